@@ -0,0 +1,602 @@
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <labhelper.hpp>
+#include <Model.hpp>
+#include <stb_image.h>
+
+#include <glm/glm.hpp>
+
+#include "heightfield.hpp"
+#include "noise.hpp"
+#include "radiance.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// CPU micro-benchmarks of the engine hot paths, at several sizes. Each case
+// is run until both a minimum number of iterations and a minimum time are
+// reached, and the results are written as JSON (--output, microbench.json by
+// default) so that they can be compared from one build to the next.
+// Checks compare implementations of the same function, e.g. the CPU and GPU
+// noise, and fail the run when they disagree beyond their tolerance.
+// GL cases run under an offscreen context, which can be a software one
+// (e.g. Mesa llvmpipe with LIBGL_ALWAYS_SOFTWARE=1).
+// Paths are relative to the build directory, as for the application.
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+    const int MIN_ITERATIONS = 5;
+    const double MIN_SECONDS = 0.25;
+
+    struct Result {
+        std::string name;
+        int size;
+        int iterations;
+        double minMs;
+        double medianMs;
+        double meanMs;
+        double maxMs;
+        // Items processed per iteration, to report a throughput
+        int items;
+    };
+
+    struct Check {
+        std::string name;
+        double maxError;
+        double tolerance;
+        int mismatches;
+    };
+
+    std::vector<Result> results;
+    std::vector<Check> checks;
+    std::vector<std::string> skipped;
+
+    // Whether the offscreen context could be created, for the GL cases
+    bool hasContext = false;
+
+    /**
+     * Time a case, after one untimed run
+     * @param size Size parameter of the case, its meaning depends on the case
+     * @param items Items processed per run, 0 if the throughput is not relevant
+     */
+    void run(const std::string& name, int size, const std::function<void()>& body, int items = 0) {
+        typedef std::chrono::high_resolution_clock clock;
+        body();
+
+        std::vector<double> times;
+        double total = 0.;
+        while ((int) times.size() < MIN_ITERATIONS || total < MIN_SECONDS * 1000.) {
+            auto start = clock::now();
+            body();
+            std::chrono::duration<double, std::milli> time = clock::now() - start;
+            times.push_back(time.count());
+            total += time.count();
+        }
+
+        std::sort(times.begin(), times.end());
+        Result result {name, size, (int) times.size(), times.front(), times[times.size() / 2],
+                       total / (double) times.size(), times.back(), items};
+        results.push_back(result);
+        std::cerr << name << " [" << size << "]: median " << result.medianMs << " ms over " << result.iterations
+                  << " iterations\n";
+    }
+
+    /**
+     * Compare two implementations over the same inputs
+     */
+    void check(const std::string& name, const std::vector<float>& expected, const std::vector<float>& actual,
+               double tolerance) {
+        Check result {name, 0., tolerance, 0};
+        for (size_t i = 0; i < expected.size(); i++) {
+            double error = std::abs((double) expected[i] - (double) actual[i]);
+            result.maxError = std::max(result.maxError, error);
+            result.mismatches += error > tolerance ? 1 : 0;
+        }
+        checks.push_back(result);
+        std::cerr << name << ": max error " << result.maxError << ", " << result.mismatches << " of "
+                  << expected.size() << " values above " << tolerance << "\n";
+    }
+
+    bool writeJson(const std::string& path) {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "ERROR: cannot write " << path << "\n";
+            return false;
+        }
+        out << std::fixed << std::setprecision(6);
+        out << "{\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << r.name << "\", \"size\": " << r.size
+                << ", \"iterations\": " << r.iterations << ", \"min_ms\": " << r.minMs << ", \"median_ms\": "
+                << r.medianMs << ", \"mean_ms\": " << r.meanMs << ", \"max_ms\": " << r.maxMs;
+            if (r.items > 0) {
+                out << ", \"items_per_second\": " << (double) r.items / (r.medianMs / 1000.);
+            }
+            out << "}";
+        }
+        out << "\n  ],\n  \"checks\": [";
+        for (size_t i = 0; i < checks.size(); i++) {
+            const Check& c = checks[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << c.name << "\", \"max_error\": " << c.maxError
+                << ", \"tolerance\": " << c.tolerance << ", \"mismatches\": " << c.mismatches << ", \"passed\": "
+                << (c.mismatches == 0 ? "true" : "false") << "}";
+        }
+        out << "\n  ],\n  \"skipped\": [";
+        for (size_t i = 0; i < skipped.size(); i++) {
+            out << (i == 0 ? "" : ", ") << "\"" << skipped[i] << "\"";
+        }
+        out << "]\n}\n";
+        return true;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Synthetic meshes: a flat grid of size x size quads, without normals so
+    // that the loader generates them
+    ///////////////////////////////////////////////////////////////////////////
+    void buildGridMesh(int size, std::vector<float>& vertices, std::vector<int>& indices) {
+        vertices.clear();
+        indices.clear();
+        for (int z = 0; z <= size; z++) {
+            for (int x = 0; x <= size; x++) {
+                // Slightly bumpy, so that the normals differ
+                vertices.push_back((float) x);
+                vertices.push_back((float) ((x * 7 + z * 13) % 5) * 0.1f);
+                vertices.push_back((float) z);
+            }
+        }
+        for (int z = 0; z < size; z++) {
+            for (int x = 0; x < size; x++) {
+                int i = z * (size + 1) + x;
+                int quad[6] = {i, i + size + 1, i + 1, i + 1, i + size + 1, i + size + 2};
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+    }
+
+    /**
+     * @return Path of the OBJ file, written with its material library next to it
+     */
+    std::string writeGridObj(int size) {
+        std::string name = "microbench_grid_" + std::to_string(size);
+        std::ofstream mtl(name + ".mtl");
+        mtl << "newmtl grid\nKd 0.8 0.8 0.8\n";
+
+        std::vector<float> vertices;
+        std::vector<int> indices;
+        buildGridMesh(size, vertices, indices);
+        std::ofstream obj(name + ".obj");
+        obj << "mtllib " << name << ".mtl\no grid\n";
+        for (size_t i = 0; i < vertices.size(); i += 3) {
+            obj << "v " << vertices[i] << " " << vertices[i + 1] << " " << vertices[i + 2] << "\n";
+            obj << "vt " << vertices[i] / (float) size << " " << vertices[i + 2] / (float) size << "\n";
+        }
+        obj << "usemtl grid\n";
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            obj << "f";
+            for (size_t j = 0; j < 3; j++) {
+                // OBJ indices start at 1
+                obj << " " << indices[i + j] + 1 << "/" << indices[i + j] + 1;
+            }
+            obj << "\n";
+        }
+        return name + ".obj";
+    }
+
+    void removeGridObj(int size) {
+        std::string name = "microbench_grid_" + std::to_string(size);
+        std::remove((name + ".obj").c_str());
+        std::remove((name + ".mtl").c_str());
+    }
+
+    bool fileExists(const std::string& path) {
+        return std::ifstream(path).good();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Cases
+///////////////////////////////////////////////////////////////////////////////
+
+void benchHeightFieldGrid() {
+    // Reused from one iteration to the next, as by HeightField::generateMesh
+    std::vector<float> positions;
+    std::vector<float> texCoords;
+    std::vector<uint32_t> indices;
+    for (int tessellation : {64, 256, 1024, 2048}) {
+        run("heightfield_grid", tessellation, [&]() {
+            HeightField::buildGrid(tessellation, positions, texCoords, indices);
+        });
+    }
+}
+
+/**
+ * Radiance .hdr files of the application, with the decoder of the engine and with stbi. Both must give the same
+ * floats.
+ */
+void benchHdrDecode() {
+    // Orientation of the files, as loaded by the application
+    stbi_set_flip_vertically_on_load(false);
+    std::vector<std::string> files = {"../scenes/envmaps/001.hdr", "../scenes/envmaps/001_irradiance.hdr"};
+    for (int level = 0; level < 8; level++) {
+        files.push_back("../scenes/envmaps/001_dl_" + std::to_string(level) + ".hdr");
+    }
+    for (const std::string& file : files) {
+        if (!fileExists(file)) {
+            skipped.push_back("hdr_decode " + file);
+            continue;
+        }
+        int width = 0, height = 0, components = 0;
+        stbi_info(file.c_str(), &width, &height, &components);
+        run("hdr_decode_stbi", width, [&]() {
+            int w, h, c;
+            float* data = stbi_loadf(file.c_str(), &w, &h, &c, 3);
+            stbi_image_free(data);
+        }, width * height);
+
+        owo::RadianceImage image;
+        std::string error;
+        run("hdr_decode", width, [&]() {
+            owo::loadRadianceImage(file, image, error);
+        }, width * height);
+        if (image.data.empty()) {
+            std::cerr << error << "\n";
+        }
+
+        int w, h, c;
+        float* data = stbi_loadf(file.c_str(), &w, &h, &c, 3);
+        if (data == nullptr) {
+            std::cerr << "ERROR: stbi cannot decode " << file << ": " << stbi_failure_reason() << "\n";
+            // Nothing to compare to, counted as one mismatch
+            check("hdr_decode_vs_stbi " + file, {0.f}, {INFINITY}, 0.);
+            continue;
+        }
+        std::vector<float> expected(data, data + (size_t) w * h * 3);
+        stbi_image_free(data);
+        // A failed decode counts as mismatches
+        image.data.resize(expected.size(), INFINITY);
+        check("hdr_decode_vs_stbi " + file, expected, image.data, 0.);
+    }
+    stbi_set_flip_vertically_on_load(true);
+
+    // Files cut short in or right after the header are rejected, 1 each
+    std::vector<std::string> truncated = {
+        "#?RADIANCE",
+        "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n",
+        "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y 4 +X 16",
+        "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y 4 +X 16\n",
+        "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y 4 +X 16\n\x02\x02\x00",
+    };
+    std::vector<float> rejected;
+    for (const std::string& header : truncated) {
+        // Exactly sized, so that reading past the end is caught by sanitizers
+        std::vector<unsigned char> bytes(header.begin(), header.end());
+        owo::RadianceImage image;
+        std::string error;
+        rejected.push_back(owo::decodeRadianceImage(bytes.data(), bytes.size(), image, error) ? 0.f : 1.f);
+    }
+    check("hdr_decode_truncated_header", std::vector<float>(truncated.size(), 1.f), rejected, 0.);
+}
+
+void benchObjParse() {
+    for (int size : {32, 128, 512}) {
+        std::string path = writeGridObj(size);
+        run("obj_parse", size, [&]() {
+            delete owo::parseModelFromOBJ(path);
+        });
+        removeGridObj(size);
+    }
+    if (fileExists("../scenes/sphere.obj")) {
+        owo::Model* sphere = owo::parseModelFromOBJ("../scenes/sphere.obj");
+        int triangles = (int) sphere->m_positions.size() / 3;
+        delete sphere;
+        run("obj_parse_sphere", triangles, []() {
+            delete owo::parseModelFromOBJ("../scenes/sphere.obj");
+        });
+    } else {
+        skipped.push_back("obj_parse_sphere");
+    }
+}
+
+void benchAutoNormals() {
+    std::vector<float> vertices;
+    std::vector<int> indices;
+    std::vector<glm::vec4> normals;
+    for (int size : {64, 256, 1024}) {
+        buildGridMesh(size, vertices, indices);
+        run("auto_normals", size, [&]() {
+            normals.assign(vertices.size() / 3, glm::vec4(0.f));
+            owo::accumulateAutoNormals(vertices, indices.data(), indices.size() / 3, 1, normals);
+            owo::averageAutoNormals(normals);
+        });
+    }
+}
+
+/**
+ * Uniforms set per frame on the terrain, with names looked up on every call or once
+ */
+void benchSetUniform() {
+    GLuint program = hasContext
+                     ? owo::loadShaderProgram("../shader/heightfield.vert", "../shader/heightfield.frag", true) : 0;
+    if (program == 0) {
+        skipped.push_back("set_uniform_slow");
+        skipped.push_back("set_uniform_cached");
+        return;
+    }
+    glUseProgram(program);
+
+    const char* vec3Names[] = {"point_light_color", "viewSpaceLightPosition", "viewSpaceLightDir"};
+    const char* floatNames[] = {"point_light_intensity_multiplier", "environment_multiplier", "densityIntensity",
+                                "heightIntensity"};
+    const char* mat4Names[] = {"lightMatrix", "modelViewMatrix", "normalMatrix", "viewInverse",
+                               "modelViewProjectionMatrix"};
+    const int UNIFORMS = 12;
+    // Calls per iteration, the frame sets them once per program
+    const int REPEAT = 100;
+
+    glm::vec3 v(1.f);
+    glm::mat4 m(1.f);
+    run("set_uniform_slow", UNIFORMS * REPEAT, [&]() {
+        for (int r = 0; r < REPEAT; r++) {
+            for (const char* name : vec3Names) {
+                owo::setUniformSlow(program, name, v);
+            }
+            for (const char* name : floatNames) {
+                owo::setUniformSlow(program, name, 1.f);
+            }
+            for (const char* name : mat4Names) {
+                owo::setUniformSlow(program, name, m);
+            }
+        }
+    });
+
+    GLint vec3Locations[3], floatLocations[4], mat4Locations[5];
+    for (int i = 0; i < 3; i++) {
+        vec3Locations[i] = glGetUniformLocation(program, vec3Names[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        floatLocations[i] = glGetUniformLocation(program, floatNames[i]);
+    }
+    for (int i = 0; i < 5; i++) {
+        mat4Locations[i] = glGetUniformLocation(program, mat4Names[i]);
+    }
+    run("set_uniform_cached", UNIFORMS * REPEAT, [&]() {
+        for (int r = 0; r < REPEAT; r++) {
+            for (GLint location : vec3Locations) {
+                glUniform3fv(location, 1, &v.x);
+            }
+            for (GLint location : floatLocations) {
+                glUniform1f(location, 1.f);
+            }
+            for (GLint location : mat4Locations) {
+                glUniformMatrix4fv(location, 1, false, &m[0].x);
+            }
+        }
+    });
+
+    glUseProgram(0);
+    glDeleteProgram(program);
+}
+
+/**
+ * @return Transform feedback program capturing the cellular noise of each vertex, 0 on failure
+ */
+GLuint createNoiseFeedbackProgram() {
+    std::string source, error;
+    if (!owo::loadShaderSource("../shader/noise_feedback.vert", source, error)) {
+        std::cerr << error << "\n";
+        return 0;
+    }
+    const char* sourcePointer = source.c_str();
+    GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(shader, 1, &sourcePointer, nullptr);
+    glCompileShader(shader);
+    GLint ok = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        std::cerr << owo::GetShaderInfoLog(shader) << "\n";
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glDeleteShader(shader);
+    const char* varying = "noise";
+    glTransformFeedbackVaryings(program, 1, &varying, GL_INTERLEAVED_ATTRIBS);
+    if (!owo::linkShaderProgram(program, true)) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+/**
+ * Cellular noise of the terrain, scalar and SIMD on the CPU and through transform feedback on the GPU. Outputs must
+ * agree: exactly between the CPU versions, within a tolerance for the GPU one, whose arithmetic may differ slightly.
+ */
+void benchNoise() {
+    // Positions as seen by the terrain shader: the grid in [-1, 1] scaled by the density of each octave, with the
+    // default density and seed
+    const int SAMPLES = 1 << 18;
+    const float GPU_TOLERANCE = 1e-3f;
+    std::vector<float> x(SAMPLES), y(SAMPLES);
+    uint32_t state = 1;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (float) (state >> 8u) / (float) (1u << 24u);
+    };
+    const float octaveScales[10] = {1.f / 16, 1.f / 8, 1.f / 4, 1.f / 2, 1.f, 2.f, 4.f, 8.f, 16.f, 32.f};
+    for (int i = 0; i < SAMPLES; i++) {
+        float scale = 6.f * octaveScales[i % 10];
+        x[i] = (2.f * random() - 1.f) * scale + 100.f;
+        y[i] = (2.f * random() - 1.f) * scale + 50.f;
+    }
+
+    std::vector<float> scalar(2 * SAMPLES);
+    run("noise_scalar", SAMPLES, [&]() {
+        for (int i = 0; i < SAMPLES; i++) {
+            glm::vec2 f = cellularNoise(glm::vec2(x[i], y[i]));
+            scalar[2 * i] = f.x;
+            scalar[2 * i + 1] = f.y;
+        }
+    }, SAMPLES);
+
+    if (cellularNoiseUsesSimd()) {
+        std::vector<float> f1(SAMPLES), f2(SAMPLES);
+        run("noise_simd", SAMPLES, [&]() {
+            cellularNoise(x.data(), y.data(), f1.data(), f2.data(), SAMPLES);
+        }, SAMPLES);
+        std::vector<float> simd(2 * SAMPLES);
+        for (int i = 0; i < SAMPLES; i++) {
+            simd[2 * i] = f1[i];
+            simd[2 * i + 1] = f2[i];
+        }
+        check("noise_simd_vs_scalar", scalar, simd, 0.);
+    } else {
+        skipped.push_back("noise_simd");
+    }
+
+    GLuint program = hasContext ? createNoiseFeedbackProgram() : 0;
+    if (program == 0) {
+        skipped.push_back("noise_gpu");
+        return;
+    }
+
+    std::vector<float> positions(2 * SAMPLES);
+    for (int i = 0; i < SAMPLES; i++) {
+        positions[2 * i] = x[i];
+        positions[2 * i + 1] = y[i];
+    }
+    GLuint vao, buffers[2];
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(2, buffers);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (positions.size() * sizeof(float)), positions.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, false, 0, nullptr);
+    glEnableVertexAttribArray(0);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1]);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, (GLsizeiptr) (positions.size() * sizeof(float)), nullptr,
+                 GL_STATIC_READ);
+
+    glUseProgram(program);
+    glEnable(GL_RASTERIZER_DISCARD);
+    run("noise_gpu", SAMPLES, [&]() {
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, SAMPLES);
+        glEndTransformFeedback();
+        glFinish();
+    }, SAMPLES);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    std::vector<float> gpu(2 * SAMPLES);
+    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, (GLsizeiptr) (gpu.size() * sizeof(float)), gpu.data());
+    check("noise_gpu_vs_scalar", scalar, gpu, GPU_TOLERANCE);
+
+    glUseProgram(0);
+    glBindVertexArray(0);
+    glDeleteBuffers(2, buffers);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteProgram(program);
+}
+
+/**
+ * Octave sums of the terrain height over the grid in [-1, 1], with all the octaves and with those faded out at the
+ * distance of a camera on the edge of the terrain, at 1080p. Sized by the mesh density intensity of the GUI, the
+ * default one and a denser one. The batched sums must be exactly those of the scalar version.
+ */
+void benchTerrainNoise() {
+    const int SIDE = 512;
+    const int COUNT = SIDE * SIDE;
+    const glm::vec2 SEED(100.f, 50.f);
+    // Field of view of 45 degrees, in model units since the view distance and the noise positions scale alike
+    const float PIXEL_FOOTPRINT = 2.f * std::tan(0.5f * 0.785398f) / 1080.f;
+    const glm::vec2 CAMERA(0.f, -1.2f);
+    const float CAMERA_HEIGHT = 0.1f;
+
+    std::vector<float> x(COUNT), z(COUNT), noFade(COUNT, 0.f), footprints(COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        x[i] = 2.f * (float) (i % SIDE) / (SIDE - 1) - 1.f;
+        z[i] = 2.f * (float) (i / SIDE) / (SIDE - 1) - 1.f;
+        glm::vec2 offset(x[i] - CAMERA.x, z[i] - CAMERA.y);
+        footprints[i] = PIXEL_FOOTPRINT * std::sqrt(offset.x * offset.x + offset.y * offset.y
+                                                    + CAMERA_HEIGHT * CAMERA_HEIGHT);
+    }
+
+    std::vector<float> sumX(COUNT), sumY(COUNT);
+    for (int densityIntensity : {300, 1000}) {
+        // As computed by the application for the shader, whatever the terrain size
+        float density = (float) densityIntensity / 50.f;
+        size_t allOctaves = 0, fadedOctaves = 0;
+        run("terrain_noise_all_octaves", densityIntensity, [&]() {
+            allOctaves = terrainNoise(x.data(), z.data(), noFade.data(), COUNT, density, SEED, sumX.data(),
+                                      sumY.data());
+        }, COUNT);
+        run("terrain_noise_faded", densityIntensity, [&]() {
+            fadedOctaves = terrainNoise(x.data(), z.data(), footprints.data(), COUNT, density, SEED, sumX.data(),
+                                        sumY.data());
+        }, COUNT);
+        std::cerr << "terrain_noise [" << densityIntensity << "]: " << 100. * (double) fadedOctaves
+                     / (double) allOctaves << "% of the octaves evaluated once faded\n";
+
+        std::vector<float> batched(2 * COUNT), scalar(2 * COUNT);
+        for (int i = 0; i < COUNT; i++) {
+            glm::vec2 sum = terrainNoise(glm::vec2(x[i], z[i]), density, SEED, footprints[i]);
+            scalar[2 * i] = sum.x;
+            scalar[2 * i + 1] = sum.y;
+            batched[2 * i] = sumX[i];
+            batched[2 * i + 1] = sumY[i];
+        }
+        check("terrain_noise_batched_vs_scalar", scalar, batched, 0.);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string output = "microbench.json";
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        }
+    }
+
+    std::vector<std::pair<std::string, std::function<void()>>> cases = {
+        {"heightfield_grid", benchHeightFieldGrid},
+        {"hdr_decode", benchHdrDecode},
+        {"obj_parse", benchObjParse},
+        {"auto_normals", benchAutoNormals},
+        {"set_uniform", benchSetUniform},
+        {"noise", benchNoise},
+        {"terrain_noise", benchTerrainNoise},
+    };
+
+    SDL_Window* hiddenWindow = nullptr;
+    hasContext = owo::init_offscreen_GL(hiddenWindow);
+
+    for (const auto& c : cases) {
+        if (filter.empty() || c.first.find(filter) != std::string::npos) {
+            c.second();
+        }
+    }
+
+    if (hasContext) {
+        owo::shutDownOffscreen(hiddenWindow);
+    }
+
+    bool passed = std::all_of(checks.begin(), checks.end(), [](const Check& c) {
+        return c.mismatches == 0;
+    });
+    return writeJson(output) && passed ? 0 : 1;
+}
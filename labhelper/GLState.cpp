@@ -0,0 +1,173 @@
+#include "GLState.hpp"
+#include <unordered_map>
+
+namespace owo {
+    namespace glstate {
+        namespace {
+            // Value of a binding whose state is not known
+            const GLuint UNKNOWN = UINT32_MAX;
+
+            struct State {
+                GLuint program = UNKNOWN;
+                GLuint vertexArray = UNKNOWN;
+                GLenum activeTextureUnit = UNKNOWN;
+                GLuint restartIndex = UNKNOWN;
+                // Indexed by target
+                std::unordered_map<GLenum, GLuint> buffers;
+                // Indexed by (target, index)
+                std::unordered_map<uint64_t, GLuint> indexedBuffers;
+                // Indexed by (unit, target)
+                std::unordered_map<uint64_t, GLuint> textures;
+                // Indexed by capability
+                std::unordered_map<GLenum, bool> enabled;
+                Counters counters;
+            };
+
+            State& state() {
+                static State s;
+                return s;
+            }
+
+            uint64_t key(uint32_t high, uint32_t low) {
+                return (uint64_t(high) << 32u) | low;
+            }
+
+            /**
+             * Record the new value of a piece of state
+             * @return True if the call must be issued
+             */
+            template<typename Map, typename Key, typename Value>
+            bool update(Map& map, const Key& k, const Value& value) {
+                auto it = map.find(k);
+                if (it != map.end() && it->second == value) {
+                    state().counters.elided++;
+                    return false;
+                }
+                map[k] = value;
+                state().counters.issued++;
+                return true;
+            }
+
+            bool update(GLuint& current, GLuint value) {
+                if (current == value) {
+                    state().counters.elided++;
+                    return false;
+                }
+                current = value;
+                state().counters.issued++;
+                return true;
+            }
+        } // namespace
+
+        void useProgram(GLuint program) {
+            if (update(state().program, program)) {
+                glUseProgram(program);
+            }
+        }
+
+        GLuint currentProgram() {
+            if (state().program == UNKNOWN) {
+                GLint program = 0;
+                glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+                state().program = (GLuint) program;
+            }
+            return state().program;
+        }
+
+        void bindVertexArray(GLuint vertexArray) {
+            if (update(state().vertexArray, vertexArray)) {
+                glBindVertexArray(vertexArray);
+                state().buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+            }
+        }
+
+        void bindBuffer(GLenum target, GLuint buffer) {
+            if (update(state().buffers, target, buffer)) {
+                glBindBuffer(target, buffer);
+            }
+        }
+
+        void bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+            if (update(state().indexedBuffers, key(target, index), buffer)) {
+                glBindBufferBase(target, index, buffer);
+                // Binding to an indexed target also binds the generic one
+                state().buffers[target] = buffer;
+            }
+        }
+
+        void activeTexture(GLenum unit) {
+            if (update(state().activeTextureUnit, unit)) {
+                glActiveTexture(unit);
+            }
+        }
+
+        void bindTexture(GLenum target, GLuint texture) {
+            if (state().activeTextureUnit == UNKNOWN) {
+                activeTexture(GL_TEXTURE0);
+            }
+            if (update(state().textures, key(state().activeTextureUnit, target), texture)) {
+                glBindTexture(target, texture);
+            }
+        }
+
+        void bindTextureUnit(GLuint unit, GLenum target, GLuint texture) {
+            auto it = state().textures.find(key(GL_TEXTURE0 + unit, target));
+            if (it != state().textures.end() && it->second == texture) {
+                state().counters.elided++;
+                return;
+            }
+            activeTexture(GL_TEXTURE0 + unit);
+            bindTexture(target, texture);
+        }
+
+        void enable(GLenum capability) {
+            if (update(state().enabled, capability, true)) {
+                glEnable(capability);
+            }
+        }
+
+        void disable(GLenum capability) {
+            if (update(state().enabled, capability, false)) {
+                glDisable(capability);
+            }
+        }
+
+        void setEnabled(GLenum capability, bool enabled) {
+            if (enabled) {
+                enable(capability);
+            } else {
+                disable(capability);
+            }
+        }
+
+        bool isEnabled(GLenum capability) {
+            auto it = state().enabled.find(capability);
+            if (it != state().enabled.end()) {
+                return it->second;
+            }
+            bool enabled = glIsEnabled(capability) == GL_TRUE;
+            state().enabled[capability] = enabled;
+            return enabled;
+        }
+
+        void primitiveRestartIndex(GLuint index) {
+            if (update(state().restartIndex, index)) {
+                glPrimitiveRestartIndex(index);
+            }
+        }
+
+        void invalidate() {
+            Counters counters = state().counters;
+            state() = State();
+            state().counters = counters;
+        }
+
+        const Counters& counters() {
+            return state().counters;
+        }
+
+        void resetCounters() {
+            state().counters = Counters();
+        }
+    } // namespace glstate
+} // namespace owo
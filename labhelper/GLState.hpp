@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <GL/glew.h>
+
+//////////////////////////////////////////////////////////////////////////////
+// Thin shadow of the OpenGL state that changes in the frame loop: program,
+// vertex array, buffer and texture bindings, and enable flags. A call that
+// would not change anything is skipped, and queries such as isEnabled() are
+// answered without a synchronous glGet.
+// NOTE: The shadow is only correct if every change of this state goes
+//       through these functions. Call invalidate() after code that changes it
+//       behind our back (e.g. third-party renderers) or after deleting
+//       objects that may still be bound.
+//////////////////////////////////////////////////////////////////////////////
+namespace owo {
+    namespace glstate {
+        struct Counters {
+            // Calls forwarded to OpenGL
+            uint64_t issued = 0;
+            // Calls skipped because the state was already set
+            uint64_t elided = 0;
+        };
+
+        void useProgram(GLuint program);
+
+        // Currently bound program, without querying GL_CURRENT_PROGRAM if it is known
+        GLuint currentProgram();
+
+        // Also forgets the element array buffer binding, which belongs to the vertex array
+        void bindVertexArray(GLuint vertexArray);
+
+        void bindBuffer(GLenum target, GLuint buffer);
+
+        void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+        // Select the texture unit, e.g. GL_TEXTURE0
+        void activeTexture(GLenum unit);
+
+        // Bind a texture to the active texture unit
+        void bindTexture(GLenum target, GLuint texture);
+
+        // Bind a texture to the given unit index, switching the active unit only if needed
+        void bindTextureUnit(GLuint unit, GLenum target, GLuint texture);
+
+        void enable(GLenum capability);
+
+        void disable(GLenum capability);
+
+        void setEnabled(GLenum capability, bool enabled);
+
+        bool isEnabled(GLenum capability);
+
+        void primitiveRestartIndex(GLuint index);
+
+        // Forget everything, the next call of each kind will be issued
+        void invalidate();
+
+        const Counters& counters();
+
+        void resetCounters();
+    } // namespace glstate
+} // namespace owo
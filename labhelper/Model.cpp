@@ -8,29 +8,40 @@
 #include <algorithm>
 #include <GL/glew.h>
 #include <stb_image.h>
+#include "GLState.hpp"
+#include "Trace.hpp"
 
 namespace owo {
     bool Texture::load(const std::string& _directory, const std::string& _filename, int _components) {
+        return loadPixels(_directory, _filename, _components) && upload();
+    }
+
+    bool Texture::loadPixels(const std::string& _directory, const std::string& _filename, int _components) {
         filename = _filename;
         directory = _directory;
         valid = true;
-        int components;
-        data = stbi_load((directory + filename).c_str(), &width, &height, &components, _components);
+        components = _components;
+        int file_components;
+        data = stbi_load((directory + filename).c_str(), &width, &height, &file_components, _components);
         if (data == nullptr) {
             std::cout << "ERROR: loadModelFromOBJ(): Failed to load texture: " << filename << " in " << _directory
                       << "\n";
             exit(1);
         }
+        return true;
+    }
+
+    bool Texture::upload() {
         glGenTextures(1, &gl_id);
-        glBindTexture(GL_TEXTURE_2D, gl_id);
+        glstate::bindTexture(GL_TEXTURE_2D, gl_id);
         GLenum format, internal_format;
-        if (_components == 1) {
+        if (components == 1) {
             format = GL_R;
             internal_format = GL_R8;
-        } else if (_components == 3) {
+        } else if (components == 3) {
             format = GL_RGB;
             internal_format = GL_RGB;
-        } else if (_components == 4) {
+        } else if (components == 4) {
             format = GL_RGBA;
             internal_format = GL_RGBA;
         } else {
@@ -51,6 +62,10 @@ namespace owo {
 // Destructor
 ///////////////////////////////////////////////////////////////////////////
     Model::~Model() {
+        // Only parsed, nothing was created
+        if (m_vaob == 0) {
+            return;
+        }
         for (auto& material: m_materials) {
             if (material.m_color_texture.valid) {
                 glDeleteTextures(1, &material.m_color_texture.gl_id);
@@ -74,9 +89,55 @@ namespace owo {
         glDeleteBuffers(1, &m_positions_bo);
         glDeleteBuffers(1, &m_normals_bo);
         glDeleteBuffers(1, &m_texture_coordinates_bo);
+        if (m_supports_indirect) {
+            glDeleteBuffers(1, &m_draw_commands_bo);
+            glDeleteBuffers(1, &m_material_indices_bo);
+            glDeleteBuffers(1, &m_materials_ubo);
+        }
+        // Deleted objects were unbound
+        glstate::invalidate();
     }
 
     Model* loadModelFromOBJ(const std::string& path) {
+        OWO_PROFILE_SCOPE("loadModelFromOBJ");
+        std::cout << "Loading " << path << "..." << std::flush;
+        Model* model = parseModelFromOBJ(path);
+        uploadModel(model);
+        std::cout << "done.\n";
+        return model;
+    }
+
+    void accumulateAutoNormals(const std::vector<float>& vertices,
+                               const int* vertex_indices,
+                               size_t triangle_count,
+                               size_t index_stride,
+                               std::vector<glm::vec4>& normals) {
+        for (size_t face = 0; face < triangle_count; face++) {
+            int i0 = vertex_indices[(face * 3 + 0) * index_stride];
+            int i1 = vertex_indices[(face * 3 + 1) * index_stride];
+            int i2 = vertex_indices[(face * 3 + 2) * index_stride];
+            glm::vec3 v0 = glm::vec3(vertices[i0 * 3 + 0], vertices[i0 * 3 + 1], vertices[i0 * 3 + 2]);
+            glm::vec3 v1 = glm::vec3(vertices[i1 * 3 + 0], vertices[i1 * 3 + 1], vertices[i1 * 3 + 2]);
+            glm::vec3 v2 = glm::vec3(vertices[i2 * 3 + 0], vertices[i2 * 3 + 1], vertices[i2 * 3 + 2]);
+
+            glm::vec3 e0 = glm::normalize(v1 - v0);
+            glm::vec3 e1 = glm::normalize(v2 - v0);
+            glm::vec3 face_normal = cross(e0, e1);
+
+            normals[i0] += glm::vec4(face_normal, 1.0f);
+            normals[i1] += glm::vec4(face_normal, 1.0f);
+            normals[i2] += glm::vec4(face_normal, 1.0f);
+        }
+    }
+
+    void averageAutoNormals(std::vector<glm::vec4>& normals) {
+        for (auto& normal: normals) {
+            normal = (1.0f / normal.w) * normal;
+        }
+    }
+
+    Model* parseModelFromOBJ(const std::string& path) {
+        OWO_PROFILE_SCOPE("parseModelFromOBJ");
         ///////////////////////////////////////////////////////////////////////
         // Separate filename into directory, base filename and extension
         // NOTE: This can be made a LOT simpler as soon as compilers properly
@@ -102,7 +163,6 @@ namespace owo {
         ///////////////////////////////////////////////////////////////////////
         // Parse the OBJ file using tinyobj
         ///////////////////////////////////////////////////////////////////////
-        std::cout << "Loading " << path << "..." << std::flush;
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
         std::vector<tinyobj::material_t> materials;
@@ -128,27 +188,27 @@ namespace owo {
             material.m_name = m.name;
             material.m_color = glm::vec3(m.diffuse[0], m.diffuse[1], m.diffuse[2]);
             if (!m.diffuse_texname.empty()) {
-                material.m_color_texture.load(directory, m.diffuse_texname, 4);
+                material.m_color_texture.loadPixels(directory, m.diffuse_texname, 4);
             }
             material.m_reflectivity = m.specular[0];
             if (!m.specular_texname.empty()) {
-                material.m_reflectivity_texture.load(directory, m.specular_texname, 1);
+                material.m_reflectivity_texture.loadPixels(directory, m.specular_texname, 1);
             }
             material.m_metalness = m.metallic;
             if (!m.metallic_texname.empty()) {
-                material.m_metalness_texture.load(directory, m.metallic_texname, 1);
+                material.m_metalness_texture.loadPixels(directory, m.metallic_texname, 1);
             }
             material.m_fresnel = m.sheen;
             if (!m.sheen_texname.empty()) {
-                material.m_fresnel_texture.load(directory, m.sheen_texname, 1);
+                material.m_fresnel_texture.loadPixels(directory, m.sheen_texname, 1);
             }
             material.m_shininess = m.roughness;
             if (!m.roughness_texname.empty()) {
-                material.m_shininess_texture.load(directory, m.roughness_texname, 1);
+                material.m_shininess_texture.loadPixels(directory, m.roughness_texname, 1);
             }
             material.m_emission = m.emission[0];
             if (!m.emissive_texname.empty()) {
-                material.m_emission_texture.load(directory, m.emissive_texname, 4);
+                material.m_emission_texture.loadPixels(directory, m.emissive_texname, 4);
             }
             material.m_transparency = m.transmittance[0];
             model->m_materials.push_back(material);
@@ -173,29 +233,14 @@ namespace owo {
         ///////////////////////////////////////////////////////////////////////
         std::vector<glm::vec4> auto_normals(attrib.vertices.size() / 3);
         for (const auto& shape: shapes) {
-            for (int face = 0; face < int(shape.mesh.indices.size()) / 3; face++) {
-                glm::vec3 v0 = glm::vec3(attrib.vertices[shape.mesh.indices[face * 3 + 0].vertex_index * 3 + 0],
-                                         attrib.vertices[shape.mesh.indices[face * 3 + 0].vertex_index * 3 + 1],
-                                         attrib.vertices[shape.mesh.indices[face * 3 + 0].vertex_index * 3 + 2]);
-                glm::vec3 v1 = glm::vec3(attrib.vertices[shape.mesh.indices[face * 3 + 1].vertex_index * 3 + 0],
-                                         attrib.vertices[shape.mesh.indices[face * 3 + 1].vertex_index * 3 + 1],
-                                         attrib.vertices[shape.mesh.indices[face * 3 + 1].vertex_index * 3 + 2]);
-                glm::vec3 v2 = glm::vec3(attrib.vertices[shape.mesh.indices[face * 3 + 2].vertex_index * 3 + 0],
-                                         attrib.vertices[shape.mesh.indices[face * 3 + 2].vertex_index * 3 + 1],
-                                         attrib.vertices[shape.mesh.indices[face * 3 + 2].vertex_index * 3 + 2]);
-
-                glm::vec3 e0 = glm::normalize(v1 - v0);
-                glm::vec3 e1 = glm::normalize(v2 - v0);
-                glm::vec3 face_normal = cross(e0, e1);
-
-                auto_normals[shape.mesh.indices[face * 3 + 0].vertex_index] += glm::vec4(face_normal, 1.0f);
-                auto_normals[shape.mesh.indices[face * 3 + 1].vertex_index] += glm::vec4(face_normal, 1.0f);
-                auto_normals[shape.mesh.indices[face * 3 + 2].vertex_index] += glm::vec4(face_normal, 1.0f);
+            if (shape.mesh.indices.empty()) {
+                continue;
             }
+            // vertex_index of each tinyobj::index_t, 3 ints apart
+            accumulateAutoNormals(attrib.vertices, &shape.mesh.indices[0].vertex_index, shape.mesh.indices.size() / 3,
+                                  sizeof(tinyobj::index_t) / sizeof(int), auto_normals);
         }
-        for (auto& normal: auto_normals) {
-            normal = (1.0f / normal.w) * normal;
-        }
+        averageAutoNormals(auto_normals);
 
         ///////////////////////////////////////////////////////////////////////
         // Now we will turn all shapes into Meshes. A shape that has several
@@ -276,34 +321,99 @@ namespace owo {
             }
         }
 
+        return model;
+    }
+
+    void uploadModel(Model* model) {
+        OWO_PROFILE_SCOPE("uploadModel");
+        for (auto& material: model->m_materials) {
+            for (Texture* texture: {&material.m_color_texture, &material.m_reflectivity_texture,
+                                    &material.m_metalness_texture, &material.m_fresnel_texture,
+                                    &material.m_shininess_texture, &material.m_emission_texture}) {
+                if (texture->valid) {
+                    texture->upload();
+                }
+            }
+        }
+
         ///////////////////////////////////////////////////////////////////////
         // Upload to GPU
         ///////////////////////////////////////////////////////////////////////
         glGenVertexArrays(1, &model->m_vaob);
-        glBindVertexArray(model->m_vaob);
+        glstate::bindVertexArray(model->m_vaob);
         glGenBuffers(1, &model->m_positions_bo);
-        glBindBuffer(GL_ARRAY_BUFFER, model->m_positions_bo);
+        glstate::bindBuffer(GL_ARRAY_BUFFER, model->m_positions_bo);
         glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (model->m_positions.size() * sizeof(glm::vec3)),
                      &model->m_positions[0].x,
                      GL_STATIC_DRAW);
         glVertexAttribPointer(0, 3, GL_FLOAT, false, 0, nullptr);
         glEnableVertexAttribArray(0);
         glGenBuffers(1, &model->m_normals_bo);
-        glBindBuffer(GL_ARRAY_BUFFER, model->m_normals_bo);
+        glstate::bindBuffer(GL_ARRAY_BUFFER, model->m_normals_bo);
         glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (model->m_normals.size() * sizeof(glm::vec3)),
                      &model->m_normals[0].x,
                      GL_STATIC_DRAW);
         glVertexAttribPointer(1, 3, GL_FLOAT, false, 0, nullptr);
         glEnableVertexAttribArray(1);
         glGenBuffers(1, &model->m_texture_coordinates_bo);
-        glBindBuffer(GL_ARRAY_BUFFER, model->m_texture_coordinates_bo);
+        glstate::bindBuffer(GL_ARRAY_BUFFER, model->m_texture_coordinates_bo);
         glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (model->m_texture_coordinates.size() * sizeof(glm::vec2)),
                      &model->m_texture_coordinates[0].x, GL_STATIC_DRAW);
         glVertexAttribPointer(2, 2, GL_FLOAT, false, 0, nullptr);
         glEnableVertexAttribArray(2);
 
-        std::cout << "done.\n";
-        return model;
+        ///////////////////////////////////////////////////////////////////////
+        // Build the indirect draw commands. Each Mesh becomes one command,
+        // whose base instance is its material index. The shader reads it back
+        // through an instanced attribute and fetches the material from a
+        // uniform block. Textures cannot be switched within a multi-draw, so
+        // textured models keep using the per-mesh path.
+        ///////////////////////////////////////////////////////////////////////
+        bool has_textures = false;
+        for (const auto& material: model->m_materials) {
+            has_textures = has_textures || material.m_color_texture.valid || material.m_reflectivity_texture.valid
+                           || material.m_metalness_texture.valid || material.m_fresnel_texture.valid
+                           || material.m_shininess_texture.valid || material.m_emission_texture.valid;
+        }
+        model->m_supports_indirect = GLEW_ARB_multi_draw_indirect && !has_textures && !model->m_meshes.empty()
+                                     && model->m_materials.size() <= MAX_BLOCK_MATERIALS;
+
+        if (model->m_supports_indirect) {
+            for (const auto& mesh: model->m_meshes) {
+                model->m_draw_commands.push_back({mesh.m_number_of_vertices, 1, mesh.m_start_index,
+                                                  mesh.m_material_idx});
+            }
+            glGenBuffers(1, &model->m_draw_commands_bo);
+            glstate::bindBuffer(GL_DRAW_INDIRECT_BUFFER, model->m_draw_commands_bo);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                         (GLsizeiptr) (model->m_draw_commands.size() * sizeof(DrawArraysIndirectCommand)),
+                         model->m_draw_commands.data(), GL_STATIC_DRAW);
+
+            std::vector<uint32_t> material_indices(model->m_materials.size());
+            std::vector<GpuMaterial> gpu_materials(model->m_materials.size());
+            for (uint32_t i = 0; i < model->m_materials.size(); i++) {
+                const Material& material = model->m_materials[i];
+                material_indices[i] = i;
+                gpu_materials[i] = {material.m_color, material.m_reflectivity, material.m_metalness,
+                                    material.m_fresnel, material.m_shininess, material.m_emission};
+            }
+
+            glGenBuffers(1, &model->m_material_indices_bo);
+            glstate::bindBuffer(GL_ARRAY_BUFFER, model->m_material_indices_bo);
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (material_indices.size() * sizeof(uint32_t)),
+                         material_indices.data(), GL_STATIC_DRAW);
+            glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, 0, nullptr);
+            glVertexAttribDivisor(3, 1);
+            glEnableVertexAttribArray(3);
+
+            glGenBuffers(1, &model->m_materials_ubo);
+            glstate::bindBuffer(GL_UNIFORM_BUFFER, model->m_materials_ubo);
+            // As large as the whole uniform block, of which only the used materials are set
+            glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr) (MAX_BLOCK_MATERIALS * sizeof(GpuMaterial)), nullptr,
+                         GL_STATIC_DRAW);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr) (gpu_materials.size() * sizeof(GpuMaterial)),
+                            gpu_materials.data());
+        }
     }
 
     void saveModelToOBJ(Model* model, const std::string& path) {
@@ -418,7 +528,7 @@ namespace owo {
 // Loop through all Meshes in the Model and render them
 ///////////////////////////////////////////////////////////////////////
     void render(const Model* model, const bool submitMaterials) {
-        glBindVertexArray(model->m_vaob);
+        glstate::bindVertexArray(model->m_vaob);
         for (auto& mesh: model->m_meshes) {
             if (submitMaterials) {
                 const Material& material = model->m_materials[mesh.m_material_idx];
@@ -430,19 +540,18 @@ namespace owo {
                 bool has_shininess_texture = material.m_shininess_texture.valid;
                 bool has_emission_texture = material.m_emission_texture.valid;
                 if (has_color_texture)
-                    glBindTextures(0, 1, &material.m_color_texture.gl_id);
+                    glstate::bindTextureUnit(0, GL_TEXTURE_2D, material.m_color_texture.gl_id);
                 if (has_reflectivity_texture)
-                    glBindTextures(1, 1, &material.m_reflectivity_texture.gl_id);
+                    glstate::bindTextureUnit(1, GL_TEXTURE_2D, material.m_reflectivity_texture.gl_id);
                 if (has_metalness_texture)
-                    glBindTextures(2, 1, &material.m_metalness_texture.gl_id);
+                    glstate::bindTextureUnit(2, GL_TEXTURE_2D, material.m_metalness_texture.gl_id);
                 if (has_fresnel_texture)
-                    glBindTextures(3, 1, &material.m_fresnel_texture.gl_id);
+                    glstate::bindTextureUnit(3, GL_TEXTURE_2D, material.m_fresnel_texture.gl_id);
                 if (has_shininess_texture)
-                    glBindTextures(4, 1, &material.m_shininess_texture.gl_id);
+                    glstate::bindTextureUnit(4, GL_TEXTURE_2D, material.m_shininess_texture.gl_id);
                 if (has_emission_texture)
-                    glBindTextures(5, 1, &material.m_emission_texture.gl_id);
-                GLint current_program = 0;
-                glGetIntegerv(GL_CURRENT_PROGRAM, &current_program);
+                    glstate::bindTextureUnit(5, GL_TEXTURE_2D, material.m_emission_texture.gl_id);
+                GLuint current_program = glstate::currentProgram();
                 glUniform1i(glGetUniformLocation(current_program, "has_color_texture"), has_color_texture);
                 glUniform1i(glGetUniformLocation(current_program, "has_diffuse_texture"),
                             has_color_texture ? 1 : 0); // FIXME
@@ -472,4 +581,35 @@ namespace owo {
             glDrawArrays(GL_TRIANGLES, (GLint) mesh.m_start_index, (GLsizei) mesh.m_number_of_vertices);
         }
     }
+
+///////////////////////////////////////////////////////////////////////
+// Submit all Meshes in the Model with a single multi-draw call
+///////////////////////////////////////////////////////////////////////
+    void renderIndirect(const Model* model, const bool submitMaterials) {
+        if (!model->m_supports_indirect) {
+            render(model, submitMaterials);
+            return;
+        }
+
+        glstate::bindVertexArray(model->m_vaob);
+        GLuint current_program = glstate::currentProgram();
+        if (submitMaterials) {
+            glUniform1i(glGetUniformLocation(current_program, "use_material_block"), 1);
+            glUniform1i(glGetUniformLocation(current_program, "has_color_texture"), 0);
+            glUniform1i(glGetUniformLocation(current_program, "has_diffuse_texture"), 0);
+            glUniform1i(glGetUniformLocation(current_program, "has_reflectivity_texture"), 0);
+            glUniform1i(glGetUniformLocation(current_program, "has_metalness_texture"), 0);
+            glUniform1i(glGetUniformLocation(current_program, "has_fresnel_texture"), 0);
+            glUniform1i(glGetUniformLocation(current_program, "has_shininess_texture"), 0);
+            glUniform1i(glGetUniformLocation(current_program, "has_emission_texture"), 0);
+            glstate::bindBufferBase(GL_UNIFORM_BUFFER, 0, model->m_materials_ubo);
+        }
+
+        glstate::bindBuffer(GL_DRAW_INDIRECT_BUFFER, model->m_draw_commands_bo);
+        glMultiDrawArraysIndirect(GL_TRIANGLES, nullptr, (GLsizei) model->m_draw_commands.size(), 0);
+
+        if (submitMaterials) {
+            glUniform1i(glGetUniformLocation(current_program, "use_material_block"), 0);
+        }
+    }
 } // namespace owo
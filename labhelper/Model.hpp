@@ -11,9 +11,16 @@ namespace owo {
         std::string filename;
         std::string directory;
         int width, height;
+        int components = 0;
         uint8_t* data = nullptr;
 
         bool load(const std::string& directory, const std::string& filename, int nof_components);
+
+        // Decode the image only, without creating the texture
+        bool loadPixels(const std::string& directory, const std::string& filename, int nof_components);
+
+        // Create the texture from the decoded image
+        bool upload();
     };
 
 //////////////////////////////////////////////////////////////////////////////
@@ -49,6 +56,27 @@ namespace owo {
         uint32_t m_number_of_vertices;
     };
 
+    // Layout of one command read by glMultiDrawArraysIndirect
+    struct DrawArraysIndirectCommand {
+        uint32_t count;
+        uint32_t instanceCount;
+        uint32_t first;
+        uint32_t baseInstance;
+    };
+
+    // Material as laid out in the std140 "MaterialBlock" uniform block
+    struct GpuMaterial {
+        glm::vec3 color;
+        float reflectivity;
+        float metalness;
+        float fresnel;
+        float shininess;
+        float emission;
+    };
+
+    // Size of the "materials" array of the uniform block, see shading.frag
+    const uint32_t MAX_BLOCK_MATERIALS = 256;
+
     class Model {
     public:
         ~Model();
@@ -66,18 +94,47 @@ namespace owo {
         std::vector<glm::vec3> m_normals;
         std::vector<glm::vec2> m_texture_coordinates;
         // Buffers on GPU
-        uint32_t m_positions_bo;
-        uint32_t m_normals_bo;
-        uint32_t m_texture_coordinates_bo;
-        // Vertex Array Object
-        uint32_t m_vaob;
+        uint32_t m_positions_bo = 0;
+        uint32_t m_normals_bo = 0;
+        uint32_t m_texture_coordinates_bo = 0;
+        // Vertex Array Object, 0 until uploaded
+        uint32_t m_vaob = 0;
+        // One indirect draw command per Mesh, the base instance is the material index
+        std::vector<DrawArraysIndirectCommand> m_draw_commands;
+        uint32_t m_draw_commands_bo = 0;
+        // Instanced attribute returning the base instance, i.e. the material index
+        uint32_t m_material_indices_bo = 0;
+        // Uniform buffer with all materials
+        uint32_t m_materials_ubo = 0;
+        // Whether all meshes can be submitted with a single multi-draw call
+        bool m_supports_indirect = false;
     };
 
     Model* loadModelFromOBJ(const std::string& filename);
 
+    // Parse and de-index an OBJ file and decode its textures, without any GL call
+    Model* parseModelFromOBJ(const std::string& filename);
+
+    // Create the GL objects of a parsed model
+    void uploadModel(Model* model);
+
+    // Add the normal of each triangle to its 3 vertex positions, w counting the triangles.
+    // The position indices of triangle i are vertex_indices[(3 * i + k) * index_stride], k in [0, 3[
+    void accumulateAutoNormals(const std::vector<float>& vertices,
+                               const int* vertex_indices,
+                               size_t triangle_count,
+                               size_t index_stride,
+                               std::vector<glm::vec4>& normals);
+
+    // Turn the accumulated normals into the average normal of each vertex position
+    void averageAutoNormals(std::vector<glm::vec4>& normals);
+
     void saveModelToOBJ(Model* model, const std::string& filename);
 
     void freeModel(Model* model);
 
     void render(const Model* model, bool submitMaterials = true);
+
+    // Render all meshes with one glMultiDrawArraysIndirect call, falls back to render() when unsupported
+    void renderIndirect(const Model* model, bool submitMaterials = true);
 } // namespace owo
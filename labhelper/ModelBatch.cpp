@@ -0,0 +1,172 @@
+#include "ModelBatch.hpp"
+#include "GLState.hpp"
+#include <algorithm>
+#include <iostream>
+#include <GL/glew.h>
+
+namespace owo {
+    ModelBatch::~ModelBatch() {
+        destroy();
+    }
+
+    void ModelBatch::destroy() {
+        if (m_vaob == 0) {
+            return;
+        }
+        glDeleteBuffers(1, &m_positions_ssbo);
+        glDeleteBuffers(1, &m_normals_ssbo);
+        glDeleteBuffers(1, &m_texture_coordinates_ssbo);
+        glDeleteBuffers(1, &m_draws_ssbo);
+        glDeleteBuffers(1, &m_materials_ubo);
+        glDeleteBuffers(1, &m_draw_commands_bo);
+        glDeleteBuffers(1, &m_draw_indices_bo);
+        glDeleteVertexArrays(1, &m_vaob);
+        m_positions_ssbo = m_normals_ssbo = m_texture_coordinates_ssbo = m_draws_ssbo = 0;
+        m_materials_ubo = m_draw_commands_bo = m_draw_indices_bo = m_vaob = 0;
+        // Deleted objects were unbound
+        glstate::invalidate();
+    }
+
+    bool ModelBatch::isSupported() {
+        return GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_multi_draw_indirect;
+    }
+
+    uint32_t ModelBatch::addModel(const Model* model) {
+        BatchedModel batched;
+        batched.model = model;
+        batched.firstVertex = (uint32_t) (m_positions.size() / 3);
+        batched.firstMaterial = (uint32_t) m_materials.size();
+
+        for (uint64_t i = 0; i < model->m_positions.size(); i++) {
+            m_positions.push_back(model->m_positions[i].x);
+            m_positions.push_back(model->m_positions[i].y);
+            m_positions.push_back(model->m_positions[i].z);
+            m_normals.push_back(model->m_normals[i].x);
+            m_normals.push_back(model->m_normals[i].y);
+            m_normals.push_back(model->m_normals[i].z);
+        }
+        m_texture_coordinates.insert(m_texture_coordinates.end(), model->m_texture_coordinates.begin(),
+                                     model->m_texture_coordinates.end());
+
+        for (const auto& material: model->m_materials) {
+            m_materials.push_back({material.m_color, material.m_reflectivity, material.m_metalness,
+                                   material.m_fresnel, material.m_shininess, material.m_emission});
+        }
+        if (m_materials.size() > MAX_BLOCK_MATERIALS) {
+            std::cout << "ModelBatch: more than " << MAX_BLOCK_MATERIALS << " materials, "
+                      << model->m_name << " will not be shaded correctly.\n";
+        }
+
+        m_models.push_back(batched);
+        return (uint32_t) m_models.size() - 1;
+    }
+
+    uint32_t ModelBatch::addInstance(uint32_t modelIndex, const glm::mat4& modelMatrix) {
+        const BatchedModel& batched = m_models[modelIndex];
+
+        BatchedInstance instance;
+        instance.firstDraw = (uint32_t) m_draws.size();
+        instance.numberOfDraws = (uint32_t) batched.model->m_meshes.size();
+
+        for (const auto& mesh: batched.model->m_meshes) {
+            GpuDraw draw = {};
+            draw.modelMatrix = modelMatrix;
+            draw.materialIndex = batched.firstMaterial + mesh.m_material_idx;
+
+            m_draw_commands.push_back({mesh.m_number_of_vertices, 1, batched.firstVertex + mesh.m_start_index,
+                                       (uint32_t) m_draws.size()});
+            m_draws.push_back(draw);
+        }
+
+        m_instances.push_back(instance);
+        return (uint32_t) m_instances.size() - 1;
+    }
+
+    void ModelBatch::setInstanceTransform(uint32_t instanceIndex, const glm::mat4& modelMatrix) {
+        const BatchedInstance& instance = m_instances[instanceIndex];
+        for (uint32_t i = instance.firstDraw; i < instance.firstDraw + instance.numberOfDraws; i++) {
+            m_draws[i].modelMatrix = modelMatrix;
+        }
+        m_draws_dirty = true;
+    }
+
+    void ModelBatch::upload() {
+        ///////////////////////////////////////////////////////////////////////
+        // Shared vertex storage, read by the vertex shader from gl_VertexID
+        ///////////////////////////////////////////////////////////////////////
+        glGenBuffers(1, &m_positions_ssbo);
+        glstate::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_positions_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr) (m_positions.size() * sizeof(float)),
+                     m_positions.data(), GL_STATIC_DRAW);
+        glGenBuffers(1, &m_normals_ssbo);
+        glstate::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_normals_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr) (m_normals.size() * sizeof(float)),
+                     m_normals.data(), GL_STATIC_DRAW);
+        glGenBuffers(1, &m_texture_coordinates_ssbo);
+        glstate::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_texture_coordinates_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER,
+                     (GLsizeiptr) (m_texture_coordinates.size() * sizeof(glm::vec2)),
+                     m_texture_coordinates.data(), GL_STATIC_DRAW);
+        glGenBuffers(1, &m_draws_ssbo);
+        glstate::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_draws_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr) (m_draws.size() * sizeof(GpuDraw)),
+                     m_draws.data(), GL_DYNAMIC_DRAW);
+
+        glGenBuffers(1, &m_materials_ubo);
+        glstate::bindBuffer(GL_UNIFORM_BUFFER, m_materials_ubo);
+        // As large as the whole uniform block, of which only the used materials are set
+        size_t materialCount = std::min(m_materials.size(), (size_t) MAX_BLOCK_MATERIALS);
+        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr) (MAX_BLOCK_MATERIALS * sizeof(GpuMaterial)), nullptr,
+                     GL_STATIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr) (materialCount * sizeof(GpuMaterial)), m_materials.data());
+
+        glGenBuffers(1, &m_draw_commands_bo);
+        glstate::bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_draw_commands_bo);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                     (GLsizeiptr) (m_draw_commands.size() * sizeof(DrawArraysIndirectCommand)),
+                     m_draw_commands.data(), GL_STATIC_DRAW);
+
+        ///////////////////////////////////////////////////////////////////////
+        // The only vertex attribute is instanced and returns the base
+        // instance of the command, i.e. the index of the per-draw data
+        ///////////////////////////////////////////////////////////////////////
+        std::vector<uint32_t> draw_indices(m_draws.size());
+        for (uint32_t i = 0; i < draw_indices.size(); i++) {
+            draw_indices[i] = i;
+        }
+        glGenVertexArrays(1, &m_vaob);
+        glstate::bindVertexArray(m_vaob);
+        glGenBuffers(1, &m_draw_indices_bo);
+        glstate::bindBuffer(GL_ARRAY_BUFFER, m_draw_indices_bo);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (draw_indices.size() * sizeof(uint32_t)), draw_indices.data(),
+                     GL_STATIC_DRAW);
+        glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, 0, nullptr);
+        glVertexAttribDivisor(0, 1);
+        glEnableVertexAttribArray(0);
+
+        m_draws_dirty = false;
+    }
+
+    void ModelBatch::render() {
+        if (m_draw_commands.empty()) {
+            return;
+        }
+
+        if (m_draws_dirty) {
+            glstate::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_draws_ssbo);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr) (m_draws.size() * sizeof(GpuDraw)),
+                            m_draws.data());
+            m_draws_dirty = false;
+        }
+
+        glstate::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_positions_ssbo);
+        glstate::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_normals_ssbo);
+        glstate::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_texture_coordinates_ssbo);
+        glstate::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_draws_ssbo);
+        glstate::bindBufferBase(GL_UNIFORM_BUFFER, 0, m_materials_ubo);
+
+        glstate::bindVertexArray(m_vaob);
+        glstate::bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_draw_commands_bo);
+        glMultiDrawArraysIndirect(GL_TRIANGLES, nullptr, (GLsizei) m_draw_commands.size(), 0);
+    }
+} // namespace owo
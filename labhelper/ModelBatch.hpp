@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "Model.hpp"
+
+namespace owo {
+    // Per-draw data as laid out in the std430 "DrawBlock" storage block, see pulling.vert
+    struct GpuDraw {
+        glm::mat4 modelMatrix;
+        uint32_t materialIndex;
+        uint32_t padding[3];
+    };
+
+//////////////////////////////////////////////////////////////////////////////
+// A ModelBatch stores the geometry of several models in shared storage
+// buffers. The vertex shader fetches the attributes itself ("vertex
+// pulling") from gl_VertexID, which starts at the first vertex of the draw,
+// so no per-model VAO has to be bound and every mesh of every instance is
+// submitted with a single glMultiDrawArraysIndirect call. The base instance
+// of each command is the index of its per-draw data (model matrix and
+// material).
+// NOTE: Material textures are not bound, only the material constants are
+//       available to the shader through the "MaterialBlock" uniform block.
+//////////////////////////////////////////////////////////////////////////////
+    class ModelBatch {
+    public:
+        ModelBatch() = default;
+        ModelBatch(const ModelBatch&) = delete;
+        ModelBatch& operator=(const ModelBatch&) = delete;
+        ~ModelBatch();
+
+        // Delete the GPU buffers, while the context still exists. Also done by the destructor.
+        void destroy();
+
+        // Whether the driver supports storage buffers and multi-draw indirect
+        static bool isSupported();
+
+        // Append the geometry and materials of a model, returns its index in the batch
+        uint32_t addModel(const Model* model);
+
+        // Add an instance of a model previously added, returns the instance index
+        uint32_t addInstance(uint32_t modelIndex, const glm::mat4& modelMatrix);
+
+        // Move an instance, the per-draw data is uploaded again on the next render()
+        void setInstanceTransform(uint32_t instanceIndex, const glm::mat4& modelMatrix);
+
+        // Create the GPU buffers, must be called once all models and instances are added
+        void upload();
+
+        // Draw all instances with one call, the pulling shader must be bound
+        void render();
+
+    private:
+        struct BatchedModel {
+            const Model* model;
+            // First vertex of this model in the shared buffers
+            uint32_t firstVertex;
+            // First material of this model in the shared material block
+            uint32_t firstMaterial;
+        };
+
+        struct BatchedInstance {
+            // Range of per-draw data owned by this instance, one per mesh
+            uint32_t firstDraw;
+            uint32_t numberOfDraws;
+        };
+
+        std::vector<BatchedModel> m_models;
+        std::vector<BatchedInstance> m_instances;
+
+        // Buffers on CPU
+        std::vector<float> m_positions;
+        std::vector<float> m_normals;
+        std::vector<glm::vec2> m_texture_coordinates;
+        std::vector<GpuMaterial> m_materials;
+        std::vector<GpuDraw> m_draws;
+        std::vector<DrawArraysIndirectCommand> m_draw_commands;
+
+        // Buffers on GPU
+        uint32_t m_positions_ssbo = 0;
+        uint32_t m_normals_ssbo = 0;
+        uint32_t m_texture_coordinates_ssbo = 0;
+        uint32_t m_draws_ssbo = 0;
+        uint32_t m_materials_ubo = 0;
+        uint32_t m_draw_commands_bo = 0;
+        uint32_t m_draw_indices_bo = 0;
+        // Vertex Array Object, only holds the draw index attribute
+        uint32_t m_vaob = 0;
+
+        bool m_draws_dirty = false;
+    };
+} // namespace owo
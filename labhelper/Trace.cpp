@@ -0,0 +1,148 @@
+#include "Trace.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace owo {
+    namespace trace {
+        namespace {
+            struct Event {
+                const char* name;
+                uint64_t startNs;
+                uint64_t endNs;
+            };
+
+            // Slot of the ring, atomic as writeChromeTrace() may read it while its thread overwrites it
+            struct EventSlot {
+                std::atomic<const char*> name {nullptr};
+                std::atomic<uint64_t> startNs {0};
+                std::atomic<uint64_t> endNs {0};
+            };
+
+            // Written by its thread only, read by writeChromeTrace()
+            struct ThreadBuffer {
+                uint32_t threadId;
+                std::atomic<uint64_t> written {0};
+                EventSlot events[RING_CAPACITY];
+            };
+
+            // Buffers are registered once per thread and never freed, so that the events of threads that
+            // exited can still be written
+            std::mutex& registryMutex() {
+                static std::mutex m;
+                return m;
+            }
+
+            std::vector<ThreadBuffer*>& registry() {
+                static std::vector<ThreadBuffer*> buffers;
+                return buffers;
+            }
+
+            ThreadBuffer* threadBuffer() {
+                thread_local ThreadBuffer* buffer = nullptr;
+                if (buffer == nullptr) {
+                    buffer = new ThreadBuffer();
+                    std::lock_guard<std::mutex> lock(registryMutex());
+                    buffer->threadId = (uint32_t) registry().size() + 1;
+                    registry().push_back(buffer);
+                }
+                return buffer;
+            }
+
+            const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+            void writeEscaped(std::ostream& out, const char* s) {
+                for (; *s != '\0'; s++) {
+                    if (*s == '"' || *s == '\\') {
+                        out << '\\';
+                    }
+                    out << *s;
+                }
+            }
+        } // namespace
+
+        namespace detail {
+            std::atomic<bool> enabled {false};
+
+            uint64_t nowNanoseconds() noexcept {
+                return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - epoch).count();
+            }
+
+            void record(const char* name, uint64_t startNs, uint64_t endNs) noexcept {
+                ThreadBuffer* buffer = threadBuffer();
+                uint64_t index = buffer->written.load(std::memory_order_relaxed);
+                // A reader that sees any of the stores below also sees written == index, so it knows the slot
+                // is being overwritten
+                std::atomic_thread_fence(std::memory_order_release);
+                EventSlot& slot = buffer->events[index % RING_CAPACITY];
+                slot.name.store(name, std::memory_order_relaxed);
+                slot.startNs.store(startNs, std::memory_order_relaxed);
+                slot.endNs.store(endNs, std::memory_order_relaxed);
+                buffer->written.store(index + 1, std::memory_order_release);
+            }
+        } // namespace detail
+
+        void setEnabled(bool enabled) noexcept {
+            detail::enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        bool writeChromeTrace(const std::string& path) {
+            std::ofstream out(path);
+            if (!out) {
+                std::cout << "ERROR: writeChromeTrace(): Cannot open " << path << "\n";
+                return false;
+            }
+
+            std::vector<ThreadBuffer*> buffers;
+            {
+                std::lock_guard<std::mutex> lock(registryMutex());
+                buffers = registry();
+            }
+
+            // Microseconds, with nanosecond resolution
+            out << std::fixed << std::setprecision(3);
+            out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            bool first = true;
+            size_t count = 0;
+            for (ThreadBuffer* buffer : buffers) {
+                uint64_t written = buffer->written.load(std::memory_order_acquire);
+                uint64_t begin = written > RING_CAPACITY ? written - RING_CAPACITY : 0;
+                std::vector<Event> events;
+                events.reserve((size_t) (written - begin));
+                for (uint64_t i = begin; i < written; i++) {
+                    const EventSlot& slot = buffer->events[i % RING_CAPACITY];
+                    events.push_back({slot.name.load(std::memory_order_relaxed),
+                                      slot.startNs.load(std::memory_order_relaxed),
+                                      slot.endNs.load(std::memory_order_relaxed)});
+                }
+
+                // Events overwritten by the thread while copying are dropped: event i may be torn if the thread
+                // had started writing event i + RING_CAPACITY, in the same slot
+                std::atomic_thread_fence(std::memory_order_acquire);
+                uint64_t after = buffer->written.load(std::memory_order_relaxed);
+                uint64_t lost = after >= begin + RING_CAPACITY ? after - begin - RING_CAPACITY + 1 : 0;
+                size_t overwritten = (size_t) std::min<uint64_t>(events.size(), lost);
+                events.erase(events.begin(), events.begin() + (std::ptrdiff_t) overwritten);
+
+                for (const Event& event : events) {
+                    out << (first ? "\n" : ",\n");
+                    first = false;
+                    out << "{\"name\":\"";
+                    writeEscaped(out, event.name);
+                    out << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                        << ",\"ts\":" << (double) event.startNs / 1000.0
+                        << ",\"dur\":" << (double) (event.endNs - event.startNs) / 1000.0 << "}";
+                    count++;
+                }
+            }
+            out << "\n]}\n";
+
+            std::cout << "Wrote " << count << " trace events to " << path << "\n";
+            return true;
+        }
+    } // namespace trace
+} // namespace owo
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+//////////////////////////////////////////////////////////////////////////////
+// Scoped CPU profiler. OWO_PROFILE_SCOPE("name") records the time spent until
+// the end of the enclosing scope into a ring buffer owned by the calling
+// thread, so that recording never takes a lock. The events still in the
+// buffers can be written as a Chrome trace_event JSON file, to be opened in
+// chrome://tracing or Perfetto.
+// Recording is off by default and costs a relaxed atomic load per scope
+// while off. Defining OWO_DISABLE_TRACE compiles the scopes out entirely.
+// NOTE: Names must be string literals (or otherwise outlive the dump), only
+//       the pointer is stored.
+//////////////////////////////////////////////////////////////////////////////
+namespace owo {
+    namespace trace {
+        // Events kept per thread, older ones are overwritten
+        const uint32_t RING_CAPACITY = 1u << 16u;
+
+        namespace detail {
+            extern std::atomic<bool> enabled;
+
+            uint64_t nowNanoseconds() noexcept;
+
+            void record(const char* name, uint64_t startNs, uint64_t endNs) noexcept;
+        } // namespace detail
+
+        inline bool isEnabled() noexcept {
+            return detail::enabled.load(std::memory_order_relaxed);
+        }
+
+        void setEnabled(bool enabled) noexcept;
+
+        // Write the recorded events of all threads as Chrome trace_event JSON
+        bool writeChromeTrace(const std::string& path);
+
+        class Scope {
+        public:
+            explicit Scope(const char* name) noexcept :
+                m_name(isEnabled() ? name : nullptr),
+                m_start(m_name != nullptr ? detail::nowNanoseconds() : 0) {}
+
+            ~Scope() {
+                if (m_name != nullptr) {
+                    detail::record(m_name, m_start, detail::nowNanoseconds());
+                }
+            }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            const char* m_name;
+            uint64_t m_start;
+        };
+    } // namespace trace
+} // namespace owo
+
+#define OWO_TRACE_CONCAT_IMPL(a, b) a##b
+#define OWO_TRACE_CONCAT(a, b) OWO_TRACE_CONCAT_IMPL(a, b)
+
+#ifdef OWO_DISABLE_TRACE
+#define OWO_PROFILE_SCOPE(name) do {} while (false)
+#else
+#define OWO_PROFILE_SCOPE(name) ::owo::trace::Scope OWO_TRACE_CONCAT(owoTraceScope, __LINE__)(name)
+#endif
@@ -4,11 +4,13 @@
 #   define NOMINMAX //          - Macros min(a,b) and max(a,b)
 
 #   include <windows.h>
+#   include <direct.h>
 
 #   undef near
 #   undef far
 #else
 #   include <signal.h>
+#   include <sys/stat.h>
 #endif // WIN32
 
 #include <GL/glew.h>
@@ -23,7 +25,15 @@
 #include <stb_image_write.h>
 
 #include "labhelper.hpp"
+#include "GLState.hpp"
 
+#ifdef OWO_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cerrno>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include <cstdlib>
@@ -44,6 +54,120 @@
 using std::vector;
 
 namespace owo {
+    namespace {
+        /**
+         * Attributes of the context and default framebuffer created by SDL
+         */
+        void setSDLGLAttributes() {
+            // Request an OpenGL 4.1 context (should be core)
+            SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+
+#ifdef HDR_FRAMEBUFFER
+            SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 16);
+            SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 16);
+            SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 16);
+            SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 16);
+#endif
+
+            // Also request a depth buffer
+            SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+            SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+        }
+
+        /**
+         * Initialization common to all contexts, once current
+         * @return False if GLEW reported an error
+         */
+        bool initGLCommon() {
+            // Initialize GLEW; this gives us access to OpenGL Extensions.
+            GLenum glewError = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+            // GLX-based GLEW cannot query GLX without an X display, but loads the GL functions anyway
+            if (glewError == GLEW_ERROR_NO_GLX_DISPLAY) {
+                glewError = GLEW_OK;
+            }
+#endif
+            if (glewError != GLEW_OK) {
+                fprintf(stderr, "%s: %s\n", "Couldn't initialize GLEW",
+                        (const char*) glewGetErrorString(glewError));
+            }
+
+            // Check OpenGL properties
+            owo::startupGLDiagnostics();
+            owo::setupGLDebugMessages();
+
+            // Flip textures vertically so they don't end up upside-down.
+            stbi_set_flip_vertically_on_load(true);
+
+            /* Workaround for AMD. It might no longer be necessary, but I dunno if we
+                * are ever going to remove it. (Consider it a piece of living history.)
+                */
+            if (!glBindFragDataLocation) {
+                glBindFragDataLocation = glBindFragDataLocationEXT;
+            }
+            return glewError == GLEW_OK;
+        }
+
+#ifdef OWO_HAS_EGL
+        EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+        EGLContext eglContext = EGL_NO_CONTEXT;
+
+        /**
+         * Create and make current an OpenGL 4.1 core context without any surface
+         */
+        bool initSurfacelessEGL() {
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+            // Does not need any display server, e.g. llvmpipe on a CI machine
+            auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay != nullptr) {
+                eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            }
+#endif
+            if (eglDisplay == EGL_NO_DISPLAY) {
+                eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            }
+            if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, nullptr, nullptr)) {
+                eglDisplay = EGL_NO_DISPLAY;
+                return false;
+            }
+
+            const char* extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+            EGLConfig config;
+            EGLint configCount = 0;
+            const EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+            if (extensions == nullptr || strstr(extensions, "EGL_KHR_surfaceless_context") == nullptr
+                || !eglBindAPI(EGL_OPENGL_API)
+                || !eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) || configCount == 0) {
+                eglTerminate(eglDisplay);
+                eglDisplay = EGL_NO_DISPLAY;
+                return false;
+            }
+
+            const EGLint contextAttributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+                EGL_CONTEXT_MINOR_VERSION_KHR, 1,
+                EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+                EGL_NONE
+            };
+            eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+            if (eglContext == EGL_NO_CONTEXT
+                || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+                if (eglContext != EGL_NO_CONTEXT) {
+                    eglDestroyContext(eglDisplay, eglContext);
+                    eglContext = EGL_NO_CONTEXT;
+                }
+                eglTerminate(eglDisplay);
+                eglDisplay = EGL_NO_DISPLAY;
+                return false;
+            }
+            return true;
+        }
+#endif
+    } // namespace
+
     SDL_Window* init_window_SDL(std::string caption, int width, int height) {
         // Initialize SDL
         if (SDL_Init(SDL_INIT_VIDEO) < 0) {
@@ -53,22 +177,7 @@ namespace owo {
         atexit(SDL_Quit);
         SDL_GL_LoadLibrary(nullptr); // Default OpenGL is fine.
 
-        // Request an OpenGL 4.1 context (should be core)
-        SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
-        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
-        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
-        SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
-
-#ifdef HDR_FRAMEBUFFER
-        SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 16);
-        SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 16);
-        SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 16);
-        SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 16);
-#endif
-
-        // Also request a depth buffer
-        SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-        SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+        setSDLGLAttributes();
 
         // Create the window
         SDL_Window* window = SDL_CreateWindow(caption.c_str(), SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
@@ -85,31 +194,74 @@ namespace owo {
             return nullptr;
         }
 
-        // Initialize GLEW; this gives us access to OpenGL Extensions.
-        glewInit();
+        initGLCommon();
 
         // Initialize ImGui; will allow us to edit variables in the application.
         ImGui_ImplSdlGL3_Init(window);
 
-        // Check OpenGL properties
-        owo::startupGLDiagnostics();
-        owo::setupGLDebugMessages();
-
-        // Flip textures vertically so they don't end up upside-down.
-        stbi_set_flip_vertically_on_load(true);
-
         // 1 for v-sync
         SDL_GL_SetSwapInterval(1);
 
-        /* Workaround for AMD. It might no longer be necessary, but I dunno if we
-            * are ever going to remove it. (Consider it a piece of living history.)
-            */
-        if (!glBindFragDataLocation) {
-            glBindFragDataLocation = glBindFragDataLocationEXT;
-        }
         return window;
     }
 
+    bool init_offscreen_GL(SDL_Window*& hiddenWindow) {
+        hiddenWindow = nullptr;
+
+#ifdef OWO_HAS_EGL
+        if (initSurfacelessEGL()) {
+            return initGLCommon();
+        }
+        std::cout << "No surfaceless EGL context available, using a hidden window\n";
+#endif
+
+        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+            fprintf(stderr, "%s: %s\n", "Couldn't initialize SDL", SDL_GetError());
+            return false;
+        }
+        SDL_GL_LoadLibrary(nullptr);
+        setSDLGLAttributes();
+
+        hiddenWindow = SDL_CreateWindow("Offscreen", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1, 1,
+                                        SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+        if (hiddenWindow == nullptr) {
+            fprintf(stderr, "%s: %s\n", "Couldn't create hidden window", SDL_GetError());
+            SDL_Quit();
+            return false;
+        }
+
+        SDL_GLContext context = SDL_GL_CreateContext(hiddenWindow);
+        if (context == nullptr) {
+            fprintf(stderr, "%s: %s\n", "Failed to create OpenGL context", SDL_GetError());
+            SDL_DestroyWindow(hiddenWindow);
+            hiddenWindow = nullptr;
+            SDL_Quit();
+            return false;
+        }
+
+        // Never wait for the display
+        SDL_GL_SetSwapInterval(0);
+
+        return initGLCommon();
+    }
+
+    void shutDownOffscreen(SDL_Window* hiddenWindow) {
+#ifdef OWO_HAS_EGL
+        if (eglDisplay != EGL_NO_DISPLAY) {
+            eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(eglDisplay, eglContext);
+            eglTerminate(eglDisplay);
+            eglContext = EGL_NO_CONTEXT;
+            eglDisplay = EGL_NO_DISPLAY;
+        }
+#endif
+        if (hiddenWindow != nullptr) {
+            SDL_GL_DeleteContext(SDL_GL_GetCurrentContext());
+            SDL_DestroyWindow(hiddenWindow);
+            SDL_Quit();
+        }
+    }
+
     GLuint loadCubeMap(const char* facePosX,
                        const char* faceNegX,
                        const char* facePosY,
@@ -143,7 +295,7 @@ namespace owo {
         //************************************************
         //	 Load the faces into the cube map texture
         //************************************************
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        glstate::bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
         tempTexHelper::loadCubeMapFace(facePosX, GL_TEXTURE_CUBE_MAP_POSITIVE_X);
         tempTexHelper::loadCubeMapFace(faceNegX, GL_TEXTURE_CUBE_MAP_NEGATIVE_X);
@@ -455,61 +607,382 @@ namespace owo {
     }
 
 
-    GLuint loadShaderProgram(const std::string& vertexShader, const std::string& fragmentShader, bool allow_errors) {
-        GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
-        GLuint fShader = glCreateShader(GL_FRAGMENT_SHADER);
+    namespace {
+        // Include chains deeper than this are assumed to be cycles
+        const int MAX_INCLUDE_DEPTH = 16;
+
+        bool expandIncludes(const std::string& path, std::string& source, int depth, int& sourceCount,
+                            std::string& error, std::vector<std::string>* files) {
+            if (depth > MAX_INCLUDE_DEPTH) {
+                error = "Too many nested includes in " + path;
+                return false;
+            }
+            if (files != nullptr) {
+                files->push_back(path);
+            }
+            std::ifstream file(path);
+            if (!file) {
+                error = "Cannot open " + path;
+                return false;
+            }
+
+            size_t separator = path.find_last_of("\\/");
+            std::string directory = separator == std::string::npos ? "" : path.substr(0, separator + 1);
+            int sourceNumber = sourceCount++;
+
+            std::string line;
+            int lineNumber = 0;
+            while (std::getline(file, line)) {
+                lineNumber++;
+                size_t start = line.find_first_not_of(" \t");
+                if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+                    source += line + "\n";
+                    continue;
+                }
+
+                size_t open = line.find('"', start);
+                size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+                if (close == std::string::npos) {
+                    error = path + "(" + std::to_string(lineNumber) + "): Expecting #include \"file\"";
+                    return false;
+                }
+                // Line numbers of errors then refer to the right file, numbered by order of inclusion
+                source += "#line 1 " + std::to_string(sourceCount) + "\n";
+                if (!expandIncludes(directory + line.substr(open + 1, close - open - 1), source, depth + 1,
+                                    sourceCount, error, files)) {
+                    return false;
+                }
+                source += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceNumber) + "\n";
+            }
+            return true;
+        }
+    }
 
-        std::ifstream vs_file(vertexShader);
-        std::string vs_src((std::istreambuf_iterator<char>(vs_file)), std::istreambuf_iterator<char>());
+    bool loadShaderSource(const std::string& path,
+                          std::string& source,
+                          std::string& error,
+                          std::vector<std::string>* files) {
+        source.clear();
+        if (files != nullptr) {
+            files->clear();
+        }
+        int sourceCount = 0;
+        return expandIncludes(path, source, 0, sourceCount, error, files);
+    }
 
-        std::ifstream fs_file(fragmentShader);
-        std::string fs_src((std::istreambuf_iterator<char>(fs_file)), std::istreambuf_iterator<char>());
+    std::string injectDefines(const std::string& source, const ShaderDefines& defines) {
+        if (defines.empty()) {
+            return source;
+        }
+        // Only comments and blank lines may come before #version
+        size_t version = source.find("#version");
+        size_t insert = version == std::string::npos ? 0 : source.find('\n', version);
+        insert = insert == std::string::npos ? source.size() : insert + 1;
+
+        std::string block;
+        for (const std::string& define : defines) {
+            block += "#define " + define + "\n";
+        }
+        long nextLine = 1 + std::count(source.begin(), source.begin() + (std::ptrdiff_t) insert, '\n');
+        block += "#line " + std::to_string(nextLine) + " 0\n";
+        return source.substr(0, insert) + block + source.substr(insert);
+    }
+
+    std::string shaderProgramName(const std::string& vertexShader,
+                                  const std::string& fragmentShader,
+                                  const ShaderDefines& defines) {
+        std::string name = vertexShader + " + " + fragmentShader;
+        for (size_t i = 0; i < defines.size(); i++) {
+            name += (i == 0 ? " [" : ", ") + defines[i];
+        }
+        return defines.empty() ? name : name + "]";
+    }
+
+    bool ensureDirectory(const std::string& path) {
+#if defined(_WIN32)
+        int result = _mkdir(path.c_str());
+#else
+        int result = mkdir(path.c_str(), 0755);
+#endif
+        if (result != 0 && errno != EEXIST) {
+            std::cout << "ERROR: ensureDirectory(): Cannot create " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t hashString(const std::string& data, uint64_t hash) {
+        const uint64_t FNV_PRIME = 1099511628211ull;
+        for (unsigned char c : data) {
+            hash ^= c;
+            hash *= FNV_PRIME;
+        }
+        // Separates consecutive strings, so that moving text from one to the next changes the hash
+        hash ^= 0xffu;
+        hash *= FNV_PRIME;
+        return hash;
+    }
+
+// Program binary cache
+    namespace {
+        std::string programCacheDirectory;
+
+        // "OWPB", then the binary format, the key, the binary size and the binary
+        const uint32_t PROGRAM_CACHE_MAGIC = 0x4250574fu;
+
+        std::string glString(GLenum name) {
+            const GLubyte* value = glGetString(name);
+            return value != nullptr ? (const char*) value : "";
+        }
+
+        /**
+         * @return Key of a program, from its expanded sources and the driver, which may not load binaries from
+         *         another version
+         */
+        uint64_t programCacheKey(const std::string& vs_src, const std::string& fs_src) {
+            static const uint64_t driverHash = [] {
+                uint64_t hash = hashString(glString(GL_VENDOR));
+                for (GLenum name : {GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+                    hash = hashString(glString(name), hash);
+                }
+                return hash;
+            }();
+            return hashString(fs_src, hashString(vs_src, driverHash));
+        }
+
+        bool programBinarySupported() {
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            return formats > 0;
+        }
+
+        /**
+         * @return Program loaded from the cache, 0 if not cached or rejected by the driver
+         */
+        GLuint loadCachedProgram(const std::string& path, uint64_t key) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) {
+                return 0;
+            }
+            uint32_t magic = 0, format = 0, size = 0;
+            uint64_t fileKey = 0;
+            file.read((char*) &magic, sizeof(magic));
+            file.read((char*) &format, sizeof(format));
+            file.read((char*) &fileKey, sizeof(fileKey));
+            file.read((char*) &size, sizeof(size));
+            if (!file || magic != PROGRAM_CACHE_MAGIC || fileKey != key || size == 0) {
+                return 0;
+            }
+            std::vector<char> binary(size);
+            if (!file.read(binary.data(), size)) {
+                return 0;
+            }
+
+            GLuint program = glCreateProgram();
+            glProgramBinary(program, (GLenum) format, binary.data(), (GLsizei) size);
+            GLint linkOk = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &linkOk);
+            if (!linkOk) {
+                // E.g. after a driver update that kept the version string
+                printf("Cached program %s rejected by the driver, compiling it\n", path.c_str());
+                glDeleteProgram(program);
+                return 0;
+            }
+            return program;
+        }
+
+        void storeCachedProgram(const std::string& path, uint64_t key, GLuint program) {
+            GLint size = 0;
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+            if (size <= 0 || !ensureDirectory(programCacheDirectory)) {
+                return;
+            }
+            std::vector<char> binary((size_t) size);
+            GLenum format = 0;
+            glGetProgramBinary(program, size, &size, &format, binary.data());
+
+            std::ofstream file(path, std::ios::binary);
+            uint32_t header[2] = {PROGRAM_CACHE_MAGIC, (uint32_t) format};
+            uint32_t binarySize = (uint32_t) size;
+            file.write((const char*) header, sizeof(header));
+            file.write((const char*) &key, sizeof(key));
+            file.write((const char*) &binarySize, sizeof(binarySize));
+            file.write(binary.data(), size);
+            if (!file) {
+                // A truncated file is rejected when loaded
+                std::cout << "ERROR: storeCachedProgram(): Cannot write " << path << "\n";
+            }
+        }
+
+        void logProgramLoad(const std::string& name, const char* how, std::chrono::steady_clock::time_point start) {
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            printf("Program %s %s in %.1f ms\n", name.c_str(), how, elapsed.count());
+        }
+
+        std::string programInfoLog(GLuint program) {
+            GLint logLength = 0;
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+            if (logLength <= 0) {
+                return std::string();
+            }
+            std::vector<char> log((size_t) logLength);
+            glGetProgramInfoLog(program, logLength, nullptr, log.data());
+            return log.data();
+        }
+
+        bool parallelShaderCompile = false;
+    }
+
+    void setProgramBinaryCache(const std::string& directory) {
+        programCacheDirectory = directory;
+    }
+
+    bool enableParallelShaderCompile() {
+        // Same token and entry point semantics for both extensions, let the driver pick the thread count
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xffffffffu);
+            parallelShaderCompile = true;
+        } else if (GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xffffffffu);
+            parallelShaderCompile = true;
+        }
+        return parallelShaderCompile;
+    }
+
+    PendingProgram beginShaderProgram(const std::string& vs_src, const std::string& fs_src, const std::string& name) {
+        PendingProgram pending;
+        pending.name = name;
+        pending.start = std::chrono::steady_clock::now();
+
+        if (!programCacheDirectory.empty() && programBinarySupported()) {
+            pending.cacheKey = programCacheKey(vs_src, fs_src);
+            char fileName[32];
+            snprintf(fileName, sizeof(fileName), "%016llx.bin", (unsigned long long) pending.cacheKey);
+            pending.cachePath = programCacheDirectory + "/" + fileName;
+            pending.program = loadCachedProgram(pending.cachePath, pending.cacheKey);
+            if (pending.program != 0) {
+                pending.cachePath.clear();
+                return pending;
+            }
+        }
+
+        pending.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        pending.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
 
         const char* vs = vs_src.c_str();
         const char* fs = fs_src.c_str();
 
-        glShaderSource(vShader, 1, &vs, nullptr);
-        glShaderSource(fShader, 1, &fs, nullptr);
+        glShaderSource(pending.vertexShader, 1, &vs, nullptr);
+        glShaderSource(pending.fragmentShader, 1, &fs, nullptr);
         // text data is not needed beyond this point
 
-        glCompileShader(vShader);
+        // Neither waits for the result with parallel compilation, the status is only checked by
+        // finishShaderProgram()
+        glCompileShader(pending.vertexShader);
+        glCompileShader(pending.fragmentShader);
+
+        pending.program = glCreateProgram();
+        if (!pending.cachePath.empty()) {
+            glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glAttachShader(pending.program, pending.fragmentShader);
+        glAttachShader(pending.program, pending.vertexShader);
+        glLinkProgram(pending.program);
+        return pending;
+    }
+
+    bool isShaderProgramReady(const PendingProgram& pending) {
+        if (!parallelShaderCompile || pending.vertexShader == 0) {
+            return true;
+        }
+        GLint completed = 0;
+        glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed != 0;
+    }
+
+    GLuint finishShaderProgram(PendingProgram& pending, std::string& error, std::string& title) {
+        if (pending.vertexShader == 0) {
+            logProgramLoad(pending.name, "loaded from the cache", pending.start);
+            return pending.program;
+        }
+
+        GLuint program = pending.program;
         int compileOk = 0;
-        glGetShaderiv(vShader, GL_COMPILE_STATUS, &compileOk);
+        glGetShaderiv(pending.vertexShader, GL_COMPILE_STATUS, &compileOk);
         if (!compileOk) {
-            std::string err = GetShaderInfoLog(vShader);
+            error = GetShaderInfoLog(pending.vertexShader);
+            title = "Vertex Shader";
+            program = 0;
+        } else {
+            glGetShaderiv(pending.fragmentShader, GL_COMPILE_STATUS, &compileOk);
+            if (!compileOk) {
+                error = GetShaderInfoLog(pending.fragmentShader);
+                title = "Fragment Shader";
+                program = 0;
+            }
+        }
+        if (program != 0) {
+            GLint linkOk = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &linkOk);
+            if (!linkOk) {
+                error = programInfoLog(program);
+                title = "Linking";
+                program = 0;
+            }
+        }
+
+        glDetachShader(pending.program, pending.vertexShader);
+        glDetachShader(pending.program, pending.fragmentShader);
+        glDeleteShader(pending.vertexShader);
+        glDeleteShader(pending.fragmentShader);
+        pending.vertexShader = 0;
+        pending.fragmentShader = 0;
+        if (program == 0) {
+            glDeleteProgram(pending.program);
+            pending.program = 0;
+            return 0;
+        }
+
+        if (!pending.cachePath.empty()) {
+            storeCachedProgram(pending.cachePath, pending.cacheKey, program);
+        }
+        logProgramLoad(pending.name, "compiled", pending.start);
+        return program;
+    }
+
+    GLuint loadShaderProgram(const std::string& vertexShader, const std::string& fragmentShader, bool allow_errors) {
+        return loadShaderProgram(vertexShader, fragmentShader, ShaderDefines(), allow_errors);
+    }
+
+    GLuint loadShaderProgram(const std::string& vertexShader,
+                             const std::string& fragmentShader,
+                             const ShaderDefines& defines,
+                             bool allow_errors) {
+        std::string vs_src, fs_src, error;
+        if (!loadShaderSource(vertexShader, vs_src, error) || !loadShaderSource(fragmentShader, fs_src, error)) {
             if (allow_errors) {
-                non_fatal_error(err, "Vertex Shader");
+                non_fatal_error(error, "Shader source");
             } else {
-                fatal_error(err, "Vertex Shader");
+                fatal_error(error, "Shader source");
             }
             return 0;
         }
 
-        glCompileShader(fShader);
-        glGetShaderiv(fShader, GL_COMPILE_STATUS, &compileOk);
-        if (!compileOk) {
-            std::string err = GetShaderInfoLog(fShader);
+        PendingProgram pending = beginShaderProgram(injectDefines(vs_src, defines), injectDefines(fs_src, defines),
+                                                    shaderProgramName(vertexShader, fragmentShader, defines));
+        std::string title;
+        GLuint shaderProgram = finishShaderProgram(pending, error, title);
+        if (shaderProgram == 0) {
             if (allow_errors) {
-                non_fatal_error(err, "Fragment Shader");
+                non_fatal_error(error, title);
             } else {
-                fatal_error(err, "Fragment Shader");
+                fatal_error(error, title);
             }
             return 0;
         }
-
-        GLuint shaderProgram = glCreateProgram();
-        glAttachShader(shaderProgram, fShader);
-        glDeleteShader(fShader);
-        glAttachShader(shaderProgram, vShader);
-        glDeleteShader(vShader);
         if (!allow_errors) {
             CHECK_GL_ERROR()
         }
-
-        if (!linkShaderProgram(shaderProgram, allow_errors)) {
-            return 0;
-        }
-
         return shaderProgram;
     }
 
@@ -540,12 +1013,12 @@ namespace owo {
                                  GLenum bufferUsage) {
         GLuint buffer = 0;
         glGenBuffers(1, &buffer);
-        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glstate::bindBuffer(GL_ARRAY_BUFFER, buffer);
         glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) dataSize, data, bufferUsage);
         CHECK_GL_ERROR()
 
         // Now attach buffer to vertex array object.
-        glBindVertexArray(vertexArrayObject);
+        glstate::bindVertexArray(vertexArrayObject);
         glVertexAttribPointer(attributeIndex, attributeSize, type, false, 0, nullptr);
         glEnableVertexAttribArray(attributeIndex);
         CHECK_GL_ERROR()
@@ -590,14 +1063,13 @@ namespace owo {
                                                   {0.0f,                 0.0f, 0.0f}};
             owo::createAddAttribBuffer(vertexArrayObject, positions, sizeof(positions), 0, 3, GL_FLOAT);
         }
-        glBindVertexArray(vertexArrayObject);
+        glstate::bindVertexArray(vertexArrayObject);
         glDrawArrays(GL_LINES, 0, nofVertices);
     }
 
-    void drawFullScreenQuad() {
-        GLboolean previous_depth_state;
-        glGetBooleanv(GL_DEPTH_TEST, &previous_depth_state);
-        glDisable(GL_DEPTH_TEST);
+    void drawFullScreenQuad(bool depthTest) {
+        bool previous_depth_state = glstate::isEnabled(GL_DEPTH_TEST);
+        glstate::setEnabled(GL_DEPTH_TEST, depthTest);
         static GLuint vertexArrayObject = 0;
         static int nofVertices = 6;
         // do this initialization first time the function is called...
@@ -611,11 +1083,9 @@ namespace owo {
                                                   {-1.0f, 1.0f}};
             owo::createAddAttribBuffer(vertexArrayObject, positions, sizeof(positions), 0, 2, GL_FLOAT);
         }
-        glBindVertexArray(vertexArrayObject);
+        glstate::bindVertexArray(vertexArrayObject);
         glDrawArrays(GL_TRIANGLES, 0, nofVertices);
-        if (previous_depth_state) {
-            glEnable(GL_DEPTH_TEST);
-        }
+        glstate::setEnabled(GL_DEPTH_TEST, previous_depth_state);
     }
 
     inline float uniform_randf(const float from, const float to) {
@@ -4,7 +4,10 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <vector>
+#include <chrono>
 #include <cassert>
+#include <cstdint>
 
 #include <SDL.h>
 
@@ -78,6 +81,20 @@ namespace owo {
      */
     void shutDown(SDL_Window* window);
 
+    /**
+     * Initialize an OpenGL context without a visible window, e.g. for benchmarks on machines without a display.
+     * A surfaceless EGL context is used when built with EGL (OWO_HAS_EGL), a hidden SDL window otherwise. There is
+     * no default framebuffer to draw to in the former case, and vsync is off in both.
+     * @param hiddenWindow Set to the hidden window, nullptr with EGL
+     * @return False if no context could be created
+     */
+    bool init_offscreen_GL(SDL_Window*& hiddenWindow);
+
+    /**
+     * Destroys what init_offscreen_GL() initialized.
+     */
+    void shutDownOffscreen(SDL_Window* hiddenWindow);
+
     /**
      * Helper function: creates a cube map using the files specified for each face.
      */
@@ -89,6 +106,95 @@ namespace owo {
      */
     std::string GetShaderInfoLog(GLuint obj);
 
+    /**
+     * Reads a shader source file, replacing the lines #include "file" by the content of the file, relative to the
+     * including one.
+     * @param error Set to the reason of a failure
+     * @param files If not null, set to the files read, the shader itself first, e.g. to tell when to reload it
+     * @return False if a file cannot be read
+     */
+    bool loadShaderSource(const std::string& path,
+                          std::string& source,
+                          std::string& error,
+                          std::vector<std::string>* files = nullptr);
+
+    /**
+     * Preprocessor definitions of a program variant, each "NAME" or "NAME VALUE"
+     */
+    typedef std::vector<std::string> ShaderDefines;
+
+    /**
+     * @return Source with the definitions inserted after its #version line, line numbers of errors unchanged
+     */
+    std::string injectDefines(const std::string& source, const ShaderDefines& defines);
+
+    /**
+     * @return Name of a program variant for the logs, e.g. "terrain.vert + terrain.frag [OCTAVES 4]"
+     */
+    std::string shaderProgramName(const std::string& vertexShader,
+                                  const std::string& fragmentShader,
+                                  const ShaderDefines& defines);
+
+    /**
+     * Creates a directory if it does not exist yet, not its parents
+     * @return False if it cannot be created
+     */
+    bool ensureDirectory(const std::string& path);
+
+    /**
+     * FNV-1a hash of a string, e.g. for the keys of on-disk caches
+     * @param hash Hash of the previous strings, to hash several in a row, the FNV offset basis for the first one
+     */
+    uint64_t hashString(const std::string& data, uint64_t hash = 14695981039346656037ull);
+
+    /**
+     * Set the directory where loadShaderProgram() keeps the binaries of the programs it links, named after a hash of
+     * their expanded sources and of the driver strings, so that the next launches and reloads skip compiling them.
+     * Binaries rejected by the driver are compiled again. Empty, the default, disables the cache.
+     */
+    void setProgramBinaryCache(const std::string& directory);
+
+    /**
+     * Program being compiled and linked, see beginShaderProgram()
+     */
+    struct PendingProgram {
+        std::string name;
+        GLuint program = 0;
+        // 0 when loaded from the binary cache
+        GLuint vertexShader = 0;
+        GLuint fragmentShader = 0;
+        // Where to store the binary once linked, empty if not cached
+        std::string cachePath;
+        uint64_t cacheKey = 0;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /**
+     * Let the driver compile and link in the background when it supports GL_KHR_parallel_shader_compile or
+     * GL_ARB_parallel_shader_compile, so that beginShaderProgram() returns without waiting for the result
+     * @return False if not supported
+     */
+    bool enableParallelShaderCompile();
+
+    /**
+     * Start compiling and linking a program from its expanded sources, or load it from the binary cache
+     * @param name Name of the program, for the log
+     */
+    PendingProgram beginShaderProgram(const std::string& vs_src, const std::string& fs_src, const std::string& name);
+
+    /**
+     * @return True when finishShaderProgram() will not wait, always without parallel compilation
+     */
+    bool isShaderProgramReady(const PendingProgram& pending);
+
+    /**
+     * Check the result of beginShaderProgram() and store the binary into the cache
+     * @param error Set to the compilation or link log on failure
+     * @param title Set to the stage that failed
+     * @return Linked program, 0 on failure
+     */
+    GLuint finishShaderProgram(PendingProgram& pending, std::string& error, std::string& title);
+
     /**
      * Loads and compiles a fragment and vertex shader. Then creates a shader program
      * and attaches the shaders. Does NOT link the program, this is done with  linkShaderProgram()
@@ -99,6 +205,14 @@ namespace owo {
                              const std::string& fragmentShader,
                              bool allow_errors = false);
 
+    /**
+     * Same as above, for the variant of the program specialised by the definitions, injected in both shaders
+     */
+    GLuint loadShaderProgram(const std::string& vertexShader,
+                             const std::string& fragmentShader,
+                             const ShaderDefines& defines,
+                             bool allow_errors = false);
+
     /**
      * Call to link a shader program prevoiusly loaded using loadShaderProgram.
      */
@@ -136,9 +250,10 @@ namespace owo {
     void setUniformSlow(GLuint shaderProgram, const char* name, uint32_t nof_values, const glm::vec3* values);
 
     /**
-     * Helper to draw a single quad (two triangles) that cover the entire screen
+     * Helper to draw a single quad (two triangles) that cover the entire screen.
+     * Depth testing is disabled during the draw, unless depthTest is set.
      */
-    void drawFullScreenQuad();
+    void drawFullScreenQuad(bool depthTest = false);
 
     /**
      * Code that draws a sphere where the light is and a stippled line to the
@@ -5,6 +5,7 @@ layout(location = 0) in vec2 position;
 out vec2 texCoord;
 
 void main() {
-    gl_Position = vec4(position, 0.0, 1.0);
+    // On the far plane, behind everything else
+    gl_Position = vec4(position, 1.0, 1.0);
     texCoord = 0.5 * (position + vec2(1, 1));
 }
@@ -0,0 +1,48 @@
+#version 420
+
+// required by GLSL spec Sect 4.5.3 (though nvidia does not, amd does)
+precision highp float;
+
+///////////////////////////////////////////////////////////////////////////////
+// G-buffer written by heightfield_gbuffer.frag
+///////////////////////////////////////////////////////////////////////////////
+layout(binding = 11) uniform sampler2D gBufferAlbedo;
+layout(binding = 12) uniform sampler2D gBufferNormal;
+layout(binding = 13) uniform sampler2D gBufferDepth;
+
+///////////////////////////////////////////////////////////////////////////////
+// Input uniform variables
+///////////////////////////////////////////////////////////////////////////////
+uniform mat4 projectionInverse;
+
+///////////////////////////////////////////////////////////////////////////////
+// Output color
+///////////////////////////////////////////////////////////////////////////////
+layout(location = 0) out vec4 fragmentColor;
+
+// Reconstructed from the depth, used by the lighting functions
+vec3 viewSpacePosition;
+
+#include "terrain_lighting.glsl"
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gBufferDepth, texel, 0).r;
+    if (depth == 1.) {
+        // Nothing was rasterized here, keep the background
+        discard;
+    }
+
+    vec2 uv = gl_FragCoord.xy / vec2(textureSize(gBufferDepth, 0));
+    vec4 position = projectionInverse * vec4(vec3(uv, depth) * 2. - 1., 1.);
+    viewSpacePosition = position.xyz / position.w;
+
+    vec3 n = texelFetch(gBufferNormal, texel, 0).xyz;
+    vec3 wo = normalize(-viewSpacePosition);
+
+    vec3 base_color = texelFetch(gBufferAlbedo, texel, 0).rgb;
+
+    fragmentColor.xyz = shadeTerrain(wo, n, base_color);
+    // Let forward passes drawn afterwards be depth tested against the terrain
+    gl_FragDepth = depth;
+}
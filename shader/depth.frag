@@ -0,0 +1,5 @@
+#version 420
+
+// Depth-only pass (depth pre-pass), colour writes are masked out and the depth comes from the rasterizer
+void main() {
+}
@@ -0,0 +1,31 @@
+#version 420
+
+// required by GLSL spec Sect 4.5.3 (though nvidia does not, amd does)
+precision highp float;
+
+///////////////////////////////////////////////////////////////////////////////
+// Fragment count per pixel, written by overdraw.frag
+///////////////////////////////////////////////////////////////////////////////
+layout(binding = 17) uniform sampler2D overdraw;
+
+// Count shown in white
+uniform float maxOverdraw;
+
+in vec2 texCoord;
+
+layout(location = 0) out vec4 fragmentColor;
+
+void main() {
+    float count = texelFetch(overdraw, ivec2(gl_FragCoord.xy), 0).r;
+    if (count == 0.0) {
+        fragmentColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    // Blue for a single fragment, then green, yellow, red and white
+    const vec3 ramp[5] = vec3[](vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0),
+                                vec3(1.0, 0.0, 0.0), vec3(1.0, 1.0, 1.0));
+    float t = clamp((count - 1.0) / max(maxOverdraw - 1.0, 1.0), 0.0, 1.0) * 4.0;
+    int i = min(int(t), 3);
+    fragmentColor = vec4(mix(ramp[i], ramp[i + 1], t - float(i)), 1.0);
+}
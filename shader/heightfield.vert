@@ -15,6 +15,8 @@ uniform mat4 modelViewProjectionMatrix;
 uniform float heightIntensity;
 uniform float densityIntensity;
 uniform vec2 seed;
+// View space size of a pixel at a distance of 1, 0 to keep all the octaves
+uniform float pixelFootprint;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Output to fragment shader
@@ -23,85 +25,85 @@ out float yPos;
 out float colorBleeding;
 out vec3 viewSpaceNormal;
 out vec3 viewSpacePosition;
+// Must match exactly between the depth pre-pass and the shading pass
+invariant gl_Position;
 
 #define PI 3.1415926535897932384626433832795
 
-vec3 mod289(vec3 x) {
-    return x - floor(x * (1.0 / 289.0)) * 289.0;
-}
+///////////////////////////////////////////////////////////////////////////////
+// Compile-time parameters, defined by the program variant
+///////////////////////////////////////////////////////////////////////////////
+// Octaves of the height, from the largest (1 to 10)
+#ifndef HEIGHT_OCTAVES
+#define HEIGHT_OCTAVES 10
+#endif
+// Octaves of the color bleeding and horizontal displacement, from the largest (1 to 6)
+#ifndef BLEEDING_OCTAVES
+#define BLEEDING_OCTAVES 6
+#endif
 
-vec2 mod289(vec2 x) {
-    return x - floor(x * (1.0 / 289.0)) * 289.0;
-}
+// Sum of the weights of the first bleeding octaves
+const float bleedingWeights[6] = float[](3., 4., 5., 6., 6.5, 7.);
 
-// Modulo 7 without a division
-vec3 mod7(vec3 x) {
-    return x - floor(x * (1.0 / 7.0)) * 7.0;
-}
+#include "noise.glsl"
 
-// Permutation polynomial: (34x^2 + 6x) mod 289
-vec3 permute(vec3 x) {
-    return mod289((34.0 * x + 10.0) * x);
-}
+// Octaves fade out as their cells shrink from 4 to 2 pixels, as in terrainOctaveWeight() of src/noise.cpp
+const float OCTAVE_FADE_START = 0.25;
+const float OCTAVE_FADE_END = 0.5;
 
-// Cellular noise, returning F1 and F2 in a vec2.
-// Standard 3x3 search window for good F1 and F2 values
 vec2 cnoise(vec2 P) {
-    P += seed;
-    #define K 0.142857142857 // 1/7
-    #define Ko 0.428571428571 // 3/7
-    #define jitter 1.0 // Less gives more regular pattern
-    vec2 Pi = mod289(floor(P));
-    vec2 Pf = fract(P);
-    vec3 oi = vec3(-1.0, 0.0, 1.0);
-    vec3 of = vec3(-0.5, 0.5, 1.5);
-    vec3 px = permute(Pi.x + oi);
-    vec3 p = permute(px.x + Pi.y + oi); // p11, p12, p13
-    vec3 ox = fract(p*K) - Ko;
-    vec3 oy = mod7(floor(p*K))*K - Ko;
-    vec3 dx = Pf.x + 0.5 + jitter*ox;
-    vec3 dy = Pf.y - of + jitter*oy;
-    vec3 d1 = dx * dx + dy * dy; // d11, d12 and d13, squared
-    p = permute(px.y + Pi.y + oi); // p21, p22, p23
-    ox = fract(p*K) - Ko;
-    oy = mod7(floor(p*K))*K - Ko;
-    dx = Pf.x - 0.5 + jitter*ox;
-    dy = Pf.y - of + jitter*oy;
-    vec3 d2 = dx * dx + dy * dy; // d21, d22 and d23, squared
-    p = permute(px.z + Pi.y + oi); // p31, p32, p33
-    ox = fract(p*K) - Ko;
-    oy = mod7(floor(p*K))*K - Ko;
-    dx = Pf.x - 1.5 + jitter*ox;
-    dy = Pf.y - of + jitter*oy;
-    vec3 d3 = dx * dx + dy * dy; // d31, d32 and d33, squared
-    // Sort out the two smallest distances (F1, F2)
-    vec3 d1a = min(d1, d2);
-    d2 = max(d1, d2); // Swap to keep candidates for F2
-    d2 = min(d2, d3); // neither F1 nor F2 are now in d3
-    d1 = min(d1a, d2); // F1 is now in d1
-    d2 = max(d1a, d2); // Swap to keep candidates for F2
-    d1.xy = (d1.x < d1.y) ? d1.xy : d1.yx; // Swap if smaller
-    d1.xz = (d1.x < d1.z) ? d1.xz : d1.zx; // F1 is in d1.x
-    d1.yz = min(d1.yz, d2.yz); // F2 is now not in d2.yz
-    d1.y = min(d1.y, d1.z); // nor in  d1.z
-    d1.y = min(d1.y, d2.x); // F2 is in d1.y, we're done.
-    return sqrt(d1.xy);
+    return cellular(P + seed);
+}
+
+/**
+ * Add an octave of the height, faded out as its cells shrink to a couple of pixels so that it disappears without
+ * popping. Faded out octaves are not evaluated at all, which is what saves the time on wide views.
+ * @param footprint Size of a pixel at the vertex, in units of the noise positions
+ */
+void addOctave(inout vec2 y, float frequency, float amplitude, float footprint) {
+    float weight = 1. - smoothstep(OCTAVE_FADE_START, OCTAVE_FADE_END, frequency * footprint);
+    if (weight > 0.) {
+        y += cnoise(position.xz * frequency) * (amplitude * weight);
+    }
 }
 
 void main() {
     float densityIntensityFixed = densityIntensity / 50;
 
+    // The noise is sampled in model space, scaled horizontally by the model matrix
+    float viewDistance = length((modelViewMatrix * vec4(position, 1.)).xyz);
+    float footprint = pixelFootprint * viewDistance / length(modelViewMatrix[0].xyz);
+
+    // The largest octave is always kept, the height is the direction of the sum
     vec2 y = vec2(0);
-    y += cnoise(position.xz * densityIntensityFixed / 16) * 16;
-    y += cnoise(position.xz * densityIntensityFixed / 8) * 8;
-    y += cnoise(position.xz * densityIntensityFixed / 4) * 4;
-    y += cnoise(position.xz * densityIntensityFixed / 2) * 2;
-    y += cnoise(position.xz * densityIntensityFixed);
-    y += cnoise(position.xz * densityIntensityFixed * 2) / 2;
-    y += cnoise(position.xz * densityIntensityFixed * 4) / 4;
-    y += cnoise(position.xz * densityIntensityFixed * 8) / 8;
-    y += cnoise(position.xz * densityIntensityFixed * 16) / 16;
-    y += cnoise(position.xz * densityIntensityFixed * 32) / 16;
+    y += cnoise(position.xz * (densityIntensityFixed / 16)) * 16;
+#if HEIGHT_OCTAVES > 1
+    addOctave(y, densityIntensityFixed / 8, 8., footprint);
+#endif
+#if HEIGHT_OCTAVES > 2
+    addOctave(y, densityIntensityFixed / 4, 4., footprint);
+#endif
+#if HEIGHT_OCTAVES > 3
+    addOctave(y, densityIntensityFixed / 2, 2., footprint);
+#endif
+#if HEIGHT_OCTAVES > 4
+    addOctave(y, densityIntensityFixed, 1., footprint);
+#endif
+#if HEIGHT_OCTAVES > 5
+    addOctave(y, densityIntensityFixed * 2, 1. / 2., footprint);
+#endif
+#if HEIGHT_OCTAVES > 6
+    addOctave(y, densityIntensityFixed * 4, 1. / 4., footprint);
+#endif
+#if HEIGHT_OCTAVES > 7
+    addOctave(y, densityIntensityFixed * 8, 1. / 8., footprint);
+#endif
+#if HEIGHT_OCTAVES > 8
+    addOctave(y, densityIntensityFixed * 16, 1. / 16., footprint);
+#endif
+#if HEIGHT_OCTAVES > 9
+    addOctave(y, densityIntensityFixed * 32, 1. / 16., footprint);
+#endif
     y = vec2(dot(normalize(y), vec2(1, 0)));
     y -= vec2(0.4);
     y /= 2;
@@ -126,12 +128,22 @@ void main() {
 
     vec2 vBleeding = vec2(0);
     vBleeding += cnoise(vBleedingPos / 16) * 3;
+#if BLEEDING_OCTAVES > 1
     vBleeding += cnoise(vBleedingPos / 4);
+#endif
+#if BLEEDING_OCTAVES > 2
     vBleeding += cnoise(vBleedingPos * 4);
+#endif
+#if BLEEDING_OCTAVES > 3
     vBleeding += cnoise(vBleedingPos * 8);
+#endif
+#if BLEEDING_OCTAVES > 4
     vBleeding += cnoise(vBleedingPos * 16) / 2;
+#endif
+#if BLEEDING_OCTAVES > 5
     vBleeding += cnoise(cnoise(vBleedingPos) * 32) / 2;
-    vBleeding /= 7;
+#endif
+    vBleeding /= bleedingWeights[BLEEDING_OCTAVES - 1];
 
     colorBleeding = vBleeding.x;
     colorBleeding = abs(colorBleeding);
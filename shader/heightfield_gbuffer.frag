@@ -0,0 +1,33 @@
+#version 420
+
+// required by GLSL spec Sect 4.5.3 (though nvidia does not, amd does)
+precision highp float;
+
+///////////////////////////////////////////////////////////////////////////////
+// G-buffer pass of the deferred terrain shading, see deferred.frag
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Input varyings from vertex shader
+///////////////////////////////////////////////////////////////////////////////
+in vec3 viewSpaceNormal;
+in vec3 viewSpacePosition;
+in float yPos;
+in float colorBleeding;
+
+///////////////////////////////////////////////////////////////////////////////
+// Output G-buffer, depth is written to the depth attachment
+///////////////////////////////////////////////////////////////////////////////
+layout(location = 0) out vec4 albedo;
+layout(location = 1) out vec4 normal;
+
+#include "terrain_color.glsl"
+
+void main() {
+    vec3 dx = dFdx(viewSpacePosition);
+    vec3 dy = dFdy(viewSpacePosition);
+    vec3 n = normalize(cross(dx, dy));
+
+    albedo = vec4(colorFromAltitude(yPos, colorBleeding).rgb / 255., 1.);
+    normal = vec4(n, 0.);
+}
@@ -0,0 +1,14 @@
+#version 420
+///////////////////////////////////////////////////////////////////////////////
+// Cellular noise of each position, captured with transform feedback by
+// microbench to check the CPU versions against the shader
+///////////////////////////////////////////////////////////////////////////////
+layout(location = 0) in vec2 position;
+
+out vec2 noise;
+
+#include "noise.glsl"
+
+void main() {
+    noise = cellular(position);
+}
@@ -0,0 +1,10 @@
+#version 420
+
+///////////////////////////////////////////////////////////////////////////////
+// Overdraw: every fragment adds one, with additive blending
+///////////////////////////////////////////////////////////////////////////////
+layout(location = 0) out vec4 fragmentColor;
+
+void main() {
+    fragmentColor = vec4(1.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,63 @@
+#version 430
+///////////////////////////////////////////////////////////////////////////////
+// Input vertex attributes
+///////////////////////////////////////////////////////////////////////////////
+// Base instance of the draw, i.e. the index of its per-draw data
+layout(location = 0) in uint drawIndexIn;
+
+///////////////////////////////////////////////////////////////////////////////
+// Shared vertex storage of owo::ModelBatch, indexed by gl_VertexID
+///////////////////////////////////////////////////////////////////////////////
+layout(std430, binding = 0) readonly buffer PositionBlock {
+    float positions[];
+};
+layout(std430, binding = 1) readonly buffer NormalBlock {
+    float normals[];
+};
+layout(std430, binding = 2) readonly buffer TexCoordBlock {
+    vec2 texCoords[];
+};
+
+struct DrawData {
+    mat4 modelMatrix;
+    uint materialIndex;
+};
+layout(std430, binding = 3) readonly buffer DrawBlock {
+    DrawData draws[];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Input uniform variables
+///////////////////////////////////////////////////////////////////////////////
+uniform mat4 viewMatrix;
+uniform mat4 projectionMatrix;
+uniform mat4 lightMatrix;
+
+///////////////////////////////////////////////////////////////////////////////
+// Output to fragment shader, same as shading.vert
+///////////////////////////////////////////////////////////////////////////////
+out vec2 texCoord;
+out vec3 viewSpaceNormal;
+out vec3 viewSpacePosition;
+out vec4 shadowMapCoord;
+flat out uint materialIndex;
+// Must match exactly between the depth pre-pass and the shading pass
+invariant gl_Position;
+
+void main() {
+    // For non-indexed draws gl_VertexID already includes the first vertex of the command
+    int v = gl_VertexID;
+    vec3 position = vec3(positions[v * 3 + 0], positions[v * 3 + 1], positions[v * 3 + 2]);
+    vec3 normalIn = vec3(normals[v * 3 + 0], normals[v * 3 + 1], normals[v * 3 + 2]);
+
+    DrawData draw = draws[drawIndexIn];
+    mat4 modelViewMatrix = viewMatrix * draw.modelMatrix;
+    mat3 normalMatrix = transpose(inverse(mat3(modelViewMatrix)));
+
+    viewSpacePosition = (modelViewMatrix * vec4(position, 1.0)).xyz;
+    gl_Position = projectionMatrix * vec4(viewSpacePosition, 1.0);
+    texCoord = texCoords[v];
+    viewSpaceNormal = normalMatrix * normalIn;
+    shadowMapCoord = lightMatrix * vec4(viewSpacePosition, 1.f);
+    materialIndex = draw.materialIndex;
+}
@@ -13,6 +13,24 @@ uniform float material_fresnel;
 uniform float material_shininess;
 uniform float material_emission;
 
+// Materials of the whole model, used instead of the uniforms above by owo::renderIndirect
+#define MAX_BLOCK_MATERIALS 256
+struct MaterialData {
+    vec3 color;
+    float reflectivity;
+    float metalness;
+    float fresnel;
+    float shininess;
+    float emission;
+};
+layout(std140, binding = 0) uniform MaterialBlock {
+    MaterialData materials[MAX_BLOCK_MATERIALS];
+};
+uniform bool use_material_block = false;
+
+// Material of the current fragment, set in main()
+MaterialData material;
+
 uniform int has_emission_texture;
 uniform int has_color_texture;
 layout(binding = 0) uniform sampler2D colorMap;
@@ -45,6 +63,7 @@ in vec2 texCoord;
 in vec3 viewSpaceNormal;
 in vec3 viewSpacePosition;
 in vec4 shadowMapCoord;
+flat in uint materialIndex;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Input uniform variables
@@ -76,10 +95,10 @@ vec3 calculateDirectIllumiunation(vec3 wo, vec3 n, vec3 base_color) {
 
     vec3 wh = normalize(wi + wo);
 
-    float R = material_fresnel;
+    float R = material.fresnel;
     float F = R + (1. - R) * pow(1. - dot(wh, wi), 5.);
 
-    float s = material_shininess;
+    float s = material.shininess;
     float D = (s + 2.) / (2. * PI) * pow(max(0.0001, dot(n, wh)), s);
 
     float G = min(1., min(2. * dot(n, wh) * dot(n, wo) / dot(wo, wh), 2. * dot(n, wh) * dot(n, wi) / dot(wo, wh)));
@@ -88,11 +107,11 @@ vec3 calculateDirectIllumiunation(vec3 wo, vec3 n, vec3 base_color) {
 
     vec3 dielectric_term = brdf * dot(n, wi) * Li + (1. - F) * diffuse_term;
 
-    float m = material_metalness;
-    vec3 metal_term = brdf * material_color * dot(n, wi) * Li;
+    float m = material.metalness;
+    vec3 metal_term = brdf * material.color * dot(n, wi) * Li;
     vec3 microfacet_term = m * metal_term + (1. - m) * dielectric_term;
 
-    float r = material_reflectivity;
+    float r = material.reflectivity;
 
     return r * microfacet_term + (1. - r) * diffuse_term;
 }
@@ -112,32 +131,39 @@ vec3 calculateIndirectIllumination(vec3 wo, vec3 n) {
 
     vec4 irradiance = texture(irradianceMap, lookup);
 
-    vec3 diffuse_term = material_color * (1.0 / PI) * vec3(irradiance);
+    vec3 diffuse_term = material.color * (1.0 / PI) * vec3(irradiance);
 
     indirect_illum = diffuse_term;
 
-    float s = material_shininess;
+    float s = material.shininess;
     float roughness = sqrt(sqrt(2. / (s + 2.)));
     vec3 Li = environment_multiplier * textureLod(reflectionMap, lookup, roughness * 7.0).xyz;
 
     vec3 wi = reflect(normalize(viewSpaceLightPosition - viewSpacePosition), vec3(dir));
     vec3 wh = normalize(wi + wo);
-    float R = material_fresnel;
+    float R = material.fresnel;
     float F = R + (1. - R) * pow(1. - dot(wh, wi), 5.);
 
     vec3 dielectric_term = F * Li + (1. - F) * diffuse_term;
-    vec3 metal_term = F * material_color * Li;
+    vec3 metal_term = F * material.color * Li;
 
-    float m = material_metalness;
+    float m = material.metalness;
     vec3 microfacet_term = m * metal_term + (1. - m) * dielectric_term;
 
-    float r = material_reflectivity;
+    float r = material.reflectivity;
     indirect_illum = r * microfacet_term + (1. - r) * diffuse_term;
 
     return indirect_illum;
 }
 
 void main() {
+    if (use_material_block) {
+        material = materials[materialIndex];
+    } else {
+        material = MaterialData(material_color, material_reflectivity, material_metalness, material_fresnel,
+                                material_shininess, material_emission);
+    }
+
     float visibility = textureProj(shadowMapTex, shadowMapCoord);
 
     vec3 wo = -normalize(viewSpacePosition);
@@ -152,7 +178,7 @@ void main() {
     visibility *= spotAttenuation;
 
     // Direct illumination
-    vec3 direct_illumination_term = visibility * calculateDirectIllumiunation(wo, n, material_color);
+    vec3 direct_illumination_term = visibility * calculateDirectIllumiunation(wo, n, material.color);
 
     // Indirect illumination
     vec3 indirect_illumination_term = calculateIndirectIllumination(wo, n);
@@ -160,7 +186,7 @@ void main() {
     ///////////////////////////////////////////////////////////////////////////
     // Add emissive term. If emissive texture exists, sample this term.
     ///////////////////////////////////////////////////////////////////////////
-    vec3 emission_term = material_emission * material_color;
+    vec3 emission_term = material.emission * material.color;
     if (has_emission_texture == 1) {
         emission_term = texture(emissiveMap, texCoord).xyz;
     }
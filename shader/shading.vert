@@ -5,6 +5,8 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normalIn;
 layout(location = 2) in vec2 texCoordIn;
+// Base instance of the draw, i.e. the material index when using owo::renderIndirect
+layout(location = 3) in uint materialIndexIn;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Input uniform variables
@@ -21,6 +23,9 @@ out vec2 texCoord;
 out vec3 viewSpaceNormal;
 out vec3 viewSpacePosition;
 out vec4 shadowMapCoord;
+flat out uint materialIndex;
+// Must match exactly between the depth pre-pass and the shading pass
+invariant gl_Position;
 
 void main() {
     gl_Position = modelViewProjectionMatrix * vec4(position, 1.0);
@@ -28,4 +33,5 @@ void main() {
     viewSpaceNormal = (normalMatrix * vec4(normalIn, 0.0)).xyz;
     viewSpacePosition = (modelViewMatrix * vec4(position, 1.0)).xyz;
     shadowMapCoord = lightMatrix * vec4(viewSpacePosition, 1.f);
+    materialIndex = materialIndexIn;
 }
@@ -0,0 +1,72 @@
+#version 420
+
+// required by GLSL spec Sect 4.5.3 (though nvidia does not, amd does)
+precision highp float;
+
+///////////////////////////////////////////////////////////////////////////////
+// Current frame, rendered at the render resolution with a sub-pixel jitter
+///////////////////////////////////////////////////////////////////////////////
+layout(binding = 14) uniform sampler2D currentColor;
+layout(binding = 15) uniform sampler2D currentDepth;
+
+///////////////////////////////////////////////////////////////////////////////
+// Accumulated output of the previous frame, at the window resolution
+///////////////////////////////////////////////////////////////////////////////
+layout(binding = 16) uniform sampler2D historyColor;
+
+///////////////////////////////////////////////////////////////////////////////
+// Input uniform variables
+///////////////////////////////////////////////////////////////////////////////
+// From the current clip space to the previous one, both without jitter
+uniform mat4 reprojectionMatrix;
+// Jitter of the current frame, in texture coordinates
+uniform vec2 jitter;
+// Weight of the current frame, 1 to discard the history
+uniform float currentWeight;
+
+in vec2 texCoord;
+
+///////////////////////////////////////////////////////////////////////////////
+// Output color
+///////////////////////////////////////////////////////////////////////////////
+layout(location = 0) out vec4 fragmentColor;
+
+void main() {
+    // Where this pixel was rasterized in the jittered current frame
+    vec2 uv = texCoord + jitter;
+    ivec2 currentSize = textureSize(currentColor, 0);
+    ivec2 texel = clamp(ivec2(uv * vec2(currentSize)), ivec2(0), currentSize - 1);
+
+    vec3 current = texture(currentColor, uv).rgb;
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Neighbourhood of the current frame, the history is clamped to it so
+    // that disoccluded or changed pixels do not ghost
+    ///////////////////////////////////////////////////////////////////////////
+    vec3 neighbourhoodMin = current;
+    vec3 neighbourhoodMax = current;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 neighbour = clamp(texel + ivec2(x, y), ivec2(0), currentSize - 1);
+            vec3 c = texelFetch(currentColor, neighbour, 0).rgb;
+            neighbourhoodMin = min(neighbourhoodMin, c);
+            neighbourhoodMax = max(neighbourhoodMax, c);
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Reprojection into the previous frame from the current depth
+    ///////////////////////////////////////////////////////////////////////////
+    float depth = texelFetch(currentDepth, texel, 0).r;
+    vec4 previousClip = reprojectionMatrix * vec4(texCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec2 previousUv = previousClip.xy / previousClip.w * 0.5 + 0.5;
+
+    float weight = currentWeight;
+    if (any(lessThan(previousUv, vec2(0.0))) || any(greaterThan(previousUv, vec2(1.0)))) {
+        weight = 1.0;
+    }
+
+    vec3 history = clamp(texture(historyColor, previousUv).rgb, neighbourhoodMin, neighbourhoodMax);
+
+    fragmentColor = vec4(mix(history, current, weight), 1.0);
+}
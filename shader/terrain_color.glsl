@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+// Color of the terrain by altitude, included by heightfield.frag and
+// heightfield_gbuffer.frag
+///////////////////////////////////////////////////////////////////////////////
+
+const vec4[] colors = {
+    // Snow high
+    vec4(255., 255., 255., 1.),
+    // Snow low
+    vec4(240., 240., 240., 1.),
+
+    // Rock high
+    vec4(132., 132., 132., 1.),
+    // Rock low
+    vec4(122., 122., 122., 1.),
+
+    // Mountain high
+    vec4(107., 85., 68., 1.),
+    // Mountain med
+    vec4(97., 75., 58., 1.),
+    // Mountain low
+    vec4(90., 68., 50., 1.),
+
+    // Forest high
+    vec4(32., 72., 29., 1.),
+    // Forest low
+    vec4(42., 82., 39., 1.),
+
+    // Plain high
+    vec4(47., 87., 45., 1.),
+    // Plain mid-high
+    vec4(52., 92., 50., 1.),
+    // Plain mid-low
+    vec4(58., 100., 54., 1.),
+    // Plain low
+    vec4(70., 115., 63., 1.),
+
+    // Beach
+    vec4(224., 205., 169., 1.),
+
+    // Ocean high
+    vec4(33., 90., 113., 0.5),
+    // Ocean med
+    vec4(23., 85., 112., 0.5),
+    // Ocean low
+    vec4(16., 80., 110., 0.5),
+
+    // Deep ocean high
+    vec4(12., 77., 114., 0.5),
+    // Deep ocean med
+    vec4(9., 59., 87., 0.5),
+    // Deep ocean low
+    vec4(2., 45., 71., 0.5),
+};
+
+vec4 colorFromAltitude(float altitude, float bleeding) {
+    float y = altitude;
+    float cb = bleeding;
+    if (y >= 0) {
+        y = max(0, y + y * cb * 10);
+    } else {
+        y = min(-0.001, y - y * cb * 10);
+    }
+
+    y = exp(y);
+    int n = 0;
+
+    if (y < 0.4) {
+        // Deep ocean low
+        ++n;
+    }
+    if (y < 0.6) {
+        // Deep ocean med
+        ++n;
+    }
+    if (y < 0.7) {
+        // Deep ocean high
+        ++n;
+    }
+
+    if (y < 0.8) {
+        // Ocean low
+        ++n;
+    }
+    if (y < 0.9) {
+        // Ocean med
+        ++n;
+    }
+    if (y < 1.) {
+        // Ocean high
+        ++n;
+    }
+
+    if (y < 1.1) {
+        // Beach
+        ++n;
+    }
+
+    if (y < 1.3) {
+        // Plain low
+        ++n;
+    }
+    if (y < 1.4) {
+        // Plain mid-low
+        ++n;
+    }
+    if (y < 1.5) {
+        // Plain mid-high
+        ++n;
+    }
+    if (y < 1.7) {
+        // Plain high
+        ++n;
+    }
+
+    if (y < 1.9) {
+        // Forest low
+        ++n;
+    }
+    if (y < 2.1) {
+        // Forest high
+        ++n;
+    }
+
+    if (y < 2.4) {
+        // Mountain low
+        ++n;
+    }
+    if (y < 2.6) {
+        // Mountain med
+        ++n;
+    }
+    if (y < 3.) {
+        // Mountain high
+        ++n;
+    }
+
+    if (y < 3.3) {
+        // Rock low
+        ++n;
+    }
+    if (y < 3.7) {
+        // Rock high
+        ++n;
+    }
+
+    if (y < 4) {
+        // Snow low
+        ++n;
+    }
+
+    // Snow high
+    ++n;
+
+    return colors[n - 1];
+}
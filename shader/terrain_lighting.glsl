@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////
+// Shading of the terrain, included by heightfield.frag for forward shading
+// and by deferred.frag for deferred shading. The including shader declares
+// viewSpacePosition, the position of the shaded point, before the include.
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Material
+///////////////////////////////////////////////////////////////////////////////
+// Compile-time constants, so that the terms they cancel are compiled out. Defined by the program variant to override
+// the defaults.
+#ifndef MATERIAL_REFLECTIVITY
+#define MATERIAL_REFLECTIVITY 0.
+#endif
+#ifndef MATERIAL_METALNESS
+#define MATERIAL_METALNESS 0.
+#endif
+#ifndef MATERIAL_FRESNEL
+#define MATERIAL_FRESNEL 0.
+#endif
+#ifndef MATERIAL_SHININESS
+#define MATERIAL_SHININESS 0.
+#endif
+#ifndef MATERIAL_EMISSION
+#define MATERIAL_EMISSION 0.5
+#endif
+const float material_reflectivity = MATERIAL_REFLECTIVITY;
+const float material_metalness = MATERIAL_METALNESS;
+const float material_fresnel = MATERIAL_FRESNEL;
+const float material_shininess = MATERIAL_SHININESS;
+const float material_emission = MATERIAL_EMISSION;
+
+// Lighting from the environment maps, off for the lowest quality
+#ifndef ENVIRONMENT_LIGHTING
+#define ENVIRONMENT_LIGHTING 1
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Environment
+///////////////////////////////////////////////////////////////////////////////
+layout(binding = 6) uniform sampler2D environmentMap;
+layout(binding = 7) uniform sampler2D irradianceMap;
+layout(binding = 8) uniform sampler2D reflectionMap;
+uniform float environment_multiplier;
+
+///////////////////////////////////////////////////////////////////////////////
+// Light source
+///////////////////////////////////////////////////////////////////////////////
+uniform vec3 point_light_color;
+uniform float point_light_intensity_multiplier;
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+///////////////////////////////////////////////////////////////////////////////
+#define PI 3.14159265359
+
+///////////////////////////////////////////////////////////////////////////////
+// Input uniform variables
+///////////////////////////////////////////////////////////////////////////////
+uniform mat4 viewInverse;
+uniform vec3 viewSpaceLightPosition;
+
+vec3 calculateDirectIllumiunation(vec3 wo, vec3 n, vec3 base_color) {
+    vec3 direct_illum = base_color;
+
+    float d = distance(viewSpaceLightPosition, viewSpacePosition);
+    vec3 Li = point_light_intensity_multiplier * point_light_color * 1/(d*d);
+
+    vec3 wi = normalize(viewSpaceLightPosition - viewSpacePosition);
+
+    if (dot(n, wi) <= 0.) {
+        return vec3(0., 0., 0.);
+    } else if (isnan(dot(n, wi))) {
+        return Li / 10.;
+    }
+
+    vec3 diffuse_term = direct_illum * 1.0 / PI * abs(dot(n, wi)) * Li;
+
+    vec3 wh = normalize(wi + wo);
+
+    float R = material_fresnel;
+    float F = R + (1. - R) * pow(1. - dot(wh, wi), 5.);
+
+    float s = material_shininess;
+    float D = (s + 2.) / (2. * PI) * pow(max(0.0001, dot(n, wh)), s);
+
+    float G = min(1., min(2. * dot(n, wh) * dot(n, wo) / dot(wo, wh), 2. * dot(n, wh) * dot(n, wi) / dot(wo, wh)));
+
+    float brdf = F * D * G / (4. * dot(n, wo) * dot(n, wi));
+
+    vec3 dielectric_term = brdf * dot(n, wi) * Li + (1 - F) * diffuse_term;
+
+    float m = material_metalness;
+    vec3 metal_term = brdf * base_color * dot(n, wi) * Li;
+    vec3 microfacet_term = m * metal_term + (1 - m) * dielectric_term;
+
+    float r = material_reflectivity;
+
+    return r * microfacet_term + (1 - r) * diffuse_term;
+}
+
+vec3 calculateIndirectIllumination(vec3 wo, vec3 n, vec3 base_color) {
+    vec3 indirect_illum = vec3(0.f);
+
+    vec4 dir = viewInverse * vec4(n.x, n.y, n.z, 0.);
+
+    // Calculate the spherical coordinates of the direction
+    float theta = acos(max(-1.0f, min(1.0f, dir.y)));
+    float phi = atan(dir.z, dir.x);
+    if (phi < 0.0f) {
+        phi = phi + 2.0f * PI;
+    }
+
+    vec2 lookup = vec2(phi / (2.0 * PI), theta / PI);
+
+    vec4 irradiance = texture(irradianceMap, lookup);
+
+    vec3 diffuse_term = base_color * (1.0 / PI) * vec3(irradiance);
+
+    indirect_illum = diffuse_term;
+
+    float s = material_shininess;
+    float roughness = sqrt(sqrt(2. / (s + 2.)));
+    vec3 Li = environment_multiplier * textureLod(reflectionMap, lookup, roughness * 7.0).xyz;
+
+    vec3 wi = reflect(normalize(viewSpaceLightPosition - viewSpacePosition), vec3(dir));
+    vec3 wh = normalize(wi + wo);
+    float R = material_fresnel;
+    float F = R + (1. - R) * pow(1. - dot(wh, wi), 5.);
+
+    vec3 dielectric_term = F * Li + (1. - F) * diffuse_term;
+    vec3 metal_term = F * base_color * Li;
+
+    float m = material_metalness;
+    vec3 microfacet_term = m * metal_term + (1 - m) * dielectric_term;
+
+    float r = material_reflectivity;
+    indirect_illum = r * microfacet_term + (1 - r) * diffuse_term;
+
+    return indirect_illum;
+}
+
+/**
+ * Direct, indirect and emitted light of a point of the terrain, red if invalid
+ */
+vec3 shadeTerrain(vec3 wo, vec3 n, vec3 base_color) {
+    vec3 direct_illumination_term = calculateDirectIllumiunation(wo, n, base_color);
+
+#if ENVIRONMENT_LIGHTING
+    vec3 indirect_illumination_term = calculateIndirectIllumination(wo, n, base_color);
+#else
+    vec3 indirect_illumination_term = vec3(0.);
+#endif
+
+    vec3 emission_term = material_emission * base_color;
+
+    vec3 final_color = direct_illumination_term + indirect_illumination_term + emission_term;
+
+    // Check if we got invalid results in the operations
+    if (any(isnan(final_color))) {
+        final_color.xyz = vec3(1.f, 0.f, 0.f);
+    }
+
+    return final_color;
+}
@@ -0,0 +1,127 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace {
+    const float PERCENTILES[] = {50.f, 90.f, 95.f, 99.f};
+
+    struct Summary {
+        float percentiles[4];
+        float mean;
+        float max;
+        size_t count;
+    };
+
+    /**
+     * Percentiles (nearest rank), mean and max of values, negative values excluded
+     */
+    Summary summarize(std::vector<float> values) {
+        values.erase(std::remove_if(values.begin(), values.end(), [](float v) { return v < 0.f; }), values.end());
+        Summary summary {};
+        summary.count = values.size();
+        if (values.empty()) {
+            return summary;
+        }
+
+        std::sort(values.begin(), values.end());
+        for (int i = 0; i < 4; i++) {
+            size_t rank = (size_t) std::ceil(PERCENTILES[i] / 100.f * (float) values.size());
+            summary.percentiles[i] = values[std::min(values.size() - 1, std::max<size_t>(rank, 1) - 1)];
+        }
+        double sum = 0.;
+        for (float v : values) {
+            sum += v;
+        }
+        summary.mean = (float) (sum / (double) values.size());
+        summary.max = values.back();
+        return summary;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CameraPath
+///////////////////////////////////////////////////////////////////////////////
+
+CameraPath::CameraPath(std::vector<glm::vec3> points) : points(std::move(points)) {}
+
+glm::vec3 CameraPath::position(float t) const noexcept {
+    const int n = (int) this->points.size();
+    float segment = (t - std::floor(t)) * (float) n;
+    int i = std::min(n - 1, (int) segment);
+    float u = segment - (float) i;
+
+    const glm::vec3& p0 = this->points[(i + n - 1) % n];
+    const glm::vec3& p1 = this->points[i];
+    const glm::vec3& p2 = this->points[(i + 1) % n];
+    const glm::vec3& p3 = this->points[(i + 2) % n];
+
+    // Uniform Catmull-Rom
+    return 0.5f * ((2.f * p1)
+                   + (p2 - p0) * u
+                   + (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * u * u
+                   + (3.f * p1 - p0 - 3.f * p2 + p3) * u * u * u);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// BenchmarkRecorder
+///////////////////////////////////////////////////////////////////////////////
+
+void BenchmarkRecorder::addFrame(float cpuMilliseconds, float gpuMilliseconds) {
+    this->frames.push_back({cpuMilliseconds, gpuMilliseconds});
+}
+
+bool BenchmarkRecorder::writeCsv(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        std::cout << "ERROR: cannot write " << path << "\n";
+        return false;
+    }
+    out << "frame,cpu_ms,gpu_ms\n";
+    for (size_t i = 0; i < this->frames.size(); i++) {
+        out << i << "," << this->frames[i].cpuMilliseconds << "," << this->frames[i].gpuMilliseconds << "\n";
+    }
+
+    std::vector<float> cpu, gpu;
+    for (const Frame& frame : this->frames) {
+        cpu.push_back(frame.cpuMilliseconds);
+        gpu.push_back(frame.gpuMilliseconds);
+    }
+
+    std::ofstream summaryOut(path + ".summary.csv");
+    if (!summaryOut) {
+        std::cout << "ERROR: cannot write " << path << ".summary.csv\n";
+        return false;
+    }
+    summaryOut << "metric,frames,mean,p50,p90,p95,p99,max\n";
+    const char* names[] = {"cpu_ms", "gpu_ms"};
+    const std::vector<float>* values[] = {&cpu, &gpu};
+    for (int i = 0; i < 2; i++) {
+        Summary s = summarize(*values[i]);
+        summaryOut << names[i] << "," << s.count << "," << s.mean;
+        for (float p : s.percentiles) {
+            summaryOut << "," << p;
+        }
+        summaryOut << "," << s.max << "\n";
+    }
+    return true;
+}
+
+void BenchmarkRecorder::printSummary() const {
+    std::vector<float> cpu, gpu;
+    for (const Frame& frame : this->frames) {
+        cpu.push_back(frame.cpuMilliseconds);
+        gpu.push_back(frame.gpuMilliseconds);
+    }
+
+    const char* names[] = {"CPU", "GPU"};
+    const std::vector<float>* values[] = {&cpu, &gpu};
+    for (int i = 0; i < 2; i++) {
+        Summary s = summarize(*values[i]);
+        std::cout << names[i] << " frame time over " << s.count << " frames: mean " << s.mean << " ms, p50 "
+                  << s.percentiles[0] << " ms, p90 " << s.percentiles[1] << " ms, p95 " << s.percentiles[2]
+                  << " ms, p99 " << s.percentiles[3] << " ms, max " << s.max << " ms\n";
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * Closed camera path, a Catmull-Rom spline through control points
+ */
+class CameraPath {
+public:
+    /**
+     * Constructor
+     * @param points Control points, at least 4, the path goes through all of them and back to the first one
+     */
+    explicit CameraPath(std::vector<glm::vec3> points);
+
+    /**
+     * @param t Position along the path, in [0, 1[
+     * @return Point of the path
+     */
+    glm::vec3 position(float t) const noexcept;
+
+private:
+    std::vector<glm::vec3> points;
+};
+
+/**
+ * Timings of the frames of a benchmark
+ */
+class BenchmarkRecorder {
+public:
+    /**
+     * Record a frame
+     * @param cpuMilliseconds CPU time of the frame
+     * @param gpuMilliseconds GPU time of the frame, negative if it was not measured
+     */
+    void addFrame(float cpuMilliseconds, float gpuMilliseconds);
+
+    /**
+     * Write the timings of every frame to a CSV file, and their percentiles to "<path>.summary.csv"
+     * @return False if a file cannot be written
+     */
+    bool writeCsv(const std::string& path) const;
+
+    /**
+     * Print the percentiles to the standard output
+     */
+    void printSummary() const;
+
+private:
+    struct Frame {
+        float cpuMilliseconds;
+        float gpuMilliseconds;
+    };
+
+    std::vector<Frame> frames;
+};
@@ -1,17 +1,31 @@
 #include "fbo.hpp"
 #include <cstdint>
 #include <labhelper.hpp>
+#include <GLState.hpp>
 
-FboInfo::FboInfo(int numberOfColorBuffers) :
+FboInfo::FboInfo(int numberOfColorBuffers, GLenum colorFormat, bool immutableStorage) :
     isComplete(false),
     framebufferId(UINT32_MAX),
     depthBuffer(UINT32_MAX),
     width(0),
-    height(0) {
+    height(0),
+    colorFormat(colorFormat),
+    immutableStorage(immutableStorage && GLEW_ARB_texture_storage) {
     colorTextureTargets.resize(numberOfColorBuffers, UINT32_MAX);
 }
 
 void FboInfo::resize(int w, int h) {
+    if (isComplete && w == width && h == height) {
+        return;
+    }
+
+    ///////////////////////////////////////////////////////////////////////
+    // Immutable textures cannot be reallocated, start over
+    ///////////////////////////////////////////////////////////////////////
+    if (immutableStorage && isComplete) {
+        destroy();
+    }
+
     width = w;
     height = h;
 
@@ -21,7 +35,7 @@ void FboInfo::resize(int w, int h) {
     for (auto& colorTextureTarget : colorTextureTargets) {
         if (colorTextureTarget == UINT32_MAX) {
             glGenTextures(1, &colorTextureTarget);
-            glBindTexture(GL_TEXTURE_2D, colorTextureTarget);
+            owo::glstate::bindTexture(GL_TEXTURE_2D, colorTextureTarget);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         }
@@ -29,7 +43,7 @@ void FboInfo::resize(int w, int h) {
 
     if (depthBuffer == UINT32_MAX) {
         glGenTextures(1, &depthBuffer);
-        glBindTexture(GL_TEXTURE_2D, depthBuffer);
+        owo::glstate::bindTexture(GL_TEXTURE_2D, depthBuffer);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -40,13 +54,21 @@ void FboInfo::resize(int w, int h) {
     // Allocate / Resize textures
     ///////////////////////////////////////////////////////////////////////
     for (auto& colorTextureTarget : colorTextureTargets) {
-        glBindTexture(GL_TEXTURE_2D, colorTextureTarget);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        owo::glstate::bindTexture(GL_TEXTURE_2D, colorTextureTarget);
+        if (immutableStorage) {
+            glTexStorage2D(GL_TEXTURE_2D, 1, colorFormat, width, height);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, (GLint) colorFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
     }
 
-    glBindTexture(GL_TEXTURE_2D, depthBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT,
-                 nullptr);
+    owo::glstate::bindTexture(GL_TEXTURE_2D, depthBuffer);
+    if (immutableStorage) {
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32, width, height);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT,
+                     nullptr);
+    }
 
     ///////////////////////////////////////////////////////////////////////
     // Bind textures to framebuffer (if not already done)
@@ -79,6 +101,29 @@ void FboInfo::resize(int w, int h) {
     }
 }
 
+void FboInfo::destroy() {
+    for (auto& colorTextureTarget : colorTextureTargets) {
+        if (colorTextureTarget != UINT32_MAX) {
+            glDeleteTextures(1, &colorTextureTarget);
+            colorTextureTarget = UINT32_MAX;
+        }
+    }
+    if (depthBuffer != UINT32_MAX) {
+        glDeleteTextures(1, &depthBuffer);
+        depthBuffer = UINT32_MAX;
+    }
+    if (framebufferId != UINT32_MAX) {
+        glDeleteFramebuffers(1, &framebufferId);
+        framebufferId = UINT32_MAX;
+    }
+    isComplete = false;
+    width = 0;
+    height = 0;
+
+    // Deleted textures were unbound
+    owo::glstate::invalidate();
+}
+
 bool FboInfo::checkFramebufferComplete() const {
     // Check that our FBO is correctly set up, this can fail if we have
     // incompatible formats in a buffer, or for example if we specify an
@@ -9,10 +9,17 @@ public:
     int width;
     int height;
     bool isComplete;
+    // Internal format of all color attachments
+    GLenum colorFormat;
+    // Allocate textures with glTexStorage2D, a resize then recreates them
+    bool immutableStorage;
 
-    explicit FboInfo(int numberOfColorBuffers = 1);
+    explicit FboInfo(int numberOfColorBuffers = 1, GLenum colorFormat = GL_RGBA16F, bool immutableStorage = false);
 
     void resize(int w, int h);
 
+    // Delete the textures and the framebuffer, resize() allocates them again
+    void destroy();
+
     bool checkFramebufferComplete() const;
 };
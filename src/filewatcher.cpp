@@ -0,0 +1,109 @@
+#include "filewatcher.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <iostream>
+#endif
+
+using std::chrono::steady_clock;
+
+const int FileWatcher::POLL_INTERVAL_MS;
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+    if (this->inotifyFd >= 0) {
+        close(this->inotifyFd);
+    }
+#endif
+}
+
+void FileWatcher::addFile(const std::string& path) {
+    if (this->files.count(path) != 0) {
+        return;
+    }
+    this->files[path] = stamp(path);
+
+#ifdef __linux__
+    if (!this->inotifyTried) {
+        this->inotifyTried = true;
+        this->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (this->inotifyFd < 0) {
+            std::cout << "inotify not available, polling the shader files\n";
+        }
+    }
+    if (this->inotifyFd < 0) {
+        return;
+    }
+
+    // Editors often write a new file and rename it over the old one, which only the directory sees
+    size_t separator = path.find_last_of('/');
+    std::string directory = separator == std::string::npos ? "" : path.substr(0, separator + 1);
+    if (!this->watchedDirectories.insert(directory).second) {
+        return;
+    }
+    int watch = inotify_add_watch(this->inotifyFd, directory.empty() ? "." : directory.c_str(),
+                                  IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch < 0) {
+        std::cout << "Cannot watch " << directory << ", polling the shader files\n";
+        close(this->inotifyFd);
+        this->inotifyFd = -1;
+        return;
+    }
+    this->watches[watch] = directory;
+#endif
+}
+
+FileWatcher::FileStamp FileWatcher::stamp(const std::string& path) {
+    struct stat info {};
+    if (stat(path.c_str(), &info) != 0) {
+        return {0, 0};
+    }
+    return {info.st_mtime, (long long) info.st_size};
+}
+
+std::vector<std::string> FileWatcher::poll() {
+    std::set<std::string> changed;
+
+#ifdef __linux__
+    if (this->inotifyFd >= 0) {
+        alignas(inotify_event) char buffer[4096];
+        for (;;) {
+            ssize_t length = read(this->inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                // EAGAIN once all the events are read
+                break;
+            }
+            for (char* event = buffer; event < buffer + length;) {
+                const inotify_event* notification = (const inotify_event*) event;
+                auto watch = this->watches.find(notification->wd);
+                if (watch != this->watches.end() && notification->len > 0) {
+                    std::string path = watch->second + notification->name;
+                    if (this->files.count(path) != 0) {
+                        changed.insert(path);
+                    }
+                }
+                event += sizeof(inotify_event) + notification->len;
+            }
+        }
+        return std::vector<std::string>(changed.begin(), changed.end());
+    }
+#endif
+
+    steady_clock::time_point now = steady_clock::now();
+    if (now < this->nextPoll) {
+        return {};
+    }
+    this->nextPoll = now + std::chrono::milliseconds(POLL_INTERVAL_MS);
+    for (auto& file : this->files) {
+        FileStamp current = stamp(file.first);
+        if (current != file.second) {
+            file.second = current;
+            changed.insert(file.first);
+        }
+    }
+    return std::vector<std::string>(changed.begin(), changed.end());
+}
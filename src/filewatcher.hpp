@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Watches files for changes, without waiting.
+ * Uses inotify on the directories of the files on Linux, and polls the modification times of the files a few times
+ * per second elsewhere or when inotify is not available.
+ */
+class FileWatcher {
+public:
+    /**
+     * Destructor
+     */
+    ~FileWatcher();
+
+    /**
+     * Watch a file, which does not have to exist yet
+     */
+    void addFile(const std::string& path);
+
+    /**
+     * @return Paths of the watched files changed since the last call, as added
+     */
+    std::vector<std::string> poll();
+
+    /**
+     * @return True when notified by the system rather than polling
+     */
+    bool usesNotifications() const noexcept {
+        return this->inotifyFd >= 0;
+    }
+
+    /**
+     * Interval between two polls of the modification times
+     */
+    static const int POLL_INTERVAL_MS = 250;
+
+private:
+    /**
+     * Modification time and size of a file, zero if it does not exist
+     */
+    struct FileStamp {
+        time_t modified;
+        long long size;
+
+        bool operator!=(const FileStamp& other) const noexcept {
+            return this->modified != other.modified || this->size != other.size;
+        }
+    };
+
+    static FileStamp stamp(const std::string& path);
+
+    std::map<std::string, FileStamp> files;
+    std::chrono::steady_clock::time_point nextPoll;
+
+    // Notifications
+    int inotifyFd {-1};
+    bool inotifyTried {false};
+    // Directory of each watch descriptor, with its trailing separator
+    std::map<int, std::string> watches;
+    std::set<std::string> watchedDirectories;
+};
@@ -0,0 +1,146 @@
+#include "framepacer.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <Trace.hpp>
+
+using std::chrono::steady_clock;
+
+namespace {
+    // Weight of a new frame time in the prediction when it is below it, it is taken at once when above
+    const float PREDICTION_DECAY = 0.05f;
+
+    // Weight of a new latency in the running average
+    const float LATENCY_AVERAGE_WEIGHT = 0.1f;
+}
+
+FramePacer::~FramePacer() {
+    this->destroy();
+}
+
+void FramePacer::destroy() noexcept {
+    for (GLsync fence : this->fences) {
+        glDeleteSync(fence);
+    }
+    this->fences.clear();
+    this->gpuTimer.destroy();
+}
+
+void FramePacer::setRefreshRate(int hz) noexcept {
+    this->intervalMs = 1000.f / (float) (hz > 0 ? hz : 60);
+}
+
+void FramePacer::waitForFrameStart() {
+    this->sleepMs = 0.f;
+    if (this->presented) {
+        // The next refresh is an interval after the previous one
+        float startMs = std::max(this->intervalMs - this->predictedMs - this->marginMs, 0.f);
+        steady_clock::time_point deadline = this->lastPresent + std::chrono::duration_cast<steady_clock::duration>(
+            std::chrono::duration<float, std::milli>(startMs));
+        steady_clock::time_point now = steady_clock::now();
+        if (deadline > now) {
+            OWO_PROFILE_SCOPE("frame pacing wait");
+            std::this_thread::sleep_until(deadline);
+            this->sleepMs = std::chrono::duration<float, std::milli>(steady_clock::now() - now).count();
+        }
+    }
+
+    this->frameStart = steady_clock::now();
+    this->started = true;
+    this->gpuTimer.begin();
+}
+
+void FramePacer::beforeSwap() noexcept {
+    if (!this->started) {
+        return;
+    }
+    this->gpuTimer.end();
+    this->cpuMs = std::chrono::duration<float, std::milli>(steady_clock::now() - this->frameStart).count();
+}
+
+void FramePacer::afterSwap(int maxQueuedFrames) {
+    this->fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    size_t maxQueued = (size_t) std::min(std::max(maxQueuedFrames, 0), MAX_QUEUED_FRAMES);
+    while (this->fences.size() > maxQueued) {
+        OWO_PROFILE_SCOPE("frame throttling");
+        glClientWaitSync(this->fences.front(), GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(this->fences.front());
+        this->fences.pop_front();
+    }
+    this->lastPresent = steady_clock::now();
+    this->presented = true;
+
+    if (!this->started) {
+        return;
+    }
+    this->started = false;
+    // The CPU and GPU times overlap only in part, their sum errs on the safe side
+    float frameMs = this->cpuMs + std::max(this->gpuTimer.lastMilliseconds(), 0.f);
+    if (frameMs > this->predictedMs) {
+        this->predictedMs = frameMs;
+    } else {
+        this->predictedMs += PREDICTION_DECAY * (frameMs - this->predictedMs);
+    }
+}
+
+LatencyMeter::~LatencyMeter() {
+    this->destroy();
+}
+
+void LatencyMeter::destroy() noexcept {
+    if (this->queries[0] != 0) {
+        glDeleteQueries(LATENCY, this->queries);
+    }
+    for (int i = 0; i < LATENCY; i++) {
+        this->queries[i] = 0;
+        this->pending[i] = false;
+    }
+}
+
+void LatencyMeter::inputSampled() noexcept {
+    glGetInteger64v(GL_TIMESTAMP, &this->inputTime);
+    this->inputValid = true;
+}
+
+void LatencyMeter::presented(float delayMs) noexcept {
+    if (!this->inputValid) {
+        return;
+    }
+    this->inputValid = false;
+    if (this->queries[0] == 0) {
+        glGenQueries(LATENCY, this->queries);
+    }
+
+    this->collect();
+
+    // The oldest query is still in flight: drop its result rather than waiting for it
+    glQueryCounter(this->queries[this->current], GL_TIMESTAMP);
+    this->inputTimes[this->current] = this->inputTime;
+    this->delays[this->current] = delayMs;
+    this->pending[this->current] = true;
+    this->current = (this->current + 1) % LATENCY;
+}
+
+void LatencyMeter::collect() noexcept {
+    // Oldest query first, so that the latest result wins
+    for (int i = 0; i < LATENCY; i++) {
+        int slot = (this->current + i) % LATENCY;
+        if (!this->pending[slot]) {
+            continue;
+        }
+
+        GLint available = 0;
+        glGetQueryObjectiv(this->queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+
+        GLuint64 swapped;
+        glGetQueryObjectui64v(this->queries[slot], GL_QUERY_RESULT, &swapped);
+        this->lastMs = (float) ((GLint64) swapped - this->inputTimes[slot]) / 1e6f + this->delays[slot];
+        this->averageMs = this->averageMs < 0.f
+                          ? this->lastMs
+                          : this->averageMs + LATENCY_AVERAGE_WEIGHT * (this->lastMs - this->averageMs);
+        this->pending[slot] = false;
+    }
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <chrono>
+#include <deque>
+
+#include "gputimer.hpp"
+
+/**
+ * Frame pacing for low latency.
+ * Rather than starting a frame right after the previous swap and having it wait for the display, the frame is
+ * started as late as it can be while still being ready for the next refresh, from a prediction of its CPU and GPU
+ * time. Fences after each swap limit the frames queued on the GPU, which would otherwise each add a refresh of
+ * latency.
+ */
+class FramePacer {
+public:
+    FramePacer() = default;
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    /**
+     * Destructor
+     */
+    ~FramePacer();
+
+    /**
+     * Delete the fences and queries while the context exists
+     */
+    void destroy() noexcept;
+
+    /**
+     * Set the refresh rate of the display
+     * @param hz Refresh rate, 0 when unknown
+     */
+    void setRefreshRate(int hz) noexcept;
+
+    /**
+     * Sleep until the frame must start to be ready for the next refresh, then start measuring it
+     */
+    void waitForFrameStart();
+
+    /**
+     * Stop measuring the frame, right before the swap
+     */
+    void beforeSwap() noexcept;
+
+    /**
+     * Wait until at most a number of frames are queued on the GPU, right after the swap
+     * @param maxQueuedFrames 0 to wait for the frame just swapped, as glFinish() would
+     */
+    void afterSwap(int maxQueuedFrames);
+
+    /**
+     * @return Predicted time of a frame from its start to the end of its GPU work, in milliseconds
+     */
+    float predictedMilliseconds() const noexcept {
+        return this->predictedMs;
+    }
+
+    /**
+     * @return Time slept before the last frame, in milliseconds
+     */
+    float lastSleepMilliseconds() const noexcept {
+        return this->sleepMs;
+    }
+
+    /**
+     * @return Refresh interval, in milliseconds
+     */
+    float intervalMilliseconds() const noexcept {
+        return this->intervalMs;
+    }
+
+    /**
+     * Time kept in hand before the predicted deadline, for the sleep overshoot and the frame time variance, in
+     * milliseconds
+     */
+    float marginMs {2.f};
+
+    /**
+     * Maximum of frames queued allowed by afterSwap()
+     */
+    static const int MAX_QUEUED_FRAMES = 3;
+
+private:
+    std::chrono::steady_clock::time_point frameStart;
+    // End of the previous afterSwap(), which returns at the refresh when the swap or the throttling blocks
+    std::chrono::steady_clock::time_point lastPresent;
+    bool started {false};
+    bool presented {false};
+
+    float intervalMs {1000.f / 60.f};
+    float predictedMs {0.f};
+    float cpuMs {0.f};
+    float sleepMs {0.f};
+    GpuTimer gpuTimer;
+
+    // Fences of the frames swapped and possibly still queued, oldest first
+    std::deque<GLsync> fences;
+};
+
+/**
+ * Estimate of the latency from input to present.
+ * The GPU clock is read when the input is sampled, and a timestamp query is issued after the swap of the frame using
+ * it, so that the difference covers the rendering, the queuing and the swap up to the GPU being done with it. The
+ * scanout after that is not included. Results are read back a few frames later, without waiting.
+ */
+class LatencyMeter {
+public:
+    LatencyMeter() = default;
+    LatencyMeter(const LatencyMeter&) = delete;
+    LatencyMeter& operator=(const LatencyMeter&) = delete;
+
+    /**
+     * Destructor
+     */
+    ~LatencyMeter();
+
+    /**
+     * Delete the queries while the context exists, they are created again on the next presented()
+     */
+    void destroy() noexcept;
+
+    /**
+     * Mark the input of the next frame as sampled now, the latest call before presented() counts
+     */
+    void inputSampled() noexcept;
+
+    /**
+     * Mark the frame as swapped, right after the swap
+     * @param delayMs Delay added between the input being sampled and reaching the frame, in milliseconds, e.g. by
+     *                interpolating the simulation
+     */
+    void presented(float delayMs) noexcept;
+
+    /**
+     * @return Latest latency read back, in milliseconds, negative if none is available yet
+     */
+    float lastMilliseconds() const noexcept {
+        return this->lastMs;
+    }
+
+    /**
+     * @return Running average of the latency, in milliseconds, negative if none is available yet
+     */
+    float averageMilliseconds() const noexcept {
+        return this->averageMs;
+    }
+
+    /**
+     * Number of queries in flight, i.e. latency in frames of the result
+     */
+    static const int LATENCY = 4;
+
+private:
+    /**
+     * Read back the results that are available, without waiting
+     */
+    void collect() noexcept;
+
+    GLuint queries[LATENCY] {};
+    GLint64 inputTimes[LATENCY] {};
+    float delays[LATENCY] {};
+    bool pending[LATENCY] {};
+    int current {0};
+
+    GLint64 inputTime {0};
+    bool inputValid {false};
+
+    float lastMs {-1.f};
+    float averageMs {-1.f};
+};
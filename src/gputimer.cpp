@@ -0,0 +1,85 @@
+#include "gputimer.hpp"
+
+GpuTimer::~GpuTimer() {
+    this->destroy();
+}
+
+void GpuTimer::destroy() noexcept {
+    if (this->queries[0][0] != 0) {
+        glDeleteQueries(LATENCY * 2, &this->queries[0][0]);
+    }
+    for (int i = 0; i < LATENCY; i++) {
+        this->queries[i][0] = this->queries[i][1] = 0;
+        this->pending[i] = false;
+    }
+}
+
+void GpuTimer::discard() noexcept {
+    for (int i = 0; i < LATENCY; i++) {
+        this->pending[i] = false;
+    }
+    this->lastElapsedMs = -1.f;
+}
+
+void GpuTimer::begin() noexcept {
+    if (this->queries[0][0] == 0) {
+        glGenQueries(LATENCY * 2, &this->queries[0][0]);
+    }
+
+    this->collect(false);
+
+    // The oldest pair is still in flight: drop its result rather than waiting for it
+    this->pending[this->current] = false;
+    this->measurements[this->current] = this->started++;
+    glQueryCounter(this->queries[this->current][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::end() noexcept {
+    glQueryCounter(this->queries[this->current][1], GL_TIMESTAMP);
+    this->pending[this->current] = true;
+    this->current = (this->current + 1) % LATENCY;
+}
+
+void GpuTimer::startHistory() noexcept {
+    this->keepHistory = true;
+    this->historyStart = this->started;
+    this->elapsedHistory.clear();
+}
+
+void GpuTimer::finish() noexcept {
+    this->collect(true);
+}
+
+void GpuTimer::collect(bool wait) noexcept {
+    // Oldest pair first, so that the latest result wins
+    for (int i = 0; i < LATENCY; i++) {
+        int slot = (this->current + i) % LATENCY;
+        if (!this->pending[slot]) {
+            continue;
+        }
+
+        // Reading the result waits for it
+        GLint available = wait;
+        if (!wait) {
+            glGetQueryObjectiv(this->queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        }
+        if (!available) {
+            continue;
+        }
+
+        GLuint64 start, stop;
+        glGetQueryObjectui64v(this->queries[slot][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(this->queries[slot][1], GL_QUERY_RESULT, &stop);
+        this->lastElapsedMs = (float) (stop - start) / 1e6f;
+        this->pending[slot] = false;
+        this->results++;
+
+        if (this->keepHistory && this->measurements[slot] >= this->historyStart) {
+            unsigned index = this->measurements[slot] - this->historyStart;
+            if (index >= this->elapsedHistory.size()) {
+                this->elapsedHistory.resize(index + 1, -1.f);
+            }
+            this->elapsedHistory[index] = this->lastElapsedMs;
+        }
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+
+/**
+ * GPU timer, measuring the time spent by the GPU between begin() and end() with timestamp queries.
+ * Several query pairs are used in turn and each result is read back a few frames later, so that reading it never
+ * stalls the pipeline. Timestamps (rather than GL_TIME_ELAPSED) allow timers to be nested.
+ */
+class GpuTimer {
+public:
+    /**
+     * Default constructor, queries are created on first use
+     */
+    GpuTimer() = default;
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    /**
+     * Destructor
+     */
+    ~GpuTimer();
+
+    /**
+     * Delete the queries while the context exists, they are created again on the next begin()
+     */
+    void destroy() noexcept;
+
+    /**
+     * Drop the latest result and the measurements in flight, when what is measured changes
+     */
+    void discard() noexcept;
+
+    /**
+     * Start measuring, at most once per frame
+     */
+    void begin() noexcept;
+
+    /**
+     * Stop measuring
+     */
+    void end() noexcept;
+
+    /**
+     * @return Latest available elapsed time in milliseconds, negative if no measurement is available yet
+     */
+    float lastMilliseconds() const noexcept {
+        return this->lastElapsedMs;
+    }
+
+    /**
+     * @return Number of measurements read back so far, to tell when a new one is available
+     */
+    unsigned resultCount() const noexcept {
+        return this->results;
+    }
+
+    /**
+     * Keep the result of every measurement started from now on, rather than only the latest one
+     */
+    void startHistory() noexcept;
+
+    /**
+     * Wait for the measurements in flight and read them back, once the GPU is done with them
+     */
+    void finish() noexcept;
+
+    /**
+     * @return Elapsed times in milliseconds of the measurements started since startHistory(), in that order,
+     * negative for the ones dropped before their result was available
+     */
+    const std::vector<float>& history() const noexcept {
+        return this->elapsedHistory;
+    }
+
+    /**
+     * Number of query pairs in flight, i.e. latency in frames of the result
+     */
+    static const int LATENCY = 3;
+
+private:
+    /**
+     * Read back the results that are available
+     * @param wait Whether to wait for the ones in flight
+     */
+    void collect(bool wait) noexcept;
+
+    /**
+     * Start and end timestamp queries
+     */
+    GLuint queries[LATENCY][2] {};
+
+    /**
+     * Whether a query pair was issued and its result not read yet
+     */
+    bool pending[LATENCY] {};
+
+    /**
+     * Index of the measurement of each query pair, counted from the first begin()
+     */
+    unsigned measurements[LATENCY] {};
+
+    /**
+     * Query pair used by the current measurement
+     */
+    int current {0};
+
+    /**
+     * Latest elapsed time read back
+     */
+    float lastElapsedMs {-1.f};
+
+    /**
+     * Number of measurements read back
+     */
+    unsigned results {0};
+
+    /**
+     * Number of measurements started
+     */
+    unsigned started {0};
+
+    /**
+     * Whether every result is kept, and the first measurement kept
+     */
+    bool keepHistory {false};
+    unsigned historyStart {0};
+
+    std::vector<float> elapsedHistory;
+};
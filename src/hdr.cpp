@@ -1,62 +1,390 @@
 #include "hdr.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <stb_image.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <labhelper.hpp>
+#include <GLState.hpp>
+#include <Trace.hpp>
+#include "parallel.hpp"
+#include "radiance.hpp"
 
 namespace owo {
-    struct HDRImage {
-        int width{}, height{}, components{};
-        float* data = nullptr;
-
-        // Constructor
-        explicit HDRImage(const std::string& filename) {
-            stbi_set_flip_vertically_on_load(false);
-            data = stbi_loadf(filename.c_str(), &width, &height, &components, 3);
-            stbi_set_flip_vertically_on_load(true);
-            if (data == nullptr) {
-                std::cout << "Failed to load image: " << filename << ".\n";
-                exit(1);
-            }
-        };
+    namespace {
+        std::string textureCacheDirectory;
+
+        // "OWTX", then the internal format, the size, the key, the data size and the data
+        const uint32_t TEXTURE_CACHE_MAGIC = 0x5854574fu;
+        // Changes the keys of all the cached textures, when the encoders change
+        const uint32_t TEXTURE_CACHE_VERSION = 1;
+
+        const char* const HDR_FORMAT_OPTIONS[HDR_FORMAT_COUNT] = {"rgb32f", "rgb9e5", "r11g11b10f", "bc6h"};
+
+        // Rows encoded by a thread, at least
+        const int ROWS_PER_THREAD = 32;
 
-        // Destructor
-        ~HDRImage() {
-            stbi_image_free(data);
+        /**
+         * Level of a texture in its GPU format
+         */
+        struct EncodedImage {
+            GLenum internalFormat;
+            int width;
+            int height;
+            std::vector<char> data;
         };
-    };
 
-    GLuint loadHdrTexture(const std::string& filename) {
+        bool isCompressed(GLenum internalFormat) {
+            return internalFormat == GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+        }
+
+        bool bc6hSupported() {
+            return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+        }
+
+        /**
+         * @return Bytes of an image encoded in a format other than GL_RGB32F
+         */
+        uint64_t encodedSize(GLenum internalFormat, int width, int height) {
+            if (isCompressed(internalFormat)) {
+                // Blocks of 4x4 texels, 16 bytes each
+                return ((uint64_t) width + 3) / 4 * (((uint64_t) height + 3) / 4) * 16;
+            }
+            return (uint64_t) width * (uint64_t) height * sizeof(uint32_t);
+        }
+
+        GLenum internalFormatOf(HdrFormat format) {
+            switch (format) {
+                case HDR_RGB9_E5:
+                    return GL_RGB9_E5;
+                case HDR_R11F_G11F_B10F:
+                    return GL_R11F_G11F_B10F;
+                case HDR_BC6H:
+                    return bc6hSupported() ? GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT : GL_R11F_G11F_B10F;
+                default:
+                    return GL_RGB32F;
+            }
+        }
+
+        /**
+         * @return Key of a file encoded in a format, changing when the file does
+         */
+        uint64_t textureCacheKey(const std::string& filename, GLenum internalFormat) {
+            struct stat info {};
+            stat(filename.c_str(), &info);
+            uint64_t hash = hashString(filename);
+            hash = hashString(std::to_string((long long) info.st_size) + " " + std::to_string((long long) info.st_mtime)
+                              + " " + std::to_string(internalFormat) + " " + std::to_string(TEXTURE_CACHE_VERSION),
+                              hash);
+            return hash;
+        }
+
+        std::string textureCachePath(uint64_t key) {
+            char fileName[32];
+            snprintf(fileName, sizeof(fileName), "%016llx.tex", (unsigned long long) key);
+            return textureCacheDirectory + "/" + fileName;
+        }
+
+        bool loadCachedTexture(uint64_t key, GLenum internalFormat, EncodedImage& image) {
+            std::ifstream file(textureCachePath(key), std::ios::binary);
+            if (!file) {
+                return false;
+            }
+            uint32_t header[2] = {};
+            int32_t size[2] = {};
+            uint64_t fileKey = 0;
+            uint32_t dataSize = 0;
+            file.read((char*) header, sizeof(header));
+            file.read((char*) size, sizeof(size));
+            file.read((char*) &fileKey, sizeof(fileKey));
+            file.read((char*) &dataSize, sizeof(dataSize));
+            if (!file || header[0] != TEXTURE_CACHE_MAGIC || header[1] != internalFormat || fileKey != key
+                || size[0] <= 0 || size[1] <= 0 || dataSize != encodedSize(internalFormat, size[0], size[1])) {
+                return false;
+            }
+            image.internalFormat = internalFormat;
+            image.width = size[0];
+            image.height = size[1];
+            image.data.resize(dataSize);
+            return (bool) file.read(image.data.data(), dataSize);
+        }
+
+        void storeCachedTexture(uint64_t key, const EncodedImage& image) {
+            if (!ensureDirectory(textureCacheDirectory)) {
+                return;
+            }
+            std::string path = textureCachePath(key);
+            std::ofstream file(path, std::ios::binary);
+            uint32_t header[2] = {TEXTURE_CACHE_MAGIC, image.internalFormat};
+            int32_t size[2] = {image.width, image.height};
+            uint32_t dataSize = (uint32_t) image.data.size();
+            file.write((const char*) header, sizeof(header));
+            file.write((const char*) size, sizeof(size));
+            file.write((const char*) &key, sizeof(key));
+            file.write((const char*) &dataSize, sizeof(dataSize));
+            file.write(image.data.data(), (std::streamsize) image.data.size());
+            if (!file) {
+                // A truncated file is rejected when loaded
+                std::cout << "ERROR: storeCachedTexture(): Cannot write " << path << "\n";
+            }
+        }
+
+        /**
+         * Pack the texels of an image, rows split between threads
+         */
+        void packImage(const RadianceImage& image, uint32_t (*pack)(const float*), std::vector<char>& data) {
+            data.resize((size_t) image.width * image.height * sizeof(uint32_t));
+            uint32_t* texels = (uint32_t*) data.data();
+            auto packRows = [&](int begin, int end) {
+                for (size_t i = (size_t) begin * image.width; i < (size_t) end * image.width; i++) {
+                    texels[i] = pack(image.data.data() + 3 * i);
+                }
+            };
+
+            parallelRows(image.height, ROWS_PER_THREAD, packRows);
+        }
+
+        void uploadEncoded(int level, const EncodedImage& image) {
+            if (isCompressed(image.internalFormat)) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, image.internalFormat, image.width, image.height, 0,
+                                       (GLsizei) image.data.size(), image.data.data());
+            } else {
+                GLenum type = image.internalFormat == GL_RGB9_E5 ? GL_UNSIGNED_INT_5_9_9_9_REV
+                                                                 : GL_UNSIGNED_INT_10F_11F_11F_REV;
+                glTexImage2D(GL_TEXTURE_2D, level, image.internalFormat, image.width, image.height, 0, GL_RGB, type,
+                             image.data.data());
+            }
+        }
+
+        /**
+         * Upload a file as a level of the bound texture, from the cache when there
+         * @param bytes Set to the bytes of the level on the GPU
+         * @param error Set to the reason of a failure
+         * @return False if the file cannot be decoded
+         */
+        bool uploadHdrLevel(int level, const std::string& filename, HdrFormat format, size_t& bytes,
+                            std::string& error) {
+            GLenum internalFormat = internalFormatOf(format);
+            RadianceImage image;
+            if (internalFormat == GL_RGB32F) {
+                if (!loadRadianceImage(filename, image, error)) {
+                    return false;
+                }
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGB32F, image.width, image.height, 0, GL_RGB, GL_FLOAT,
+                             image.data.data());
+                bytes = image.data.size() * sizeof(float);
+                return true;
+            }
+
+            bool cached = !textureCacheDirectory.empty();
+            uint64_t key = cached ? textureCacheKey(filename, internalFormat) : 0;
+            EncodedImage encoded {internalFormat, 0, 0, {}};
+            if (cached && loadCachedTexture(key, internalFormat, encoded)) {
+                uploadEncoded(level, encoded);
+                bytes = encoded.data.size();
+                return true;
+            }
+
+            if (!loadRadianceImage(filename, image, error)) {
+                return false;
+            }
+            encoded.width = image.width;
+            encoded.height = image.height;
+            if (isCompressed(internalFormat)) {
+                // Compressed by the driver from the floats, then read back to be cached
+                glTexImage2D(GL_TEXTURE_2D, level, internalFormat, image.width, image.height, 0, GL_RGB, GL_FLOAT,
+                             image.data.data());
+                GLint compressed = GL_FALSE, size = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                if (!compressed || size <= 0) {
+                    bytes = image.data.size() * sizeof(float);
+                    return true;
+                }
+                encoded.data.resize((size_t) size);
+                glGetCompressedTexImage(GL_TEXTURE_2D, level, encoded.data.data());
+            } else {
+                packImage(image, internalFormat == GL_RGB9_E5 ? packRgb9e5 : packR11g11b10f, encoded.data);
+                uploadEncoded(level, encoded);
+            }
+            if (cached) {
+                storeCachedTexture(key, encoded);
+            }
+            bytes = encoded.data.size();
+            return true;
+        }
+
+        void logHdrLoad(const std::string& filename, HdrFormat format, size_t bytes,
+                        std::chrono::steady_clock::time_point start) {
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            printf("HDR texture %s loaded as %s (%.2f MB) in %.1f ms\n", filename.c_str(), hdrFormatName(format),
+                   (double) bytes / (1024. * 1024.), elapsed.count());
+        }
+
+        /**
+         * Unsigned float of 5 bits of exponent and the given bits of mantissa, rounded to the nearest and clamped to
+         * the largest finite value
+         */
+        uint32_t packUnsignedFloat(float value, int mantissaBits) {
+            const uint32_t largest = (30u << mantissaBits) | ((1u << mantissaBits) - 1u);
+            // False for NaN too
+            if (!(value > 0.f)) {
+                return 0;
+            }
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            uint32_t mantissa = bits & 0x7fffffu;
+            int exponent = (int) (bits >> 23u) - 127 + 15;
+
+            if (exponent <= 0) {
+                // Denormal, the implicit bit made explicit
+                if (exponent < -mantissaBits) {
+                    return 0;
+                }
+                int shift = 24 - mantissaBits - exponent;
+                // Rounding up to the smallest normal carries into the exponent
+                return ((mantissa | 0x800000u) + (1u << (shift - 1))) >> shift;
+            }
+            if (exponent > 30) {
+                return largest;
+            }
+            int shift = 23 - mantissaBits;
+            uint32_t packed = ((uint32_t) exponent << mantissaBits) | (mantissa >> shift);
+            // Rounding up to the next power of two carries into the exponent
+            packed += (mantissa >> (shift - 1)) & 1u;
+            return std::min(packed, largest);
+        }
+    }
+
+    const char* hdrFormatName(HdrFormat format) {
+        switch (format) {
+            case HDR_RGB9_E5:
+                return "RGB9_E5";
+            case HDR_R11F_G11F_B10F:
+                return "R11F_G11F_B10F";
+            case HDR_BC6H:
+                return bc6hSupported() ? "BC6H" : "R11F_G11F_B10F (no BC6H)";
+            default:
+                return "RGB32F";
+        }
+    }
+
+    const char* hdrFormatOption(HdrFormat format) {
+        return HDR_FORMAT_OPTIONS[format < HDR_FORMAT_COUNT ? format : HDR_RGB32F];
+    }
+
+    bool parseHdrFormat(const std::string& option, HdrFormat& format) {
+        const char* const* end = HDR_FORMAT_OPTIONS + HDR_FORMAT_COUNT;
+        const char* const* found = std::find(HDR_FORMAT_OPTIONS, end, option);
+        if (found == end) {
+            return false;
+        }
+        format = (HdrFormat) (found - HDR_FORMAT_OPTIONS);
+        return true;
+    }
+
+    std::string hdrContainerPath(const std::string& base, HdrFormat format) {
+        return base + "." + hdrFormatOption(format) + ".owotex";
+    }
+
+    void setHdrTextureCache(const std::string& directory) {
+        textureCacheDirectory = directory;
+    }
+
+    uint32_t packRgb9e5(const float* rgb) noexcept {
+        // EXT_texture_shared_exponent: 9 bits of mantissa, exponent bias of 15, largest exponent of 31
+        const int MANTISSA_BITS = 9;
+        const int EXPONENT_BIAS = 15;
+        const float LARGEST = 65408.f;
+
+        float r = std::min(std::max(rgb[0], 0.f), LARGEST);
+        float g = std::min(std::max(rgb[1], 0.f), LARGEST);
+        float b = std::min(std::max(rgb[2], 0.f), LARGEST);
+        // Also NaN to 0
+        r = r == r ? r : 0.f;
+        g = g == g ? g : 0.f;
+        b = b == b ? b : 0.f;
+        float largest = std::max(r, std::max(g, b));
+        if (largest == 0.f) {
+            return 0;
+        }
+
+        // floor(log2(largest)) exactly, which is the exponent of frexp minus one
+        int exponent;
+        std::frexp(largest, &exponent);
+        int shared = std::max(exponent - 1, -EXPONENT_BIAS - 1) + 1 + EXPONENT_BIAS;
+        float scale = std::ldexp(1.f, MANTISSA_BITS + EXPONENT_BIAS - shared);
+        if ((int) std::floor(largest * scale + 0.5f) == 1 << MANTISSA_BITS) {
+            shared++;
+            scale *= 0.5f;
+        }
+
+        uint32_t rs = (uint32_t) std::floor(r * scale + 0.5f);
+        uint32_t gs = (uint32_t) std::floor(g * scale + 0.5f);
+        uint32_t bs = (uint32_t) std::floor(b * scale + 0.5f);
+        return rs | (gs << 9u) | (bs << 18u) | ((uint32_t) shared << 27u);
+    }
+
+    uint32_t packR11g11b10f(const float* rgb) noexcept {
+        return packUnsignedFloat(rgb[0], 6) | (packUnsignedFloat(rgb[1], 6) << 11u)
+               | (packUnsignedFloat(rgb[2], 5) << 22u);
+    }
+
+    GLuint loadHdrTexture(const std::string& filename, HdrFormat format) {
+        OWO_PROFILE_SCOPE("loadHdrTexture");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
         GLuint texId;
         glGenTextures(1, &texId);
-        glBindTexture(GL_TEXTURE_2D, texId);
+        glstate::bindTexture(GL_TEXTURE_2D, texId);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-        HDRImage image(filename);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, image.width, image.height, 0, GL_RGB, GL_FLOAT, image.data);
-
+        size_t bytes = 0;
+        std::string error;
+        if (!uploadHdrLevel(0, filename, format, bytes, error)) {
+            std::cout << "ERROR: loadHdrTexture(): " << error << "\n";
+            glDeleteTextures(1, &texId);
+            // Unbound, and its name may be given to the next texture
+            glstate::invalidate();
+            return 0;
+        }
+        logHdrLoad(filename, format, bytes, start);
         return texId;
     }
 
-    GLuint loadHdrMipmapTexture(const std::vector<std::string>& filenames) {
+    GLuint loadHdrMipmapTexture(const std::vector<std::string>& filenames, HdrFormat format) {
+        OWO_PROFILE_SCOPE("loadHdrMipmapTexture");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
         GLuint texId;
         glGenTextures(1, &texId);
-        glBindTexture(GL_TEXTURE_2D, texId);
+        glstate::bindTexture(GL_TEXTURE_2D, texId);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
+        size_t bytes = 0;
         for (int i = 0; i < filenames.size(); i++) {
-            HDRImage image(filenames[i]);
-            glTexImage2D(GL_TEXTURE_2D, i, GL_RGB32F, image.width, image.height, 0, GL_RGB, GL_FLOAT, image.data);
-            if (i == 0) {
-                glGenerateMipmap(GL_TEXTURE_2D);
+            size_t levelBytes = 0;
+            std::string error;
+            if (!uploadHdrLevel(i, filenames[i], format, levelBytes, error)) {
+                std::cout << "ERROR: loadHdrMipmapTexture(): " << error << "\n";
+                glDeleteTextures(1, &texId);
+                glstate::invalidate();
+                return 0;
             }
+            bytes += levelBytes;
         }
+        // Complete with the given levels only, rather than down to 1x1
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) filenames.size() - 1);
 
+        logHdrLoad(filenames.empty() ? "" : filenames[0], format, bytes, start);
         return texId;
     }
 } // namespace owo
@@ -1,9 +1,73 @@
+#pragma once
+
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <GL/glew.h>
 
 namespace owo {
-    GLuint loadHdrTexture(const std::string& filename);
+    /**
+     * GPU format of the HDR textures. The packed and compressed ones are encoded once and kept in the texture cache.
+     */
+    enum HdrFormat {
+        // 12 bytes per texel, as decoded
+        HDR_RGB32F = 0,
+        // 4 bytes, 9 bits of mantissa per channel with a shared exponent
+        HDR_RGB9_E5 = 1,
+        // 4 bytes, a float of 11, 11 and 10 bits per channel
+        HDR_R11F_G11F_B10F = 2,
+        // 1 byte, compressed by the driver, R11F_G11F_B10F when not supported
+        HDR_BC6H = 3,
+        HDR_FORMAT_COUNT = 4,
+    };
+
+    /**
+     * @return Name of a format, e.g. for the GUI
+     */
+    const char* hdrFormatName(HdrFormat format);
+
+    /**
+     * @return Name of a format on the command line, e.g. "rgb9e5"
+     */
+    const char* hdrFormatOption(HdrFormat format);
+
+    /**
+     * @param format Set to the format named by an option
+     * @return False if no format has this name
+     */
+    bool parseHdrFormat(const std::string& option, HdrFormat& format);
+
+    /**
+     * @return Path of the texture container of the environment maps starting with base in a format, e.g.
+     * "../scenes/envmaps/001.rgb9e5.owotex", made by envbake
+     */
+    std::string hdrContainerPath(const std::string& base, HdrFormat format);
+
+    /**
+     * Set the directory where the HDR textures are kept in their GPU format, named after a hash of the path, size and
+     * modification time of their file, so that the next launches skip decoding and encoding them. Empty, the default,
+     * disables the cache.
+     */
+    void setHdrTextureCache(const std::string& directory);
+
+    /**
+     * @return Texture of a Radiance .hdr file, 0 if it cannot be loaded, the error being printed
+     */
+    GLuint loadHdrTexture(const std::string& filename, HdrFormat format = HDR_RGB32F);
+
+    /**
+     * Texture whose levels are the given files, e.g. prefiltered for increasing roughnesses
+     * @return 0 if a file cannot be loaded, the error being printed
+     */
+    GLuint loadHdrMipmapTexture(const std::vector<std::string>& filenames, HdrFormat format = HDR_RGB32F);
+
+    /**
+     * Pack RGB floats as GL_UNSIGNED_INT_5_9_9_9_REV, clamping negative values to 0
+     */
+    uint32_t packRgb9e5(const float* rgb) noexcept;
 
-    GLuint loadHdrMipmapTexture(const std::vector<std::string>& filenames);
+    /**
+     * Pack RGB floats as GL_UNSIGNED_INT_10F_11F_11F_REV, clamping negative values to 0
+     */
+    uint32_t packR11g11b10f(const float* rgb) noexcept;
 }
@@ -4,78 +4,90 @@
 #include <cstdint>
 #include <glm/glm.hpp>
 #include <stb_image.h>
+#include <GLState.hpp>
+#include <Trace.hpp>
 
 using std::string;
 
 void HeightField::generateMesh(int p_tessellation) noexcept {
+    OWO_PROFILE_SCOPE("HeightField::generateMesh");
     this->tessellation = p_tessellation;
 
-    glGenBuffers(1, &this->positionBuffer);
-    glGenBuffers(1, &this->uvBuffer);
-    glGenBuffers(1, &this->indexBuffer);
-
-    glGenVertexArrays(1, &this->vao);
-    glBindVertexArray(this->vao);
-
-    positions.clear();
-    texCoords.clear();
-    indices.clear();
-
-    positions.reserve((tessellation + 1) * (tessellation + 1) * 3);
-    texCoords.reserve((tessellation + 1) * (tessellation + 1) * 2);
-    indices.reserve(tessellation * tessellation * 2 * 3);
-
-    for (int z = 0; z <= tessellation; ++z) {
-        for (int x = 0; x <= tessellation; ++x) {
-            positions.push_back(2.f * (float) x / ((float) tessellation) - 1.f); // x
-            positions.push_back(0.f);                                            // y
-            positions.push_back(2.f * (float) z / ((float) tessellation) - 1.f); // z
-
-            texCoords.push_back((float) x / ((float) tessellation)); // u
-            texCoords.push_back((float) z / ((float) tessellation)); // v
-        }
+    // Buffers are reused when the mesh is generated again, only their content changes
+    if (this->vao == UINT32_MAX) {
+        glGenBuffers(1, &this->positionBuffer);
+        glGenBuffers(1, &this->uvBuffer);
+        glGenBuffers(1, &this->indexBuffer);
+        glGenVertexArrays(1, &this->vao);
     }
+    owo::glstate::bindVertexArray(this->vao);
 
-    for (int z = 0; z < tessellation; ++z) {
-        for (int x = 0; x <= tessellation; ++x) {
-            indices.push_back(x + z * (tessellation + 1));
-            indices.push_back(x + (z + 1) * (tessellation + 1));
-        }
-
-        indices.push_back(UINT32_MAX);
-    }
+    buildGrid(this->tessellation, this->positions, this->texCoords, this->indices);
 
     // Positions
-    glBindBuffer(GL_ARRAY_BUFFER, this->positionBuffer);
+    owo::glstate::bindBuffer(GL_ARRAY_BUFFER, this->positionBuffer);
     glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (positions.size() * sizeof(float)), &positions[0], GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, false, 0, nullptr);
     glEnableVertexAttribArray(0);
 
     // Texture coordinates
-    glBindBuffer(GL_ARRAY_BUFFER, this->uvBuffer);
+    owo::glstate::bindBuffer(GL_ARRAY_BUFFER, this->uvBuffer);
     glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (texCoords.size() * sizeof(float)), &texCoords[0], GL_STATIC_DRAW);
     glVertexAttribPointer(2, 2, GL_FLOAT, false, 0, nullptr);
     glEnableVertexAttribArray(2);
 
-    // Triangle indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->indexBuffer);
+    // Triangle indices, the binding is recorded in the VAO
+    owo::glstate::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->indexBuffer);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                  (GLsizeiptr) (indices.size() * sizeof(uint32_t)),
                  &indices[0],
                  GL_STATIC_DRAW);
 }
 
+void HeightField::buildGrid(int p_tessellation,
+                            std::vector<float>& p_positions,
+                            std::vector<float>& p_texCoords,
+                            std::vector<uint32_t>& p_indices) {
+    p_positions.clear();
+    p_texCoords.clear();
+    p_indices.clear();
+
+    p_positions.reserve((p_tessellation + 1) * (p_tessellation + 1) * 3);
+    p_texCoords.reserve((p_tessellation + 1) * (p_tessellation + 1) * 2);
+    // Two indices per vertex and a restart index per row
+    p_indices.reserve(p_tessellation * (2 * (p_tessellation + 1) + 1));
+
+    for (int z = 0; z <= p_tessellation; ++z) {
+        for (int x = 0; x <= p_tessellation; ++x) {
+            p_positions.push_back(2.f * (float) x / ((float) p_tessellation) - 1.f); // x
+            p_positions.push_back(0.f);                                              // y
+            p_positions.push_back(2.f * (float) z / ((float) p_tessellation) - 1.f); // z
+
+            p_texCoords.push_back((float) x / ((float) p_tessellation)); // u
+            p_texCoords.push_back((float) z / ((float) p_tessellation)); // v
+        }
+    }
+
+    for (int z = 0; z < p_tessellation; ++z) {
+        for (int x = 0; x <= p_tessellation; ++x) {
+            p_indices.push_back(x + z * (p_tessellation + 1));
+            p_indices.push_back(x + (z + 1) * (p_tessellation + 1));
+        }
+
+        p_indices.push_back(UINT32_MAX);
+    }
+}
+
 void HeightField::submitTriangles(bool linesOnly) const noexcept {
     if (vao == UINT32_MAX) {
         std::cout << "No vertex array is generated, cannot draw anything.\n";
         return;
     }
 
-    glEnable(GL_PRIMITIVE_RESTART);
-    glPrimitiveRestartIndex(UINT32_MAX);
+    owo::glstate::enable(GL_PRIMITIVE_RESTART);
+    owo::glstate::primitiveRestartIndex(UINT32_MAX);
 
-    glBindVertexArray(this->vao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->indexBuffer);
+    owo::glstate::bindVertexArray(this->vao);
 
     if (linesOnly) {
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -17,12 +17,31 @@ public:
      */
     void generateMesh(int tessellation) noexcept;
 
+    /**
+     * Build the grid of the mesh on the CPU, without touching any GL state
+     * @param tessellation Tessellation level, the number of "squares" per side
+     * @param positions Vertex positions (x, 0, z) in [-1, 1]
+     * @param texCoords Texture coordinates in [0, 1]
+     * @param indices Triangle strip indices, one strip per row separated by the restart index UINT32_MAX
+     */
+    static void buildGrid(int tessellation,
+                          std::vector<float>& positions,
+                          std::vector<float>& texCoords,
+                          std::vector<uint32_t>& indices);
+
     /**
      * Display the mesh
      * @param linesOnly Render only the lines
      */
     void submitTriangles(bool linesOnly) const noexcept;
 
+    /**
+     * @return Tessellation level of the current mesh
+     */
+    int getTessellation() const noexcept {
+        return this->tessellation;
+    }
+
 private:
     //-------------------------------------------------------------------------
     // OpenGL variables
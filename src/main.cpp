@@ -8,6 +8,10 @@ unsigned int NvOptimusEnablement = 0x00000001;
 #include <cstdlib>
 #include <algorithm>
 #include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
 
 #include <labhelper.hpp>
 #include <imgui.h>
@@ -19,9 +23,24 @@ unsigned int NvOptimusEnablement = 0x00000001;
 using namespace glm;
 
 #include <Model.hpp>
+#include <ModelBatch.hpp>
+#include <GLState.hpp>
+#include <Trace.hpp>
 #include "hdr.hpp"
 #include "fbo.hpp"
 #include "heightfield.hpp"
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include "resolutionscaler.hpp"
+#include "tessellationcontroller.hpp"
+#include "profiler.hpp"
+#include "pipelinestats.hpp"
+#include "benchmark.hpp"
+#include "replay.hpp"
+#include "simulation.hpp"
+#include "framepacer.hpp"
+#include "shaderreloader.hpp"
+#include "texturecontainer.hpp"
 
 using std::min;
 using std::max;
@@ -36,6 +55,51 @@ float deltaTime = 0.0f;
 bool showUI = true;
 int windowWidth, windowHeight;
 
+// GL state calls of the previous frame
+owo::glstate::Counters glStateCounters;
+
+// GPU time of each render graph pass and of the GUI
+GpuProfiler gpuProfiler;
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmark mode (--benchmark): offscreen, fixed time step and scripted camera
+// path over the default seed and tessellation
+///////////////////////////////////////////////////////////////////////////////
+bool benchmarkMode = false;
+int benchmarkFrames = 600;
+std::string benchmarkOutput = "benchmark.csv";
+const int BENCHMARK_WIDTH = 1920;
+const int BENCHMARK_HEIGHT = 1080;
+const int BENCHMARK_WARMUP_FRAMES = 30;
+const float BENCHMARK_TIME_STEP = 1.f / 60.f;
+// Stands for the default framebuffer, which a surfaceless context does not have
+FboInfo benchmarkTarget(1, GL_RGBA8);
+
+// Linked programs are kept there, unless --no-program-cache
+bool useProgramCache = true;
+const std::string programCacheDirectory = "shader_cache";
+// Environment textures encoded in packed or compressed formats are kept there, unless --no-texture-cache
+bool useTextureCache = true;
+const std::string textureCacheDirectory = "texture_cache";
+
+// CPU trace, recorded from startup with --trace
+bool cpuTraceEnabled = false;
+const std::string cpuTracePath = "trace.json";
+
+///////////////////////////////////////////////////////////////////////////////
+// Session recording (--record) and replay (--replay, --replay-fast): the
+// camera, light and GUI parameters of every frame, so that a reported stutter
+// can be replayed and profiled over the same frame sequence
+///////////////////////////////////////////////////////////////////////////////
+ReplayParameters replayParameters;
+SessionRecorder sessionRecorder;
+SessionPlayer sessionPlayer;
+std::string sessionPath = "session.oworec";
+// Replay with the recorded frame times, or as fast as possible
+bool replayFast = false;
+std::chrono::steady_clock::time_point replayStart;
+double replayElapsed = 0.;
+
 // Mouse input
 ivec2 g_prevMouseCoords = {-1, -1};
 bool g_isMouseDragging = false;
@@ -47,6 +111,50 @@ bool g_isMouseRightDragging = false;
 GLuint shaderProgram;       // Shader for rendering the final image
 GLuint backgroundProgram;
 GLuint heightfieldProgram;
+GLuint pullingProgram;      // Vertex pulling variant of shaderProgram, for the model batch
+GLuint heightfieldGBufferProgram;
+GLuint deferredLightingProgram;
+// Depth-only variants, for the depth pre-pass
+GLuint heightfieldDepthProgram;
+GLuint modelDepthProgram;
+GLuint pullingDepthProgram;
+GLuint temporalProgram;
+// Overdraw heat map
+GLuint heightfieldOverdrawProgram;
+GLuint modelOverdrawProgram;
+GLuint pullingOverdrawProgram;
+GLuint heatmapProgram;
+
+// Rebuilds the programs above in the background when their files change
+ShaderReloader shaderReloader;
+
+///////////////////////////////////////////////////////////////////////////////
+// Terrain quality: each tier is a variant of the terrain programs, specialised
+// at compile time for its octave counts and lighting rather than branching at
+// runtime. All are built at startup, so that the GUI switches instantly.
+///////////////////////////////////////////////////////////////////////////////
+enum TerrainQuality {
+    QUALITY_LOW = 0,
+    QUALITY_MEDIUM = 1,
+    QUALITY_HIGH = 2,
+    QUALITY_COUNT = 3,
+};
+int terrainQuality = QUALITY_HIGH;
+const owo::ShaderDefines TERRAIN_QUALITY_DEFINES[QUALITY_COUNT] = {
+    {"HEIGHT_OCTAVES 6", "BLEEDING_OCTAVES 3", "ENVIRONMENT_LIGHTING 0"},
+    {"HEIGHT_OCTAVES 8", "BLEEDING_OCTAVES 4", "ENVIRONMENT_LIGHTING 1"},
+    {"HEIGHT_OCTAVES 10", "BLEEDING_OCTAVES 6", "ENVIRONMENT_LIGHTING 1"},
+};
+
+// Variants of the heightfield*Program and deferredLightingProgram above
+struct TerrainPrograms {
+    GLuint shading;
+    GLuint gBuffer;
+    GLuint depth;
+    GLuint overdraw;
+    GLuint deferredLighting;
+};
+TerrainPrograms terrainPrograms[QUALITY_COUNT];
 
 ///////////////////////////////////////////////////////////////////////////////
 // Environment
@@ -54,6 +162,8 @@ GLuint heightfieldProgram;
 float environment_multiplier = 1.5f;
 GLuint environmentMap, irradianceMap, reflectionMap;
 const std::string envmap_base_name = "001";
+// owo::HdrFormat of the environment textures, --environment-format followed by one of the options below
+int environmentFormat = owo::HDR_RGB32F;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Light source
@@ -68,6 +178,69 @@ float point_light_intensity_multiplier = 10000.0f;
 FboInfo shadowMapFB;
 int shadowMapResolution = 1024;
 
+///////////////////////////////////////////////////////////////////////////////
+// Deferred shading
+///////////////////////////////////////////////////////////////////////////////
+bool useDeferredShading = false;
+
+// GPU time of the terrain, for both shading paths
+GpuTimer terrainGBufferTimer;
+GpuTimer terrainShadingTimer;
+float terrainForwardMs = -1.f;
+float terrainDeferredMs = -1.f;
+
+///////////////////////////////////////////////////////////////////////////////
+// Depth pre-pass: lay down the depth first, then shade with GL_EQUAL so the
+// terrain lighting only runs once per visible pixel
+///////////////////////////////////////////////////////////////////////////////
+bool useDepthPrePass = false;
+GpuTimer depthPrePassTimer;
+
+// Path measured by the terrain timers, their results being discarded when it changes
+bool terrainDeferredPath = false;
+bool terrainDepthPrePass = false;
+
+///////////////////////////////////////////////////////////////////////////////
+// Frame render graph, transient targets are recycled through the pool
+///////////////////////////////////////////////////////////////////////////////
+RenderGraph renderGraph;
+RenderTargetPool renderTargetPool;
+
+///////////////////////////////////////////////////////////////////////////////
+// Dynamic resolution: the scene is rendered offscreen at a resolution scaled
+// to hold a GPU frame time budget, then upscaled to the window
+///////////////////////////////////////////////////////////////////////////////
+bool useDynamicResolution = false;
+ResolutionScaler resolutionScaler(16.6f);
+GpuTimer frameTimer;
+int renderWidth, renderHeight;
+
+///////////////////////////////////////////////////////////////////////////////
+// Temporal upsampling: the projection is jittered by a different sub-pixel
+// offset every frame, and frames are accumulated at the window resolution by
+// reprojecting the previous result with the previous view-projection matrix
+///////////////////////////////////////////////////////////////////////////////
+bool useTemporalUpsampling = false;
+// Number of jitter positions before the sequence repeats
+const int TEMPORAL_SAMPLES = 8;
+float temporalCurrentWeight = 0.1f;
+FboInfo historyFB[2];
+int historyIndex = 0;
+bool historyValid = false;
+int temporalFrame = 0;
+mat4 previousViewProjMatrix;
+
+///////////////////////////////////////////////////////////////////////////////
+// Debug views: pipeline statistics of the frame, and overdraw heat map of the
+// terrain and models
+///////////////////////////////////////////////////////////////////////////////
+bool showPipelineStatistics = false;
+PipelineStatistics pipelineStatistics;
+bool showOverdraw = false;
+// Count the fragments passing the depth test, i.e. the shaded ones, rather than all the rasterized ones
+bool overdrawDepthTested = true;
+float maxOverdraw = 8.f;
+
 ///////////////////////////////////////////////////////////////////////////////
 // Camera parameters.
 ///////////////////////////////////////////////////////////////////////////////
@@ -78,92 +251,364 @@ float cameraSpeed = 30.f;
 vec3 worldUp(0.0f, 1.0f, 0.0f);
 float rotation_speed = 15.f;
 
+///////////////////////////////////////////////////////////////////////////////
+// Camera and light simulation, at a fixed rate on its own thread so that a
+// long swap does not hold the input back. The values above are the sampled
+// ones, used to render the frame.
+///////////////////////////////////////////////////////////////////////////////
+Simulation simulation({cameraPosition, cameraDirection, lightRotation});
+bool useSimulationThread = true;
+
+///////////////////////////////////////////////////////////////////////////////
+// Low-latency mode (--low-latency): frames start as late as their predicted
+// time allows, the input is latched right before the matrices are set up, and
+// the frames queued on the GPU are limited with fences
+///////////////////////////////////////////////////////////////////////////////
+bool lowLatencyMode = false;
+int maxQueuedFrames = 1;
+FramePacer framePacer;
+LatencyMeter latencyMeter;
+// Quit requested while handling the events of the latch
+bool quitRequested = false;
+
 ///////////////////////////////////////////////////////////////////////////////
 // Models
 ///////////////////////////////////////////////////////////////////////////////
 owo::Model* sphereModel = nullptr;
 
+// How model meshes are submitted
+enum ModelSubmission {
+    SUBMIT_PER_MESH = 0,
+    SUBMIT_MULTI_DRAW_INDIRECT = 1,
+    SUBMIT_VERTEX_PULLING = 2,
+};
+int modelSubmission = SUBMIT_MULTI_DRAW_INDIRECT;
+
+/**
+ * Fall back to multi-draw indirect when vertex pulling is selected but not supported, e.g. by a replayed session
+ */
+void checkModelSubmission() {
+    if (modelSubmission == SUBMIT_VERTEX_PULLING && !owo::ModelBatch::isSupported()) {
+        modelSubmission = SUBMIT_MULTI_DRAW_INDIRECT;
+    }
+}
+
+// All models in shared buffers, drawn with one call when using vertex pulling
+owo::ModelBatch modelBatch;
+uint32_t lightSphereInstance;
+
 HeightField terrain;
 bool onlyTrianglesMesh = false;
 int tessellation = 256;
+// Adjust the tessellation to the GPU time of the terrain
+bool autoTessellation = false;
+TessellationController tessellationController(4.f);
 float meshHeightIntensity = 50.f;
 float meshDensityIntensity = 300.f;
 float terrainSize = 100.f;
 float randomSeed = 100.;
+// Fade out the octaves of the terrain noise whose cells are smaller than a few pixels
+bool fadeDistantOctaves = true;
+
+/**
+ * Load the environment textures in the current format, replacing the previous ones
+ */
+void loadEnvironmentMaps() {
+    glDeleteTextures(1, &reflectionMap);
+    glDeleteTextures(1, &environmentMap);
+    glDeleteTextures(1, &irradianceMap);
+    // Deleted textures were unbound, and the loaders may get their names back
+    owo::glstate::invalidate();
+
+    // Baked by envbake, loaded as is when present
+    owo::HdrFormat format = (owo::HdrFormat) environmentFormat;
+    std::string base = "../scenes/envmaps/" + envmap_base_name;
+    std::string container = owo::hdrContainerPath(base, format);
+    std::map<std::string, GLuint> textures;
+    std::string error;
+    if (std::ifstream(container).good() && !owo::loadTextureContainer(container, textures, error)) {
+        std::cout << "ERROR: loadEnvironmentMaps(): " << error << ", loading the .hdr files\n";
+    }
+    reflectionMap = textures["reflection"];
+    environmentMap = textures["environment"];
+    irradianceMap = textures["irradiance"];
+
+    if (reflectionMap == 0) {
+        const int roughnesses = 8;
+        std::vector<std::string> filenames;
+        filenames.reserve(roughnesses);
+        for (int i = 0; i < roughnesses; i++) {
+            filenames.push_back(base + "_dl_" + std::to_string(i) + ".hdr");
+        }
+        reflectionMap = owo::loadHdrMipmapTexture(filenames, format);
+    }
+    if (environmentMap == 0) {
+        environmentMap = owo::loadHdrTexture(base + ".hdr", format);
+    }
+    if (irradianceMap == 0) {
+        irradianceMap = owo::loadHdrTexture(base + "_irradiance.hdr", format);
+    }
+}
+
+/**
+ * Delete the GL objects owned by globals while the context exists, their destructors only running after main()
+ */
+void destroyGLObjects() {
+    modelBatch.destroy();
+    terrainGBufferTimer.destroy();
+    terrainShadingTimer.destroy();
+    depthPrePassTimer.destroy();
+    frameTimer.destroy();
+    gpuProfiler.destroy();
+    renderTargetPool.destroy();
+    pipelineStatistics.destroy();
+    framePacer.destroy();
+    latencyMeter.destroy();
+}
+
+/**
+ * Register the shader programs, rebuilt when their files change
+ */
+void registerShaderPrograms() {
+    for (int quality = 0; quality < QUALITY_COUNT; quality++) {
+        const owo::ShaderDefines& defines = TERRAIN_QUALITY_DEFINES[quality];
+        TerrainPrograms& programs = terrainPrograms[quality];
+        shaderReloader.add("../shader/heightfield.vert", "../shader/heightfield.frag", &programs.shading, defines);
+        shaderReloader.add("../shader/heightfield.vert", "../shader/heightfield_gbuffer.frag", &programs.gBuffer,
+                           defines);
+        shaderReloader.add("../shader/heightfield.vert", "../shader/depth.frag", &programs.depth, defines);
+        shaderReloader.add("../shader/heightfield.vert", "../shader/overdraw.frag", &programs.overdraw, defines);
+        shaderReloader.add("../shader/background.vert", "../shader/deferred.frag", &programs.deferredLighting,
+                           defines);
+    }
+    shaderReloader.add("../shader/background.vert", "../shader/temporal.frag", &temporalProgram);
+    shaderReloader.add("../shader/shading.vert", "../shader/overdraw.frag", &modelOverdrawProgram);
+    shaderReloader.add("../shader/background.vert", "../shader/heatmap.frag", &heatmapProgram);
+    shaderReloader.add("../shader/shading.vert", "../shader/depth.frag", &modelDepthProgram);
+    shaderReloader.add("../shader/background.vert", "../shader/background.frag", &backgroundProgram);
+    shaderReloader.add("../shader/shading.vert", "../shader/shading.frag", &shaderProgram);
+    if (owo::ModelBatch::isSupported()) {
+        shaderReloader.add("../shader/pulling.vert", "../shader/shading.frag", &pullingProgram);
+        shaderReloader.add("../shader/pulling.vert", "../shader/depth.frag", &pullingDepthProgram);
+        shaderReloader.add("../shader/pulling.vert", "../shader/overdraw.frag", &pullingOverdrawProgram);
+    }
+}
+
+/**
+ * Use the variants of the terrain programs of the current quality
+ */
+void selectTerrainPrograms() {
+    const TerrainPrograms& programs = terrainPrograms[terrainQuality];
+    heightfieldProgram = programs.shading;
+    heightfieldGBufferProgram = programs.gBuffer;
+    heightfieldDepthProgram = programs.depth;
+    heightfieldOverdrawProgram = programs.overdraw;
+    deferredLightingProgram = programs.deferredLighting;
+}
+
+/**
+ * Register the parameters recorded along with the sessions, recordings made with another list cannot be replayed
+ */
+void registerReplayParameters() {
+    replayParameters.add("onlyTrianglesMesh", &onlyTrianglesMesh);
+    replayParameters.add("terrainQuality", &terrainQuality, 0, QUALITY_COUNT - 1);
+    replayParameters.add("meshHeightIntensity", &meshHeightIntensity);
+    replayParameters.add("meshDensityIntensity", &meshDensityIntensity);
+    replayParameters.add("terrainSize", &terrainSize);
+    replayParameters.add("tessellation", &tessellation, 2, tessellationController.maxTessellation);
+    replayParameters.add("autoTessellation", &autoTessellation);
+    replayParameters.add("terrainBudget", &tessellationController.budgetMilliseconds);
+    replayParameters.add("randomSeed", &randomSeed);
+    replayParameters.add("fadeDistantOctaves", &fadeDistantOctaves);
+    replayParameters.add("useDeferredShading", &useDeferredShading);
+    replayParameters.add("useDepthPrePass", &useDepthPrePass);
+    replayParameters.add("useDynamicResolution", &useDynamicResolution);
+    replayParameters.add("targetFrameTime", &resolutionScaler.targetMilliseconds);
+    replayParameters.add("minScale", &resolutionScaler.minScale);
+    replayParameters.add("useTemporalUpsampling", &useTemporalUpsampling);
+    replayParameters.add("temporalCurrentWeight", &temporalCurrentWeight);
+    replayParameters.add("showOverdraw", &showOverdraw);
+    replayParameters.add("overdrawDepthTested", &overdrawDepthTested);
+    replayParameters.add("modelSubmission", &modelSubmission, SUBMIT_PER_MESH, SUBMIT_VERTEX_PULLING);
+    replayParameters.add("environmentMultiplier", &environment_multiplier);
+    replayParameters.add("pointLightColor", &point_light_color);
+    replayParameters.add("pointLightIntensity", &point_light_intensity_multiplier);
+    replayParameters.add("lightManualOnly", &lightManualOnly);
+}
+
+/**
+ * Start replaying a session
+ * @param fast Ignore the recorded frame times
+ */
+bool startReplay(const std::string& path, bool fast) {
+    sessionRecorder.stop();
+    if (!sessionPlayer.open(path, replayParameters)) {
+        return false;
+    }
+    replayFast = fast;
+    replayStart = std::chrono::steady_clock::now();
+    replayElapsed = 0.;
+    // Not limited by the refresh rate either
+    SDL_GL_SetSwapInterval(fast ? 0 : 1);
+    std::cout << "Replaying " << sessionPlayer.frameCount() << " frames from " << path << "\n";
+    return true;
+}
 
-void loadShaders(bool is_reload) {
-    GLuint shader;
+void stopReplay() {
+    sessionPlayer.close();
+    SDL_GL_SetSwapInterval(1);
+    // Carry on from where the session ended
+    simulation.reset({cameraPosition, cameraDirection, lightRotation});
+}
 
-    shader = owo::loadShaderProgram("../shader/background.vert", "../shader/background.frag", is_reload);
-    if (shader != 0) {
-        backgroundProgram = shader;
+/**
+ * Set the state of the next replayed frame, waiting for its recorded time unless replaying as fast as possible
+ * @return False at the end of the session
+ */
+bool replayFrame() {
+    ReplayFrameState state {};
+    if (!sessionPlayer.nextFrame(state)) {
+        return false;
+    }
+    deltaTime = state.deltaTime;
+    cameraPosition = state.cameraPosition;
+    cameraDirection = state.cameraDirection;
+    lightRotation = state.lightRotation;
+    checkModelSubmission();
+    if (terrain.getTessellation() != tessellation) {
+        terrain.generateMesh(tessellation);
     }
 
-    shader = owo::loadShaderProgram("../shader/shading.vert", "../shader/shading.frag", is_reload);
-    if (shader != 0) {
-        shaderProgram = shader;
+    replayElapsed += (double) state.deltaTime;
+    if (!replayFast) {
+        OWO_PROFILE_SCOPE("replay wait");
+        std::this_thread::sleep_until(replayStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(replayElapsed)));
     }
+    return true;
+}
 
-    shader = owo::loadShaderProgram("../shader/heightfield.vert", "../shader/heightfield.frag", is_reload);
-    if (shader != 0) {
-        heightfieldProgram = shader;
+bool handleEvents();
+
+/**
+ * Set the camera and light of the frame, from the session being replayed or from the simulation, and record them.
+ * In low-latency mode, this is called right before the matrices are set up, and handles the pending events first so
+ * that the latest input makes it into the frame.
+ */
+void latchFrameState() {
+    OWO_PROFILE_SCOPE("latchFrameState");
+    if (sessionPlayer.isPlaying() && !replayFrame()) {
+        std::cout << "Replay done\n";
+        stopReplay();
+    }
+    if (!sessionPlayer.isPlaying()) {
+        if (lowLatencyMode) {
+            quitRequested = handleEvents() || quitRequested;
+        }
+        simulation.setSettings({cameraSpeed, rotation_speed, lightManualOnly});
+        if (!simulation.isThreaded()) {
+            simulation.update();
+        }
+        SimulationState state = lowLatencyMode ? simulation.sampleLatched() : simulation.sample();
+        cameraPosition = state.cameraPosition;
+        cameraDirection = state.cameraDirection;
+        lightRotation = state.lightRotation;
+    }
+    if (sessionRecorder.isRecording()) {
+        sessionRecorder.recordFrame({deltaTime, cameraPosition, cameraDirection, lightRotation});
     }
 }
 
 void initGL() {
+    OWO_PROFILE_SCOPE("initGL");
     // Load Shaders
-    heightfieldProgram = owo::loadShaderProgram("../shader/heightfield.vert", "../shader/heightfield.frag");
-    backgroundProgram = owo::loadShaderProgram("../shader/background.vert",
-                                               "../shader/background.frag");
-    shaderProgram = owo::loadShaderProgram("../shader/shading.vert", "../shader/shading.frag");
+    auto shadersStart = std::chrono::steady_clock::now();
+    registerShaderPrograms();
+    shaderReloader.loadAll();
+    checkModelSubmission();
+    std::chrono::duration<float, std::milli> shadersTime = std::chrono::steady_clock::now() - shadersStart;
+    std::cout << "Loaded the shader programs in " << shadersTime.count() << " ms\n";
 
     ///////////////////////////////////////////////////////////////////////
     // Load models and set up model matrices
     ///////////////////////////////////////////////////////////////////////
     sphereModel = owo::loadModelFromOBJ("../scenes/sphere.obj");
 
+    if (owo::ModelBatch::isSupported()) {
+        uint32_t sphereIndex = modelBatch.addModel(sphereModel);
+        lightSphereInstance = modelBatch.addInstance(sphereIndex, mat4(1.f));
+        modelBatch.upload();
+    }
+
     ///////////////////////////////////////////////////////////////////////
     // Load environment map
     ///////////////////////////////////////////////////////////////////////
-    const int roughnesses = 8;
-    std::vector<std::string> filenames;
-    filenames.reserve(roughnesses);
-    for (int i = 0; i < roughnesses; i++) {
-        filenames.push_back("../scenes/envmaps/" + envmap_base_name + "_dl_" + std::to_string(i) + ".hdr");
-    }
-
-    reflectionMap = owo::loadHdrMipmapTexture(filenames);
-    environmentMap = owo::loadHdrTexture("../scenes/envmaps/" + envmap_base_name + ".hdr");
-    irradianceMap = owo::loadHdrTexture("../scenes/envmaps/" + envmap_base_name + "_irradiance.hdr");
+    loadEnvironmentMaps();
 
     shadowMapFB.resize(shadowMapResolution, shadowMapResolution);
-    glBindTexture(GL_TEXTURE_2D, shadowMapFB.depthBuffer);
+    owo::glstate::bindTexture(GL_TEXTURE_2D, shadowMapFB.depthBuffer);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
 
-    glEnable(GL_DEPTH_TEST); // enable Z-buffering
-    glEnable(GL_CULL_FACE);  // enables backface culling
+    owo::glstate::enable(GL_DEPTH_TEST); // enable Z-buffering
+    owo::glstate::enable(GL_CULL_FACE);  // enables backface culling
 
     terrain.generateMesh(tessellation);
+
+    renderGraph.setPassHooks([](const std::string& pass) { gpuProfiler.begin(pass); },
+                             [](const std::string& pass) { gpuProfiler.end(pass); });
 }
 
+// Programs the light sphere is drawn with
+enum LightDrawMode {
+    LIGHT_SHADED,
+    LIGHT_DEPTH_ONLY,
+    LIGHT_OVERDRAW,
+};
+
 void debugDrawLight(const glm::mat4& viewMatrix,
                     const glm::mat4& projectionMatrix,
-                    const glm::vec3& worldSpaceLightPos) {
+                    const glm::vec3& worldSpaceLightPos,
+                    LightDrawMode mode = LIGHT_SHADED) {
     mat4 modelMatrix = glm::translate(worldSpaceLightPos);
-    glUseProgram(shaderProgram);
-    owo::setUniformSlow(shaderProgram, "modelViewProjectionMatrix",
+    bool shaded = mode == LIGHT_SHADED;
+
+    if (modelSubmission == SUBMIT_VERTEX_PULLING) {
+        GLuint program = shaded ? pullingProgram
+                                : mode == LIGHT_DEPTH_ONLY ? pullingDepthProgram : pullingOverdrawProgram;
+        owo::glstate::useProgram(program);
+        owo::setUniformSlow(program, "viewMatrix", viewMatrix);
+        owo::setUniformSlow(program, "projectionMatrix", projectionMatrix);
+        owo::setUniformSlow(program, "use_material_block", 1);
+        modelBatch.setInstanceTransform(lightSphereInstance, modelMatrix);
+        modelBatch.render();
+        return;
+    }
+
+    GLuint program = shaded ? shaderProgram : mode == LIGHT_DEPTH_ONLY ? modelDepthProgram : modelOverdrawProgram;
+    owo::glstate::useProgram(program);
+    owo::setUniformSlow(program, "modelViewProjectionMatrix",
                         projectionMatrix * viewMatrix * modelMatrix);
-    owo::render(sphereModel);
+    if (modelSubmission == SUBMIT_MULTI_DRAW_INDIRECT) {
+        owo::renderIndirect(sphereModel, shaded);
+    } else {
+        owo::render(sphereModel, shaded);
+    }
 }
 
 
 void drawBackground(const mat4& viewMatrix, const mat4& projectionMatrix) {
-    glUseProgram(backgroundProgram);
+    owo::glstate::useProgram(backgroundProgram);
     owo::setUniformSlow(backgroundProgram, "environment_multiplier", environment_multiplier);
     owo::setUniformSlow(backgroundProgram, "inv_PV", inverse(projectionMatrix * viewMatrix));
     owo::setUniformSlow(backgroundProgram, "camera_pos", cameraPosition);
-    owo::drawFullScreenQuad();
+
+    // The quad lies on the far plane, so only the pixels not covered by anything else are shaded
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    owo::drawFullScreenQuad(true);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
 }
 
 void drawMesh(GLuint currentShaderProgram,
@@ -171,7 +616,7 @@ void drawMesh(GLuint currentShaderProgram,
               const mat4& projectionMatrix,
               const mat4& lightViewMatrix,
               const mat4& lightProjectionMatrix) {
-    glUseProgram(currentShaderProgram);
+    owo::glstate::useProgram(currentShaderProgram);
 
     // Light source
     vec4 viewSpaceLightPosition = viewMatrix * vec4(lightPosition, 1.0f);
@@ -204,16 +649,74 @@ void drawMesh(GLuint currentShaderProgram,
                         projectionMatrix * viewMatrix * modelMatrix);
     owo::setUniformSlow(currentShaderProgram, "densityIntensity", (meshDensityIntensity * terrainSize) / 100);
     owo::setUniformSlow(currentShaderProgram, "heightIntensity", meshHeightIntensity / 100);
+    // Size of a pixel at a distance of 1, from the vertical field of view
+    float pixelFootprint = 2.f / (projectionMatrix[1][1] * float(renderHeight));
+    owo::setUniformSlow(currentShaderProgram, "pixelFootprint", fadeDistantOctaves ? pixelFootprint : 0.f);
 
     terrain.submitTriangles(onlyTrianglesMesh);
 }
 
+void drawDeferredLighting(const FboInfo* gBuffer, const mat4& viewMatrix, const mat4& projectionMatrix) {
+    owo::glstate::useProgram(deferredLightingProgram);
+
+    vec4 viewSpaceLightPosition = viewMatrix * vec4(lightPosition, 1.0f);
+    owo::setUniformSlow(deferredLightingProgram, "point_light_color", point_light_color);
+    owo::setUniformSlow(deferredLightingProgram, "point_light_intensity_multiplier",
+                        point_light_intensity_multiplier);
+    owo::setUniformSlow(deferredLightingProgram, "viewSpaceLightPosition", vec3(viewSpaceLightPosition));
+    owo::setUniformSlow(deferredLightingProgram, "environment_multiplier", environment_multiplier);
+    owo::setUniformSlow(deferredLightingProgram, "viewInverse", inverse(viewMatrix));
+    owo::setUniformSlow(deferredLightingProgram, "projectionInverse", inverse(projectionMatrix));
+
+    owo::glstate::bindTextureUnit(11, GL_TEXTURE_2D, gBuffer->colorTextureTargets[0]);
+    owo::glstate::bindTextureUnit(12, GL_TEXTURE_2D, gBuffer->colorTextureTargets[1]);
+    owo::glstate::bindTextureUnit(13, GL_TEXTURE_2D, gBuffer->depthBuffer);
+
+    // The G-buffer depth is written back and tested like any geometry
+    owo::drawFullScreenQuad(true);
+}
+
+/**
+ * Radical inverse of an index in a base, i.e. an element of the Halton sequence, in [0, 1[
+ */
+float halton(int index, int base) {
+    float result = 0.f;
+    float fraction = 1.f;
+    while (index > 0) {
+        fraction /= float(base);
+        result += fraction * float(index % base);
+        index /= base;
+    }
+    return result;
+}
+
+void drawTemporalResolve(const FboInfo* scene, const FboInfo* history, const mat4& reprojectionMatrix,
+                         const vec2& jitter) {
+    owo::glstate::useProgram(temporalProgram);
+    owo::setUniformSlow(temporalProgram, "reprojectionMatrix", reprojectionMatrix);
+    owo::setUniformSlow(temporalProgram, "jitter", jitter);
+    owo::setUniformSlow(temporalProgram, "currentWeight", historyValid ? temporalCurrentWeight : 1.f);
+
+    owo::glstate::bindTextureUnit(14, GL_TEXTURE_2D, scene->colorTextureTargets[0]);
+    owo::glstate::bindTextureUnit(15, GL_TEXTURE_2D, scene->depthBuffer);
+    owo::glstate::bindTextureUnit(16, GL_TEXTURE_2D, history->colorTextureTargets[0]);
+
+    owo::drawFullScreenQuad();
+}
+
+void drawHeatmap(const FboInfo* overdraw) {
+    owo::glstate::useProgram(heatmapProgram);
+    owo::setUniformSlow(heatmapProgram, "maxOverdraw", maxOverdraw);
+    owo::glstate::bindTextureUnit(17, GL_TEXTURE_2D, overdraw->colorTextureTargets[0]);
+    owo::drawFullScreenQuad();
+}
+
 void drawScene(GLuint currentShaderProgram,
                const mat4& viewMatrix,
                const mat4& projectionMatrix,
                const mat4& lightViewMatrix,
                const mat4& lightProjectionMatrix) {
-    glUseProgram(currentShaderProgram);
+    owo::glstate::useProgram(currentShaderProgram);
     // Light source
     vec4 viewSpaceLightPosition = viewMatrix * vec4(lightPosition, 1.0f);
     owo::setUniformSlow(currentShaderProgram, "point_light_color", point_light_color);
@@ -237,10 +740,15 @@ void drawScene(GLuint currentShaderProgram,
 }
 
 void display() {
+    OWO_PROFILE_SCOPE("display");
+    glStateCounters = owo::glstate::counters();
+    owo::glstate::resetCounters();
+    selectTerrainPrograms();
+
     ///////////////////////////////////////////////////////////////////////////
     // Check if window size has changed and resize buffers as needed
     ///////////////////////////////////////////////////////////////////////////
-    {
+    if (!benchmarkMode) {
         int w, h;
         SDL_GetWindowSize(g_window, &w, &h);
         if (w != windowWidth || h != windowHeight) {
@@ -248,18 +756,33 @@ void display() {
             windowHeight = h;
         }
     }
+    float resolutionScale = useDynamicResolution ? resolutionScaler.update(frameTimer.lastMilliseconds()) : 1.f;
+    renderWidth = max(1, int(float(windowWidth) * resolutionScale));
+    renderHeight = max(1, int(float(windowHeight) * resolutionScale));
 
     ///////////////////////////////////////////////////////////////////////////
-    // setup matrices
+    // setup matrices, from the latest input in low-latency mode
     ///////////////////////////////////////////////////////////////////////////
+    if (lowLatencyMode && !benchmarkMode) {
+        latchFrameState();
+    }
     mat4 projMatrix = perspective(radians(45.0f), float(windowWidth) / float(windowHeight), 5.0f, 2000.0f);
     mat4 viewMatrix = lookAt(cameraPosition, cameraPosition + cameraDirection, worldUp);
 
-    vec4 lightStartPosition = vec4(40.0f, 40.0f, 0.0f, 1.0f);
-    float light_rotation_speed = 1.f;
-    if (!lightManualOnly && !g_isMouseRightDragging) {
-        lightRotation += deltaTime * light_rotation_speed;
+    // Sub-pixel jitter of the render resolution, in normalized device coordinates
+    mat4 viewProjMatrix = projMatrix * viewMatrix;
+    vec2 jitter(0.f);
+    if (useTemporalUpsampling && !showOverdraw) {
+        int sample = temporalFrame % TEMPORAL_SAMPLES + 1;
+        jitter = vec2(halton(sample, 2) - 0.5f, halton(sample, 3) - 0.5f)
+                 * 2.f / vec2(float(renderWidth), float(renderHeight));
+        // Shifts x / w by the jitter, since w = -z
+        projMatrix[2][0] -= jitter.x;
+        projMatrix[2][1] -= jitter.y;
+        temporalFrame++;
     }
+
+    vec4 lightStartPosition = vec4(40.0f, 40.0f, 0.0f, 1.0f);
     lightPosition = vec3(rotate(lightRotation, worldUp) * lightStartPosition);
     mat4 lightViewMatrix = lookAt(lightPosition, vec3(0.0f), worldUp);
     mat4 lightProjMatrix = perspective(radians(45.0f), 1.0f, 25.0f, 100.0f);
@@ -267,32 +790,236 @@ void display() {
     ///////////////////////////////////////////////////////////////////////////
     // Bind the environment map(s) to unused texture units
     ///////////////////////////////////////////////////////////////////////////
-    glActiveTexture(GL_TEXTURE6);
-    glBindTexture(GL_TEXTURE_2D, environmentMap);
-    glActiveTexture(GL_TEXTURE7);
-    glBindTexture(GL_TEXTURE_2D, irradianceMap);
-    glActiveTexture(GL_TEXTURE8);
-    glBindTexture(GL_TEXTURE_2D, reflectionMap);
-    glActiveTexture(GL_TEXTURE0);
+    owo::glstate::bindTextureUnit(6, GL_TEXTURE_2D, environmentMap);
+    owo::glstate::bindTextureUnit(7, GL_TEXTURE_2D, irradianceMap);
+    owo::glstate::bindTextureUnit(8, GL_TEXTURE_2D, reflectionMap);
+
+    owo::glstate::bindTextureUnit(10, GL_TEXTURE_2D, shadowMapFB.depthBuffer);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Declare the passes of the frame, the graph orders them from the
+    // resources they access and culls those not reaching the backbuffer
+    ///////////////////////////////////////////////////////////////////////////
+    renderGraph.reset();
+    renderGraph.importTarget("backbuffer", benchmarkMode ? &benchmarkTarget : nullptr, windowWidth, windowHeight);
+    renderGraph.createTarget("scene", {renderWidth, renderHeight, 1, GL_RGBA16F});
+    // Albedo and view space normal, plus depth
+    renderGraph.createTarget("gbuffer", {renderWidth, renderHeight, 2, GL_RGBA16F});
+    if (showOverdraw) {
+        renderGraph.createTarget("overdraw", {renderWidth, renderHeight, 1, GL_RGBA16F});
+    }
+    // The heat map is shown as is rather than accumulated
+    bool temporalResolve = useTemporalUpsampling && !showOverdraw;
+    if (temporalResolve) {
+        for (auto& history : historyFB) {
+            if (history.width != windowWidth || history.height != windowHeight) {
+                history.resize(windowWidth, windowHeight);
+                historyValid = false;
+            }
+        }
+        renderGraph.importTarget("history", &historyFB[historyIndex], windowWidth, windowHeight);
+        renderGraph.importTarget("previousHistory", &historyFB[1 - historyIndex], windowWidth, windowHeight);
+    }
+
+    // Depth pre-pass, only for the forward path since the deferred one already shades each pixel once
+    bool depthPrePass = useDepthPrePass && !useDeferredShading;
+
+    // Measurements of the previous path would be taken for the new one
+    if (useDeferredShading != terrainDeferredPath || depthPrePass != terrainDepthPrePass) {
+        terrainDeferredPath = useDeferredShading;
+        terrainDepthPrePass = depthPrePass;
+        terrainGBufferTimer.discard();
+        terrainShadingTimer.discard();
+        depthPrePassTimer.discard();
+        terrainForwardMs = -1.f;
+        terrainDeferredMs = -1.f;
+        tessellationController.reset();
+    }
+
+    renderGraph.addPass("clear", [&]() {
+        renderGraph.bindTarget("scene");
+        glClearColor(0.2f, 0.2f, 0.8f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }).write("scene").write("scene.depth");
+
+    renderGraph.addPass("terrain G-buffer", [&]() {
+        terrainGBufferTimer.begin();
+        renderGraph.bindTarget("gbuffer");
+        glClearColor(0.f, 0.f, 0.f, 0.f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawMesh(heightfieldGBufferProgram, viewMatrix, projMatrix, lightViewMatrix, lightProjMatrix);
+        terrainGBufferTimer.end();
+    }).write("gbuffer").write("gbuffer.depth");
+
+    if (depthPrePass) {
+        renderGraph.addPass("depth pre-pass", [&]() {
+            depthPrePassTimer.begin();
+            renderGraph.bindTarget("scene");
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            drawMesh(heightfieldDepthProgram, viewMatrix, projMatrix, lightViewMatrix, lightProjMatrix);
+            debugDrawLight(viewMatrix, projMatrix, vec3(lightPosition), LIGHT_DEPTH_ONLY);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            depthPrePassTimer.end();
+        }, PassOrder::EARLY).depthTestedWrite("scene.depth");
+    }
+
+    // Shading passes of the forward path only test against the depth of the pre-pass
+    auto beginShading = [&]() {
+        renderGraph.bindTarget("scene");
+        if (depthPrePass) {
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+    };
+    auto endShading = [&]() {
+        if (depthPrePass) {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+    };
+
+    RenderPass& terrainPass = renderGraph.addPass("terrain", [&]() {
+        terrainShadingTimer.begin();
+        if (useDeferredShading) {
+            renderGraph.bindTarget("scene");
+            drawDeferredLighting(renderGraph.target("gbuffer"), viewMatrix, projMatrix);
+        } else {
+            beginShading();
+            drawMesh(heightfieldProgram, viewMatrix, projMatrix, lightViewMatrix, lightProjMatrix);
+            endShading();
+        }
+        terrainShadingTimer.end();
+    });
+    if (useDeferredShading) {
+        terrainPass.read("gbuffer").read("gbuffer.depth");
+    }
+    terrainPass.depthTestedWrite("scene");
+    if (depthPrePass) {
+        terrainPass.read("scene.depth");
+    } else {
+        terrainPass.depthTestedWrite("scene.depth");
+    }
+
+    // Separate passes so that the profiler times them separately. The light is drawn with the programs set up by the
+    // scene pass, declared first so that it runs first
+    RenderPass& scenePass = renderGraph.addPass("scene", [&]() {
+        beginShading();
+        drawScene(shaderProgram, viewMatrix, projMatrix, lightViewMatrix, lightProjMatrix);
+        if (modelSubmission == SUBMIT_VERTEX_PULLING) {
+            drawScene(pullingProgram, viewMatrix, projMatrix, lightViewMatrix, lightProjMatrix);
+        }
+        endShading();
+    });
+    RenderPass& debugLightPass = renderGraph.addPass("debug light", [&]() {
+        beginShading();
+        debugDrawLight(viewMatrix, projMatrix, vec3(lightPosition));
+        endShading();
+    });
+    for (RenderPass* pass : {&scenePass, &debugLightPass}) {
+        pass->depthTestedWrite("scene");
+        if (depthPrePass) {
+            pass->read("scene.depth");
+        } else {
+            pass->depthTestedWrite("scene.depth");
+        }
+    }
 
-    glActiveTexture(GL_TEXTURE10);
-    glBindTexture(GL_TEXTURE_2D, shadowMapFB.depthBuffer);
+    // Reads the final depth, so it runs after all the geometry and early depth testing rejects covered pixels
+    renderGraph.addPass("background", [&]() {
+        renderGraph.bindTarget("scene");
+        drawBackground(viewMatrix, projMatrix);
+    }, PassOrder::LATE).read("scene.depth").depthTestedWrite("scene");
 
     ///////////////////////////////////////////////////////////////////////////
-    // Draw from camera
+    // Overdraw heat map, replacing the scene so the passes above are culled
     ///////////////////////////////////////////////////////////////////////////
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, windowWidth, windowHeight);
-    glClearColor(0.2f, 0.2f, 0.8f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    drawBackground(viewMatrix, projMatrix);
-    drawScene(shaderProgram, viewMatrix, projMatrix, lightViewMatrix, lightProjMatrix);
-    drawMesh(heightfieldProgram, viewMatrix, projMatrix, lightViewMatrix, lightProjMatrix);
-    debugDrawLight(viewMatrix, projMatrix, vec3(lightPosition));
+    if (showOverdraw) {
+        renderGraph.addPass("overdraw", [&]() {
+            renderGraph.bindTarget("overdraw");
+            glClearColor(0.f, 0.f, 0.f, 0.f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            owo::glstate::setEnabled(GL_DEPTH_TEST, overdrawDepthTested);
+            owo::glstate::enable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            drawMesh(heightfieldOverdrawProgram, viewMatrix, projMatrix, lightViewMatrix, lightProjMatrix);
+            debugDrawLight(viewMatrix, projMatrix, vec3(lightPosition), LIGHT_OVERDRAW);
+            owo::glstate::disable(GL_BLEND);
+            owo::glstate::enable(GL_DEPTH_TEST);
+        }).write("overdraw").write("overdraw.depth");
+
+        renderGraph.addPass("overdraw heat map", [&]() {
+            renderGraph.bindTarget("scene");
+            drawHeatmap(renderGraph.target("overdraw"));
+        }).read("overdraw").write("scene");
+    }
+
+    if (temporalResolve) {
+        renderGraph.addPass("temporal resolve", [&]() {
+            renderGraph.bindTarget("history");
+            drawTemporalResolve(renderGraph.target("scene"), renderGraph.target("previousHistory"),
+                                previousViewProjMatrix * inverse(viewProjMatrix), 0.5f * jitter);
+        }).read("scene").read("scene.depth").read("previousHistory").write("history");
+    }
+
+    // Output at the window resolution, either the accumulated history or the scene upscaled as is
+    const char* output = temporalResolve ? "history" : "scene";
+    renderGraph.addPass("upscale", [&]() {
+        const FboInfo* source = renderGraph.target(output);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, source->framebufferId);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, renderGraph.framebuffer("backbuffer"));
+        glBlitFramebuffer(0, 0, source->width, source->height, 0, 0, windowWidth, windowHeight,
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, renderGraph.framebuffer("backbuffer"));
+    }).read(output).write("backbuffer");
+
+    renderGraph.setOutput("backbuffer");
+    bool pipelineStatisticsQuery = showPipelineStatistics && PipelineStatistics::isSupported();
+    if (pipelineStatisticsQuery) {
+        pipelineStatistics.begin();
+    }
+    frameTimer.begin();
+    renderGraph.execute(renderTargetPool);
+    frameTimer.end();
+    if (pipelineStatisticsQuery) {
+        pipelineStatistics.end();
+    }
+    renderTargetPool.endFrame();
+
+    if (temporalResolve) {
+        previousViewProjMatrix = viewProjMatrix;
+        historyIndex = 1 - historyIndex;
+        historyValid = true;
+    } else {
+        historyValid = false;
+    }
+
+    // Once every timer of the path has measured it
+    float terrainShadingMs = terrainShadingTimer.lastMilliseconds();
+    if (useDeferredShading) {
+        if (terrainShadingMs >= 0.f && terrainGBufferTimer.lastMilliseconds() >= 0.f) {
+            terrainDeferredMs = terrainGBufferTimer.lastMilliseconds() + terrainShadingMs;
+        }
+    } else if (depthPrePass) {
+        if (terrainShadingMs >= 0.f && depthPrePassTimer.lastMilliseconds() >= 0.f) {
+            terrainForwardMs = depthPrePassTimer.lastMilliseconds() + terrainShadingMs;
+        }
+    } else {
+        terrainForwardMs = terrainShadingMs;
+    }
+
+    // When replaying, the recorded tessellation is applied instead
+    if (autoTessellation && !sessionPlayer.isPlaying()) {
+        int next = tessellationController.update(useDeferredShading ? terrainDeferredMs : terrainForwardMs,
+                                                 tessellation);
+        if (next != tessellation) {
+            tessellation = next;
+            terrain.generateMesh(tessellation);
+        }
+    }
 }
 
 bool handleEvents() {
+    OWO_PROFILE_SCOPE("handleEvents");
     // check events (keyboard among other)
     SDL_Event event;
     bool quitEvent = false;
@@ -303,6 +1030,10 @@ bool handleEvents() {
         if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_g) {
             showUI = !showUI;
         }
+        // The camera and light are driven by the session
+        if (sessionPlayer.isPlaying()) {
+            continue;
+        }
         if (event.type == SDL_MOUSEBUTTONDOWN && (!showUI || !ImGui::GetIO().WantCaptureMouse)
             && (event.button.button == SDL_BUTTON_LEFT || event.button.button == SDL_BUTTON_RIGHT)
             && !(g_isMouseDragging || g_isMouseRightDragging)) {
@@ -325,76 +1056,224 @@ bool handleEvents() {
             g_isMouseRightDragging = false;
         }
 
-        if (event.type == SDL_MOUSEMOTION && g_isMouseDragging) {
+        // Motion is handed to the simulation, which applies it at its next step
+        if (event.type == SDL_MOUSEMOTION && (g_isMouseDragging || g_isMouseRightDragging)) {
             // More info at https://wiki.libsdl.org/SDL_MouseMotionEvent
-            float delta_x = (float) event.motion.x - (float) g_prevMouseCoords.x;
-            float delta_y = (float) event.motion.y - (float) g_prevMouseCoords.y;
+            int delta_x = event.motion.x - g_prevMouseCoords.x;
+            int delta_y = event.motion.y - g_prevMouseCoords.y;
             if (g_isMouseDragging) {
-                mat4 yaw = rotate(rotation_speed / 100.f * deltaTime * -delta_x, worldUp);
-                mat4 pitch = rotate(rotation_speed / 100.f * deltaTime * -delta_y,
-                                    normalize(cross(cameraDirection, worldUp)));
-                cameraDirection = vec3(pitch * yaw * vec4(cameraDirection, 0.0f));
-            } else if (g_isMouseRightDragging) {
-                lightRotation += delta_x * 0.01f;
+                simulation.addCameraRotation(delta_x, delta_y);
+            } else {
+                simulation.addLightRotation(delta_x);
             }
             g_prevMouseCoords.x = event.motion.x;
             g_prevMouseCoords.y = event.motion.y;
         }
     }
+    latencyMeter.inputSampled();
+
+    if (sessionPlayer.isPlaying()) {
+        simulation.setKeys(0);
+        simulation.setLightDragging(false);
+        return quitEvent;
+    }
+    simulation.setLightDragging(g_isMouseRightDragging);
 
     // check keyboard state (which keys are still pressed)
     const uint8_t* state = SDL_GetKeyboardState(nullptr);
-    vec3 cameraRight = cross(cameraDirection, worldUp);
-
-    if (state[SDL_SCANCODE_W]) {
-        cameraPosition += cameraSpeed * deltaTime * cameraDirection;
-    }
-    if (state[SDL_SCANCODE_S]) {
-        cameraPosition -= cameraSpeed * deltaTime * cameraDirection;
-    }
-    if (state[SDL_SCANCODE_A]) {
-        cameraPosition -= cameraSpeed * deltaTime * cameraRight;
-    }
-    if (state[SDL_SCANCODE_D]) {
-        cameraPosition += cameraSpeed * deltaTime * cameraRight;
-    }
-    if (state[SDL_SCANCODE_Q]) {
-        cameraPosition -= cameraSpeed * deltaTime * worldUp;
-    }
-    if (state[SDL_SCANCODE_E]) {
-        cameraPosition += cameraSpeed * deltaTime * worldUp;
-    }
+    uint32_t keys = 0;
+    keys |= state[SDL_SCANCODE_W] ? Simulation::KEY_FORWARD : 0;
+    keys |= state[SDL_SCANCODE_S] ? Simulation::KEY_BACKWARD : 0;
+    keys |= state[SDL_SCANCODE_A] ? Simulation::KEY_LEFT : 0;
+    keys |= state[SDL_SCANCODE_D] ? Simulation::KEY_RIGHT : 0;
+    keys |= state[SDL_SCANCODE_Q] ? Simulation::KEY_DOWN : 0;
+    keys |= state[SDL_SCANCODE_E] ? Simulation::KEY_UP : 0;
+    simulation.setKeys(keys);
     return quitEvent;
 }
 
 void gui() {
+    OWO_PROFILE_SCOPE("gui");
     // Inform imgui of new frame
     ImGui_ImplSdlGL3_NewFrame(g_window);
 
     // ----------------- Set variables --------------------------
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate,
                 ImGui::GetIO().Framerate);
+    ImGui::Text("GL state calls: %llu issued, %llu elided", (unsigned long long) glStateCounters.issued,
+                (unsigned long long) glStateCounters.elided);
 
     if (ImGui::CollapsingHeader("Terrain", "terrain_ch", true, true)) {
         ImGui::Checkbox("Mesh triangles only", &onlyTrianglesMesh);
         ImGui::SliderFloat("Mesh height intensity", &meshHeightIntensity, 10.f, 1000.f, "%.0f", 2.f);
         ImGui::SliderFloat("Mesh density intensity", &meshDensityIntensity, 100.f, 2000.f, "%.0f", 2.f);
         ImGui::SliderFloat("Terrain size", &terrainSize, 10.f, 1000.f, "%.0f");
+        ImGui::Checkbox("Fade distant octaves", &fadeDistantOctaves);
         if (ImGui::SliderInt("Tessellation", &tessellation, 2, 2048)) {
             terrain.generateMesh(tessellation);
+            tessellationController.reset();
         }
+        if (ImGui::Checkbox("Automatic tessellation", &autoTessellation)) {
+            tessellationController.reset();
+        }
+        ImGui::SliderFloat("Terrain GPU budget (ms)", &tessellationController.budgetMilliseconds, 0.5f, 20.f, "%.1f");
         if (ImGui::Button("Randomize seed")) {
             randomSeed = (float) (rand() % 1000);
         }
     }
 
+    if (ImGui::CollapsingHeader("Shading", "shading_ch", true, true)) {
+        ImGui::Combo("Terrain quality", &terrainQuality, "Low\0Medium\0High\0");
+        ImGui::Checkbox("Deferred terrain shading", &useDeferredShading);
+        ImGui::Checkbox("Depth pre-pass (forward only)", &useDepthPrePass);
+        ImGui::Text("Terrain GPU time: forward %.3f ms, deferred %.3f ms", terrainForwardMs, terrainDeferredMs);
+    }
+
+    if (ImGui::CollapsingHeader("Resolution", "resolution_ch", true, true)) {
+        if (ImGui::Checkbox("Dynamic resolution", &useDynamicResolution) && !useDynamicResolution) {
+            resolutionScaler.reset();
+        }
+        ImGui::SliderFloat("Target GPU frame time (ms)", &resolutionScaler.targetMilliseconds, 4.f, 50.f, "%.1f");
+        ImGui::SliderFloat("Minimum scale", &resolutionScaler.minScale, 0.25f, 1.f, "%.2f");
+        ImGui::Checkbox("Temporal upsampling", &useTemporalUpsampling);
+        ImGui::SliderFloat("Current frame weight", &temporalCurrentWeight, 0.02f, 1.f, "%.2f");
+        ImGui::Text("GPU frame time %.3f ms, rendering %dx%d (%.0f%%)", frameTimer.lastMilliseconds(), renderWidth,
+                    renderHeight, 100.f * float(renderWidth) / float(windowWidth));
+    }
+
+    if (ImGui::CollapsingHeader("GPU profiler", "profiler_ch", true, false)) {
+        ImGui::Checkbox("Enabled", &gpuProfiler.enabled);
+        ImGui::SameLine();
+        if (ImGui::Button("Reset")) {
+            gpuProfiler.clear();
+        }
+        for (const auto& section : gpuProfiler.sections()) {
+            if (section->historyCount == 0) {
+                ImGui::Text("%s: idle", section->name.c_str());
+                continue;
+            }
+            ImGui::Text("%s: min %.3f ms, avg %.3f ms, max %.3f ms", section->name.c_str(), section->min,
+                        section->avg, section->max);
+            // Oldest measurement first, at 0 until the history is full
+            ImGui::PlotLines(("##" + section->name).c_str(), section->history, section->historyCount,
+                             section->historyNext % section->historyCount, nullptr, 0.f, section->max * 1.2f,
+                             ImVec2(0, 40));
+        }
+    }
+
+    if (ImGui::CollapsingHeader("CPU trace", "cpu_trace_ch", true, false)) {
+        if (ImGui::Checkbox("Record", &cpuTraceEnabled)) {
+            owo::trace::setEnabled(cpuTraceEnabled);
+        }
+        if (ImGui::Button("Save Chrome trace")) {
+            owo::trace::writeChromeTrace(cpuTracePath);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Session", "session_ch", true, false)) {
+        if (sessionRecorder.isRecording()) {
+            ImGui::Text("Recording %s: %d frames", sessionPath.c_str(), (int) sessionRecorder.recordedFrames());
+            if (ImGui::Button("Stop recording")) {
+                sessionRecorder.stop();
+            }
+        } else if (sessionPlayer.isPlaying()) {
+            ImGui::Text("Replaying %s: frame %d / %d", sessionPath.c_str(), (int) sessionPlayer.currentFrame(),
+                        (int) sessionPlayer.frameCount());
+            if (ImGui::Button("Stop replay")) {
+                stopReplay();
+            }
+        } else {
+            if (ImGui::Button("Record")) {
+                sessionRecorder.start(sessionPath, replayParameters);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Replay")) {
+                startReplay(sessionPath, false);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Replay as fast as possible")) {
+                startReplay(sessionPath, true);
+            }
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Debug views", "debug_ch", true, false)) {
+        if (!PipelineStatistics::isSupported()) {
+            ImGui::Text("Pipeline statistics: GL_ARB_pipeline_statistics_query not supported");
+        } else {
+            ImGui::Checkbox("Pipeline statistics", &showPipelineStatistics);
+            if (showPipelineStatistics && pipelineStatistics.hasResult()) {
+                const PipelineStatistics::Values& stats = pipelineStatistics.last();
+                ImGui::Text("Vertices submitted: %llu", (unsigned long long) stats.verticesSubmitted);
+                ImGui::Text("Vertex shader invocations: %llu", (unsigned long long) stats.vertexShaderInvocations);
+                ImGui::Text("Primitives submitted: %llu", (unsigned long long) stats.primitivesSubmitted);
+                ImGui::Text("Clipping primitives: %llu in, %llu out",
+                            (unsigned long long) stats.clippingInputPrimitives,
+                            (unsigned long long) stats.clippingOutputPrimitives);
+                ImGui::Text("Fragment shader invocations: %llu (%.2f per pixel)",
+                            (unsigned long long) stats.fragmentShaderInvocations,
+                            (double) stats.fragmentShaderInvocations / (double) (renderWidth * renderHeight));
+            }
+        }
+        ImGui::Checkbox("Overdraw heat map", &showOverdraw);
+        ImGui::Checkbox("Count depth tested fragments only", &overdrawDepthTested);
+        ImGui::SliderFloat("Overdraw shown in white", &maxOverdraw, 2.f, 32.f, "%.0f");
+    }
+
+    if (ImGui::CollapsingHeader("Render graph", "render_graph_ch", true, false)) {
+        for (const auto& pass : renderGraph.executedPasses()) {
+            ImGui::BulletText("%s", pass.c_str());
+        }
+        for (const auto& pass : renderGraph.culledPasses()) {
+            ImGui::BulletText("%s (culled)", pass.c_str());
+        }
+        ImGui::Text("Pooled render targets: %d", (int) renderTargetPool.size());
+    }
+
+    if (ImGui::CollapsingHeader("Models", "models_ch", true, true)) {
+        ImGui::Combo("Submission", &modelSubmission, "One draw per mesh\0Multi-draw indirect\0Vertex pulling\0");
+        checkModelSubmission();
+        if (modelSubmission == SUBMIT_MULTI_DRAW_INDIRECT && !sphereModel->m_supports_indirect) {
+            ImGui::Text("Not supported, using one draw per mesh");
+        }
+    }
+
     if (ImGui::CollapsingHeader("Camera", "camera_ch", true, true)) {
         ImGui::SliderFloat("Camera rotation speed", &rotation_speed, 0.f, 50.f, "%.0f");
         ImGui::SliderFloat("Camera movement speed", &cameraSpeed, 10.f, 100.f, "%.0f");
+        if (ImGui::Checkbox("Simulation thread", &useSimulationThread)) {
+            if (useSimulationThread) {
+                simulation.startThread();
+            } else {
+                simulation.stopThread();
+            }
+        }
+        ImGui::Text("Simulation: %d steps per second, %llu steps", Simulation::RATE,
+                    (unsigned long long) simulation.stepCount());
+    }
+
+    if (ImGui::CollapsingHeader("Latency", "latency_ch", true, true)) {
+        ImGui::Checkbox("Low-latency mode", &lowLatencyMode);
+        if (lowLatencyMode) {
+            ImGui::SliderInt("Max queued frames", &maxQueuedFrames, 0, FramePacer::MAX_QUEUED_FRAMES);
+            ImGui::SliderFloat("Pacing margin (ms)", &framePacer.marginMs, 0.f, 8.f, "%.1f");
+            ImGui::Text("Refresh: %.2f ms, predicted frame: %.2f ms, slept: %.2f ms",
+                        framePacer.intervalMilliseconds(), framePacer.predictedMilliseconds(),
+                        framePacer.lastSleepMilliseconds());
+        }
+        if (latencyMeter.lastMilliseconds() >= 0.f) {
+            ImGui::Text("Input to present: %.1f ms (average %.1f ms)", latencyMeter.lastMilliseconds(),
+                        latencyMeter.averageMilliseconds());
+        } else {
+            ImGui::Text("Input to present: n/a");
+        }
     }
 
     if (ImGui::CollapsingHeader("Light", "light_ch", true, true)) {
         ImGui::SliderFloat("Environment multiplier", &environment_multiplier, 0.0f, 10.0f);
+        if (ImGui::Combo("Environment format", &environmentFormat, "RGB32F\0RGB9_E5\0R11F_G11F_B10F\0BC6H\0")) {
+            loadEnvironmentMaps();
+        }
         ImGui::ColorEdit3("Point light color", &point_light_color.x);
         ImGui::SliderFloat("Point light intensity multiplier", &point_light_intensity_multiplier, 0.0f,
                            30000.0f, "%.3f", 2.f);
@@ -402,31 +1281,210 @@ void gui() {
     }
 
     if (ImGui::Button("Reload Shaders")) {
-        loadShaders(true);
+        shaderReloader.reloadAll();
+    }
+    ImGui::SameLine();
+    ImGui::Text("Rebuilt when changed (%s)%s", shaderReloader.description().c_str(),
+                shaderReloader.buildingCount() > 0 ? ", building..." : "");
+    if (!shaderReloader.lastError().empty()) {
+        ImGui::TextWrapped("%s", shaderReloader.lastError().c_str());
     }
 
     // ----------------------------------------------------------
     // Render the GUI.
+    gpuProfiler.begin("ImGui");
     ImGui::Render();
+    gpuProfiler.end("ImGui");
+    // ImGui changes and restores the GL state without going through the cache
+    owo::glstate::invalidate();
+}
+
+/**
+ * Render a fixed number of frames offscreen along a scripted camera path, or the frames of the session being
+ * replayed, and write their timings
+ * @return Exit code
+ */
+int runBenchmark() {
+    SDL_Window* hiddenWindow = nullptr;
+    if (!owo::init_offscreen_GL(hiddenWindow)) {
+        std::cout << "Benchmark: cannot create an OpenGL context\n";
+        return 1;
+    }
+
+    windowWidth = BENCHMARK_WIDTH;
+    windowHeight = BENCHMARK_HEIGHT;
+    initGL();
+    benchmarkTarget.resize(windowWidth, windowHeight);
+
+    // Around and over the terrain, looking at its center
+    CameraPath path({vec3(-70.f, 50.f, 70.f), vec3(0.f, 35.f, 90.f), vec3(70.f, 60.f, 60.f),
+                     vec3(90.f, 30.f, -10.f), vec3(40.f, 70.f, -80.f), vec3(-30.f, 40.f, -85.f),
+                     vec3(-90.f, 55.f, 0.f)});
+
+    // A session is measured as recorded, from its first frame
+    bool replaying = sessionPlayer.isPlaying();
+    int frames = replaying ? (int) sessionPlayer.frameCount() : benchmarkFrames;
+    int warmupFrames = replaying ? 0 : BENCHMARK_WARMUP_FRAMES;
+
+    // The GPU times are read back frames later, and paired with their frame once all are done
+    std::vector<float> cpuMilliseconds;
+    // Nothing is presented, so the frames in flight are limited with fences instead
+    GLsync fences[2] = {nullptr, nullptr};
+    for (int frame = -warmupFrames; frame < frames; frame++) {
+        if (frame == 0) {
+            frameTimer.startHistory();
+        }
+        if (replaying) {
+            replayFrame();
+        } else {
+            deltaTime = BENCHMARK_TIME_STEP;
+            float t = float(frame + warmupFrames) / float(frames + warmupFrames);
+            cameraPosition = path.position(t);
+            cameraDirection = normalize(vec3(0.f) - cameraPosition);
+
+            // Only the light moves by itself, in steps of the frame time
+            SimulationState state {cameraPosition, cameraDirection, lightRotation};
+            Simulation::advance(state, SimulationInput {}, {cameraSpeed, rotation_speed, lightManualOnly}, deltaTime);
+            lightRotation = state.lightRotation;
+        }
+        previousTime = currentTime;
+        currentTime += deltaTime;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        display();
+        glFlush();
+        std::chrono::duration<float, std::milli> cpuTime = std::chrono::high_resolution_clock::now() - start;
+
+        GLsync& fence = fences[(frame + warmupFrames) % 2];
+        if (fence != nullptr) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+        }
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        gpuProfiler.endFrame();
+        if (frame >= 0) {
+            cpuMilliseconds.push_back(cpuTime.count());
+        }
+    }
+    for (GLsync fence : fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+        }
+    }
+    glFinish();
+    frameTimer.finish();
+
+    BenchmarkRecorder recorder;
+    const std::vector<float>& gpuMilliseconds = frameTimer.history();
+    for (size_t frame = 0; frame < cpuMilliseconds.size(); frame++) {
+        recorder.addFrame(cpuMilliseconds[frame], frame < gpuMilliseconds.size() ? gpuMilliseconds[frame] : -1.f);
+    }
+
+    bool written = recorder.writeCsv(benchmarkOutput);
+    recorder.printSummary();
+    if (cpuTraceEnabled) {
+        owo::trace::writeChromeTrace(cpuTracePath);
+    }
+
+    destroyGLObjects();
+    owo::freeModel(sphereModel);
+    owo::shutDownOffscreen(hiddenWindow);
+    return written ? 0 : 1;
 }
 
 int main(int argc, char* argv[]) {
-    (void) argc;
-    (void) argv;
+    bool recordSession = false;
+    bool replaySession = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--trace") {
+            cpuTraceEnabled = true;
+        } else if (arg == "--benchmark") {
+            benchmarkMode = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            benchmarkFrames = max(1, atoi(argv[++i]));
+        } else if (arg == "--output" && i + 1 < argc) {
+            benchmarkOutput = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            sessionPath = argv[++i];
+            recordSession = true;
+        } else if ((arg == "--replay" || arg == "--replay-fast") && i + 1 < argc) {
+            sessionPath = argv[++i];
+            replaySession = true;
+            replayFast = arg == "--replay-fast";
+        } else if (arg == "--low-latency") {
+            lowLatencyMode = true;
+        } else if (arg == "--no-program-cache") {
+            useProgramCache = false;
+        } else if (arg == "--no-texture-cache") {
+            useTextureCache = false;
+        } else if (arg == "--environment-format" && i + 1 < argc) {
+            owo::HdrFormat format;
+            if (owo::parseHdrFormat(argv[++i], format)) {
+                environmentFormat = format;
+            } else {
+                std::cout << "Unknown environment format " << argv[i] << ", keeping "
+                          << owo::hdrFormatOption((owo::HdrFormat) environmentFormat) << "\n";
+            }
+        }
+    }
+    owo::setProgramBinaryCache(useProgramCache ? programCacheDirectory : "");
+    owo::setHdrTextureCache(useTextureCache ? textureCacheDirectory : "");
+    owo::trace::setEnabled(cpuTraceEnabled);
+    registerReplayParameters();
+
+    if (benchmarkMode) {
+        if (replaySession) {
+            replayFast = true;
+            if (!sessionPlayer.open(sessionPath, replayParameters)) {
+                return 1;
+            }
+        }
+        return runBenchmark();
+    }
 
     g_window = owo::init_window_SDL("OpenGL Project");
 
     initGL();
+    shaderReloader.start(g_window);
+
+    SDL_DisplayMode displayMode;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(g_window), &displayMode) == 0) {
+        framePacer.setRefreshRate(displayMode.refresh_rate);
+    }
+
+    if (replaySession) {
+        startReplay(sessionPath, replayFast);
+    } else if (recordSession) {
+        sessionRecorder.start(sessionPath, replayParameters);
+    }
+    if (useSimulationThread) {
+        simulation.startThread();
+    }
 
     bool stopRendering = false;
     auto startTime = std::chrono::system_clock::now();
 
     while (!stopRendering) {
+        if (lowLatencyMode) {
+            framePacer.waitForFrameStart();
+        }
+
         //update currentTime
         std::chrono::duration<float> timeSinceStart = std::chrono::system_clock::now() - startTime;
         previousTime = currentTime;
         currentTime = timeSinceStart.count();
         deltaTime = currentTime - previousTime;
+
+        // Programs rebuilt since the previous frame
+        shaderReloader.update();
+
+        // Latched by display() in low-latency mode
+        if (!lowLatencyMode) {
+            latchFrameState();
+        }
+
         // render to window
         display();
 
@@ -435,13 +1493,34 @@ int main(int argc, char* argv[]) {
             gui();
         }
 
+        gpuProfiler.endFrame();
+
         // Swap front and back buffer. This frame will now been displayed.
-        SDL_GL_SwapWindow(g_window);
+        if (lowLatencyMode) {
+            framePacer.beforeSwap();
+        }
+        {
+            OWO_PROFILE_SCOPE("SDL_GL_SwapWindow");
+            SDL_GL_SwapWindow(g_window);
+        }
+        if (lowLatencyMode) {
+            framePacer.afterSwap(maxQueuedFrames);
+        }
+        // The interpolated simulation is one step behind the input, the latched one is not
+        latencyMeter.presented(lowLatencyMode ? 0.f : 1000.f / (float) Simulation::RATE);
 
         // check events (keyboard among other)
-        stopRendering = handleEvents();
+        stopRendering = handleEvents() || quitRequested;
+    }
+    simulation.stopThread();
+    shaderReloader.stop();
+    sessionRecorder.stop();
+    if (cpuTraceEnabled) {
+        owo::trace::writeChromeTrace(cpuTracePath);
     }
+
     // Free Models
+    destroyGLObjects();
     owo::freeModel(sphereModel);
 
     // Shut down everything. This includes the window and all other subsystems.
@@ -0,0 +1,229 @@
+#include "noise.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OWO_NOISE_SSE2
+#include <emmintrin.h>
+#endif
+
+using glm::vec2;
+using glm::vec3;
+
+namespace {
+    // Same constants as the shader, rounded to float the same way
+    const float K = 0.142857142857f;  // 1/7
+    const float KO = 0.428571428571f; // 3/7
+    const float INV_289 = 1.f / 289.f;
+    const float INV_7 = 1.f / 7.f;
+
+    inline vec3 mod289(vec3 x) {
+        return x - glm::floor(x * INV_289) * 289.f;
+    }
+
+    inline vec2 mod289(vec2 x) {
+        return x - glm::floor(x * INV_289) * 289.f;
+    }
+
+    inline vec3 mod7(vec3 x) {
+        return x - glm::floor(x * INV_7) * 7.f;
+    }
+
+    inline vec3 permute(vec3 x) {
+        return mod289((34.f * x + 10.f) * x);
+    }
+
+    inline vec3 fract(vec3 x) {
+        return x - glm::floor(x);
+    }
+
+    /**
+     * Squared distances to the feature points of a column of the 3x3 window
+     * @param px Permuted x of the column
+     * @param offset Offset from the column to the position along x
+     */
+    inline vec3 columnDistances(float px, float offset, vec2 Pi, vec2 Pf) {
+        const vec3 oi(-1.f, 0.f, 1.f);
+        const vec3 of(-0.5f, 0.5f, 1.5f);
+        vec3 p = permute(px + Pi.y + oi);
+        vec3 ox = fract(p * K) - KO;
+        vec3 oy = mod7(glm::floor(p * K)) * K - KO;
+        vec3 dx = Pf.x + offset + ox;
+        vec3 dy = Pf.y - of + oy;
+        return dx * dx + dy * dy;
+    }
+}
+
+vec2 cellularNoise(vec2 P) noexcept {
+    vec2 Pi = mod289(glm::floor(P));
+    vec2 Pf = P - glm::floor(P);
+    vec3 px = permute(Pi.x + vec3(-1.f, 0.f, 1.f));
+    vec3 d1 = columnDistances(px.x, 0.5f, Pi, Pf);
+    vec3 d2 = columnDistances(px.y, -0.5f, Pi, Pf);
+    vec3 d3 = columnDistances(px.z, -1.5f, Pi, Pf);
+
+    // The two smallest of the 9 distances, as selected by the shader
+    float f1 = d1.x;
+    float f2 = INFINITY;
+    for (float d : {d1.y, d1.z, d2.x, d2.y, d2.z, d3.x, d3.y, d3.z}) {
+        f2 = glm::min(f2, glm::max(f1, d));
+        f1 = glm::min(f1, d);
+    }
+    return glm::sqrt(vec2(f1, f2));
+}
+
+#ifdef OWO_NOISE_SSE2
+namespace {
+    // Exact for |x| < 2^31, which positions of the terrain are far from
+    inline __m128 floor4(__m128 x) {
+        __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.f)));
+    }
+
+    inline __m128 mod4(__m128 x, float inverse, float modulus) {
+        return _mm_sub_ps(x, _mm_mul_ps(floor4(_mm_mul_ps(x, _mm_set1_ps(inverse))), _mm_set1_ps(modulus)));
+    }
+
+    inline __m128 permute4(__m128 x) {
+        __m128 polynomial = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(34.f), x), _mm_set1_ps(10.f)), x);
+        return mod4(polynomial, INV_289, 289.f);
+    }
+
+    /**
+     * 4 positions, each step as in the scalar version
+     */
+    inline void cellularNoise4(const float* x, const float* y, float* f1Out, float* f2Out) {
+        __m128 Px = _mm_loadu_ps(x);
+        __m128 Py = _mm_loadu_ps(y);
+        __m128 floorX = floor4(Px);
+        __m128 floorY = floor4(Py);
+        __m128 Pix = mod4(floorX, INV_289, 289.f);
+        __m128 Piy = mod4(floorY, INV_289, 289.f);
+        __m128 Pfx = _mm_sub_ps(Px, floorX);
+        __m128 Pfy = _mm_sub_ps(Py, floorY);
+
+        const float oi[3] = {-1.f, 0.f, 1.f};
+        const float of[3] = {-0.5f, 0.5f, 1.5f};
+        const float offsets[3] = {0.5f, -0.5f, -1.5f};
+        __m128 k = _mm_set1_ps(K);
+        __m128 ko = _mm_set1_ps(KO);
+
+        __m128 f1 = _mm_set1_ps(INFINITY);
+        __m128 f2 = _mm_set1_ps(INFINITY);
+        for (int column = 0; column < 3; column++) {
+            __m128 px = permute4(_mm_add_ps(Pix, _mm_set1_ps(oi[column])));
+            __m128 dx0 = _mm_add_ps(Pfx, _mm_set1_ps(offsets[column]));
+            __m128 pxy = _mm_add_ps(px, Piy);
+            for (int row = 0; row < 3; row++) {
+                __m128 p = permute4(_mm_add_ps(pxy, _mm_set1_ps(oi[row])));
+                __m128 pk = _mm_mul_ps(p, k);
+                __m128 floorPk = floor4(pk);
+                __m128 ox = _mm_sub_ps(_mm_sub_ps(pk, floorPk), ko);
+                __m128 oy = _mm_sub_ps(_mm_mul_ps(mod4(floorPk, INV_7, 7.f), k), ko);
+                __m128 dx = _mm_add_ps(dx0, ox);
+                __m128 dy = _mm_add_ps(_mm_sub_ps(Pfy, _mm_set1_ps(of[row])), oy);
+                __m128 d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+                f2 = _mm_min_ps(f2, _mm_max_ps(f1, d));
+                f1 = _mm_min_ps(f1, d);
+            }
+        }
+        _mm_storeu_ps(f1Out, _mm_sqrt_ps(f1));
+        _mm_storeu_ps(f2Out, _mm_sqrt_ps(f2));
+    }
+}
+#endif
+
+void cellularNoise(const float* x, const float* y, float* f1, float* f2, size_t count) noexcept {
+    size_t i = 0;
+#ifdef OWO_NOISE_SSE2
+    for (; i + 4 <= count; i += 4) {
+        cellularNoise4(x + i, y + i, f1 + i, f2 + i);
+    }
+#endif
+    for (; i < count; i++) {
+        vec2 f = cellularNoise(vec2(x[i], y[i]));
+        f1[i] = f.x;
+        f2[i] = f.y;
+    }
+}
+
+bool cellularNoiseUsesSimd() noexcept {
+#ifdef OWO_NOISE_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
+
+namespace {
+    // Octaves of the terrain height, as in shader/heightfield.vert
+    const int TERRAIN_OCTAVES = 10;
+    const float OCTAVE_FREQUENCIES[TERRAIN_OCTAVES] = {
+        1.f / 16.f, 1.f / 8.f, 1.f / 4.f, 1.f / 2.f, 1.f, 2.f, 4.f, 8.f, 16.f, 32.f
+    };
+    const float OCTAVE_AMPLITUDES[TERRAIN_OCTAVES] = {
+        16.f, 8.f, 4.f, 2.f, 1.f, 1.f / 2.f, 1.f / 4.f, 1.f / 8.f, 1.f / 16.f, 1.f / 16.f
+    };
+    const float OCTAVE_FADE_START = 0.25f;
+    const float OCTAVE_FADE_END = 0.5f;
+}
+
+float terrainOctaveWeight(float frequency, float footprint) noexcept {
+    return 1.f - glm::smoothstep(OCTAVE_FADE_START, OCTAVE_FADE_END, frequency * footprint);
+}
+
+vec2 terrainNoise(vec2 P, float density, vec2 seed, float footprint) noexcept {
+    // The largest octave is always kept
+    vec2 sum = cellularNoise(P * (density * OCTAVE_FREQUENCIES[0]) + seed) * OCTAVE_AMPLITUDES[0];
+    for (int octave = 1; octave < TERRAIN_OCTAVES; octave++) {
+        float frequency = density * OCTAVE_FREQUENCIES[octave];
+        float weight = terrainOctaveWeight(frequency, footprint);
+        if (weight > 0.f) {
+            sum += cellularNoise(P * frequency + seed) * (OCTAVE_AMPLITUDES[octave] * weight);
+        }
+    }
+    return sum;
+}
+
+size_t terrainNoise(const float* x, const float* z, const float* footprints, size_t count, float density,
+                    vec2 seed, float* sumX, float* sumY) {
+    std::fill(sumX, sumX + count, 0.f);
+    std::fill(sumY, sumY + count, 0.f);
+
+    // Positions where the octave is evaluated, packed so that they are processed 4 at a time
+    std::vector<size_t> indices(count);
+    std::vector<float> weights(count), px(count), py(count), f1(count), f2(count);
+    size_t evaluated = 0;
+    for (int octave = 0; octave < TERRAIN_OCTAVES; octave++) {
+        float frequency = density * OCTAVE_FREQUENCIES[octave];
+        size_t packed = 0;
+        for (size_t i = 0; i < count; i++) {
+            float weight = octave == 0 ? 1.f : terrainOctaveWeight(frequency, footprints[i]);
+            if (weight > 0.f) {
+                indices[packed] = i;
+                weights[packed] = weight;
+                px[packed] = x[i] * frequency + seed.x;
+                py[packed] = z[i] * frequency + seed.y;
+                packed++;
+            }
+        }
+        if (packed == 0) {
+            // Higher octaves are faded out wherever this one is
+            break;
+        }
+
+        cellularNoise(px.data(), py.data(), f1.data(), f2.data(), packed);
+        float amplitude = OCTAVE_AMPLITUDES[octave];
+        for (size_t i = 0; i < packed; i++) {
+            // Scaled as vec2 * float in the scalar version, the first octave having no weight
+            float scale = octave == 0 ? amplitude : amplitude * weights[i];
+            sumX[indices[i]] += f1[i] * scale;
+            sumY[indices[i]] += f2[i] * scale;
+        }
+        evaluated += packed;
+    }
+    return evaluated;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/**
+ * Cellular noise of shader/noise.glsl on the CPU, returning the distances to the closest and second closest feature
+ * points (F1, F2). It follows the shader operation for operation, so that CPU and GPU terrains can be compared.
+ * @param P Position, already offset by the seed
+ */
+glm::vec2 cellularNoise(glm::vec2 P) noexcept;
+
+/**
+ * Cellular noise of several positions, 4 at a time with SSE2 when available. Results are bit-identical to the scalar
+ * cellularNoise().
+ * @param x X coordinates of the positions
+ * @param y Y coordinates of the positions
+ * @param f1 Distances to the closest feature points
+ * @param f2 Distances to the second closest feature points
+ */
+void cellularNoise(const float* x, const float* y, float* f1, float* f2, size_t count) noexcept;
+
+/**
+ * @return True if cellularNoise() of several positions uses SSE2
+ */
+bool cellularNoiseUsesSimd() noexcept;
+
+/**
+ * Weight of an octave of the terrain height, as in shader/heightfield.vert: 1 while its cells span more than 4 pixels,
+ * fading to 0 as they shrink to 2 pixels
+ * @param frequency Frequency of the octave, in cells per unit of the noise positions
+ * @param footprint Size of a pixel at the position, in units of the noise positions, 0 to keep all the octaves
+ */
+float terrainOctaveWeight(float frequency, float footprint) noexcept;
+
+/**
+ * Sum of the octaves of the terrain height of shader/heightfield.vert, whose direction is the height. Octaves faded
+ * out at the footprint are not evaluated.
+ * @param P Position on the terrain, in model space
+ * @param density Density of the largest octave times 16, densityIntensity / 50 in the shader
+ * @param seed Offset of the noise positions
+ * @param footprint Size of a pixel at the position, in units of the noise positions, 0 to keep all the octaves
+ */
+glm::vec2 terrainNoise(glm::vec2 P, float density, glm::vec2 seed, float footprint) noexcept;
+
+/**
+ * Octave sums of several positions, each octave being evaluated only at the positions where it is not faded out,
+ * 4 at a time with SSE2 when available. Results are bit-identical to the scalar terrainNoise().
+ * @param x X coordinates of the positions, in model space
+ * @param z Z coordinates of the positions, in model space
+ * @param footprints Size of a pixel at each position
+ * @param sumX First components of the sums
+ * @param sumY Second components of the sums
+ * @return Number of octaves evaluated over all the positions
+ */
+size_t terrainNoise(const float* x, const float* z, const float* footprints, size_t count, float density,
+                    glm::vec2 seed, float* sumX, float* sumY);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/**
+ * Call a function on ranges [begin, end[ of the rows of an image, split between threads, the calling one included.
+ * Images of fewer than two ranges of minRows rows stay on the calling thread.
+ * @param minRows Rows of a range, at least
+ */
+template <typename Function>
+void parallelRows(int rows, int minRows, Function function) {
+    int threadCount = (int) std::max(std::thread::hardware_concurrency(), 1u);
+    threadCount = std::max(std::min(threadCount, rows / std::max(minRows, 1)), 1);
+    int rowsPerThread = (rows + threadCount - 1) / threadCount;
+
+    std::vector<std::thread> threads;
+    for (int begin = rowsPerThread; begin < rows; begin += rowsPerThread) {
+        threads.emplace_back(function, begin, std::min(begin + rowsPerThread, rows));
+    }
+    function(0, std::min(rowsPerThread, rows));
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,83 @@
+#include "pipelinestats.hpp"
+
+namespace {
+    // Same order as the fields of PipelineStatistics::Values
+    const GLenum TARGETS[PipelineStatistics::COUNTERS] = {
+        GL_VERTICES_SUBMITTED_ARB,
+        GL_PRIMITIVES_SUBMITTED_ARB,
+        GL_VERTEX_SHADER_INVOCATIONS_ARB,
+        GL_CLIPPING_INPUT_PRIMITIVES_ARB,
+        GL_CLIPPING_OUTPUT_PRIMITIVES_ARB,
+        GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+    };
+}
+
+PipelineStatistics::~PipelineStatistics() {
+    this->destroy();
+}
+
+void PipelineStatistics::destroy() noexcept {
+    if (this->queries[0][0] != 0) {
+        glDeleteQueries(LATENCY * COUNTERS, &this->queries[0][0]);
+    }
+    for (int i = 0; i < LATENCY; i++) {
+        for (int counter = 0; counter < COUNTERS; counter++) {
+            this->queries[i][counter] = 0;
+        }
+        this->pending[i] = false;
+    }
+}
+
+bool PipelineStatistics::isSupported() {
+    return GLEW_ARB_pipeline_statistics_query;
+}
+
+void PipelineStatistics::begin() noexcept {
+    if (this->queries[0][0] == 0) {
+        glGenQueries(LATENCY * COUNTERS, &this->queries[0][0]);
+    }
+
+    this->collect();
+
+    // The oldest set is still in flight: drop its result rather than waiting for it
+    this->pending[this->current] = false;
+    for (int i = 0; i < COUNTERS; i++) {
+        glBeginQuery(TARGETS[i], this->queries[this->current][i]);
+    }
+}
+
+void PipelineStatistics::end() noexcept {
+    for (int i = 0; i < COUNTERS; i++) {
+        glEndQuery(TARGETS[i]);
+    }
+    this->pending[this->current] = true;
+    this->current = (this->current + 1) % LATENCY;
+}
+
+void PipelineStatistics::collect() noexcept {
+    // Oldest set first, so that the latest result wins
+    for (int i = 0; i < LATENCY; i++) {
+        int slot = (this->current + i) % LATENCY;
+        if (!this->pending[slot]) {
+            continue;
+        }
+
+        bool ready = true;
+        for (int j = 0; j < COUNTERS && ready; j++) {
+            GLint available = 0;
+            glGetQueryObjectiv(this->queries[slot][j], GL_QUERY_RESULT_AVAILABLE, &available);
+            ready = available != 0;
+        }
+        if (!ready) {
+            continue;
+        }
+
+        GLuint64 values[COUNTERS];
+        for (int j = 0; j < COUNTERS; j++) {
+            glGetQueryObjectui64v(this->queries[slot][j], GL_QUERY_RESULT, &values[j]);
+        }
+        this->lastValues = {values[0], values[1], values[2], values[3], values[4], values[5]};
+        this->available = true;
+        this->pending[slot] = false;
+    }
+}
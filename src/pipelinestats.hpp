@@ -0,0 +1,106 @@
+#pragma once
+
+#include <GL/glew.h>
+
+/**
+ * Pipeline statistics of the frame, from GL_ARB_pipeline_statistics_query.
+ * As with GpuTimer, several query sets are used in turn and read back a few frames later without waiting.
+ */
+class PipelineStatistics {
+public:
+    /**
+     * Counters of a measurement
+     */
+    struct Values {
+        GLuint64 verticesSubmitted;
+        GLuint64 primitivesSubmitted;
+        GLuint64 vertexShaderInvocations;
+        GLuint64 clippingInputPrimitives;
+        GLuint64 clippingOutputPrimitives;
+        GLuint64 fragmentShaderInvocations;
+    };
+
+    /**
+     * Default constructor, queries are created on first use
+     */
+    PipelineStatistics() = default;
+
+    PipelineStatistics(const PipelineStatistics&) = delete;
+    PipelineStatistics& operator=(const PipelineStatistics&) = delete;
+
+    /**
+     * Destructor
+     */
+    ~PipelineStatistics();
+
+    /**
+     * Delete the queries while the context exists, they are created again on the next begin()
+     */
+    void destroy() noexcept;
+
+    /**
+     * @return True if the extension is available
+     */
+    static bool isSupported();
+
+    /**
+     * Start counting, at most once per frame and not nested
+     */
+    void begin() noexcept;
+
+    /**
+     * Stop counting
+     */
+    void end() noexcept;
+
+    /**
+     * @return Latest available counters
+     */
+    const Values& last() const noexcept {
+        return this->lastValues;
+    }
+
+    /**
+     * @return True if a measurement was read back
+     */
+    bool hasResult() const noexcept {
+        return this->available;
+    }
+
+    /**
+     * Number of query sets in flight
+     */
+    static const int LATENCY = 3;
+
+    /**
+     * Number of counters
+     */
+    static const int COUNTERS = 6;
+
+private:
+    /**
+     * Read back the results that are available, without waiting
+     */
+    void collect() noexcept;
+
+    /**
+     * One query per counter and per slot
+     */
+    GLuint queries[LATENCY][COUNTERS] {};
+
+    /**
+     * Whether a query set was issued and its result not read yet
+     */
+    bool pending[LATENCY] {};
+
+    /**
+     * Query set used by the current measurement
+     */
+    int current {0};
+
+    /**
+     * Latest counters read back
+     */
+    Values lastValues {};
+    bool available {false};
+};
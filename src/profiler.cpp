@@ -0,0 +1,76 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+
+void GpuProfiler::begin(const std::string& name) {
+    if (!this->enabled) {
+        return;
+    }
+    Section& s = this->section(name);
+    s.timer.begin();
+    s.active = true;
+}
+
+void GpuProfiler::end(const std::string& name) {
+    if (!this->enabled) {
+        return;
+    }
+    this->section(name).timer.end();
+}
+
+void GpuProfiler::endFrame() {
+    for (auto& s : this->allSections) {
+        bool active = s->active;
+        s->active = false;
+
+        // Results come a few frames late, so they are only recorded when new
+        if (s->timer.resultCount() == s->lastResult) {
+            if (!active) {
+                // Starts over when the section runs again, the history being history[0..historyCount)
+                s->historyCount = 0;
+                s->historyNext = 0;
+            }
+            continue;
+        }
+        s->lastResult = s->timer.resultCount();
+
+        s->history[s->historyNext] = s->timer.lastMilliseconds();
+        s->historyNext = (s->historyNext + 1) % HISTORY_SIZE;
+        s->historyCount = std::min(s->historyCount + 1, HISTORY_SIZE);
+
+        s->min = s->history[0];
+        s->max = s->history[0];
+        float sum = 0.f;
+        for (int i = 0; i < s->historyCount; i++) {
+            s->min = std::min(s->min, s->history[i]);
+            s->max = std::max(s->max, s->history[i]);
+            sum += s->history[i];
+        }
+        s->avg = sum / (float) s->historyCount;
+    }
+}
+
+void GpuProfiler::clear() noexcept {
+    for (auto& s : this->allSections) {
+        s->historyCount = 0;
+        s->historyNext = 0;
+        s->min = s->avg = s->max = 0.f;
+    }
+}
+
+void GpuProfiler::destroy() noexcept {
+    for (auto& s : this->allSections) {
+        s->timer.destroy();
+    }
+}
+
+GpuProfiler::Section& GpuProfiler::section(const std::string& name) {
+    for (auto& s : this->allSections) {
+        if (s->name == name) {
+            return *s;
+        }
+    }
+    this->allSections.emplace_back(new Section());
+    this->allSections.back()->name = name;
+    return *this->allSections.back();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gputimer.hpp"
+
+/**
+ * GPU profiler, timing named sections of the frame with one GpuTimer each and keeping a short history of their
+ * measurements, along with its minimum, average and maximum.
+ */
+class GpuProfiler {
+public:
+    /**
+     * Number of measurements kept per section
+     */
+    static const int HISTORY_SIZE = 120;
+
+    /**
+     * Timed section of the frame
+     */
+    struct Section {
+        std::string name;
+        GpuTimer timer;
+        // Ring buffer of the latest measurements, in milliseconds. The valid ones are history[0..historyCount),
+        // the oldest being at historyNext once it is full.
+        float history[HISTORY_SIZE] {};
+        int historyCount {0};
+        int historyNext {0};
+        unsigned lastResult {0};
+        // Statistics over the history
+        float min {0.f};
+        float avg {0.f};
+        float max {0.f};
+        // Whether the section ran during the last frame
+        bool active {false};
+    };
+
+    /**
+     * Start timing a section, at most once per frame
+     */
+    void begin(const std::string& name);
+
+    /**
+     * Stop timing a section
+     */
+    void end(const std::string& name);
+
+    /**
+     * Record the measurements available into the histories, once per frame
+     */
+    void endFrame();
+
+    /**
+     * Forget all the measurements
+     */
+    void clear() noexcept;
+
+    /**
+     * Delete the queries of the sections while the context exists
+     */
+    void destroy() noexcept;
+
+    /**
+     * @return Sections, in order of first appearance
+     */
+    const std::vector<std::unique_ptr<Section>>& sections() const noexcept {
+        return this->allSections;
+    }
+
+    /**
+     * Whether sections are timed, begin() and end() do nothing otherwise
+     */
+    bool enabled {true};
+
+private:
+    /**
+     * @return Section of a name, created if needed
+     */
+    Section& section(const std::string& name);
+
+    std::vector<std::unique_ptr<Section>> allSections;
+};
@@ -0,0 +1,288 @@
+#include "radiance.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <Trace.hpp>
+#include "parallel.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OWO_RADIANCE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace owo {
+    namespace {
+        // Scanlines decoded by a thread, at least
+        const int ROWS_PER_THREAD = 16;
+
+        /**
+         * RGBE texel to floats, as stbi__hdr_convert()
+         */
+        inline void convertRgbe(const unsigned char* rgbe, float* rgb) {
+            if (rgbe[3] != 0) {
+                float scale = (float) ldexp(1.0f, rgbe[3] - (int) (128 + 8));
+                rgb[0] = rgbe[0] * scale;
+                rgb[1] = rgbe[1] * scale;
+                rgb[2] = rgbe[2] * scale;
+            } else {
+                rgb[0] = rgb[1] = rgb[2] = 0.f;
+            }
+        }
+
+#ifdef OWO_RADIANCE_SSE2
+        /**
+         * 4 RGBE texels to floats. 2^(e - 136) is denormal for exponents below 10, whose mantissas are scaled in two
+         * steps instead: by 2^(e - 72), which is exact, then by 2^-64, which rounds once as the product of the
+         * scalar version does.
+         */
+        inline void convertRgbe4(const unsigned char* rgbe, float* rgb) {
+            __m128i texels = _mm_loadu_si128((const __m128i*) rgbe);
+            __m128i byte = _mm_set1_epi32(0xff);
+            __m128 r = _mm_cvtepi32_ps(_mm_and_si128(texels, byte));
+            __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, 8), byte));
+            __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, 16), byte));
+            __m128i exponent = _mm_srli_epi32(texels, 24);
+
+            __m128i small = _mm_cmplt_epi32(exponent, _mm_set1_epi32(10));
+            __m128i bias = _mm_or_si128(_mm_and_si128(small, _mm_set1_epi32(127 - 72)),
+                                        _mm_andnot_si128(small, _mm_set1_epi32(127 - 136)));
+            __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(exponent, bias), 23));
+            // A zero exponent is black whatever the mantissas
+            scale = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(exponent, _mm_setzero_si128())), scale);
+            // 2^-64 or 1
+            __m128 last = _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(small), _mm_set1_ps(5.42101086e-20f)),
+                                    _mm_andnot_ps(_mm_castsi128_ps(small), _mm_set1_ps(1.f)));
+            r = _mm_mul_ps(_mm_mul_ps(r, scale), last);
+            g = _mm_mul_ps(_mm_mul_ps(g, scale), last);
+            b = _mm_mul_ps(_mm_mul_ps(b, scale), last);
+
+            // Interleaved: r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3
+            __m128 rgLow = _mm_unpacklo_ps(r, g);
+            __m128 rgHigh = _mm_unpackhi_ps(r, g);
+            __m128 b0r1 = _mm_shuffle_ps(b, r, _MM_SHUFFLE(1, 1, 0, 0));
+            __m128 g1b1 = _mm_shuffle_ps(g, b, _MM_SHUFFLE(1, 1, 1, 1));
+            __m128 b2r3 = _mm_shuffle_ps(b, rgHigh, _MM_SHUFFLE(2, 2, 2, 2));
+            __m128 g3b3 = _mm_shuffle_ps(rgHigh, b, _MM_SHUFFLE(3, 3, 3, 3));
+            _mm_storeu_ps(rgb, _mm_shuffle_ps(rgLow, b0r1, _MM_SHUFFLE(2, 0, 1, 0)));
+            _mm_storeu_ps(rgb + 4, _mm_shuffle_ps(g1b1, rgHigh, _MM_SHUFFLE(1, 0, 2, 0)));
+            _mm_storeu_ps(rgb + 8, _mm_shuffle_ps(b2r3, g3b3, _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+#endif
+
+        void convertScanline(const unsigned char* rgbe, int width, float* rgb) {
+            int i = 0;
+#ifdef OWO_RADIANCE_SSE2
+            for (; i + 4 <= width; i += 4) {
+                convertRgbe4(rgbe + 4 * i, rgb + 3 * i);
+            }
+#endif
+            for (; i < width; i++) {
+                convertRgbe(rgbe + 4 * i, rgb + 3 * i);
+            }
+        }
+
+        /**
+         * Read a line of the header, without its newline
+         * @return False at the end of the data
+         */
+        bool readLine(const unsigned char* bytes, size_t size, size_t& position, std::string& line) {
+            if (position >= size) {
+                return false;
+            }
+            const unsigned char* end = (const unsigned char*) memchr(bytes + position, '\n', size - position);
+            size_t length = end != nullptr ? (size_t) (end - bytes) - position : size - position;
+            line.assign((const char*) bytes + position, length);
+            // Past the newline, if the last line has one
+            position = std::min(position + length + 1, size);
+            return true;
+        }
+
+        /**
+         * Find where each run-length encoded scanline starts, checking their runs, so that they can be decoded
+         * independently
+         * @param offsets Set to the offset of each scanline, and to the end of the last one
+         * @return False if the data is corrupt, or not encoded this way from the second scanline on
+         */
+        bool indexScanlines(const unsigned char* bytes, size_t size, size_t position, int width, int height,
+                            std::vector<size_t>& offsets, std::string& error) {
+            offsets.resize((size_t) height + 1);
+            for (int y = 0; y < height; y++) {
+                offsets[y] = position;
+                if (position + 4 > size) {
+                    error = "truncated data";
+                    return false;
+                }
+                const unsigned char* header = bytes + position;
+                if (header[0] != 2 || header[1] != 2 || (header[2] & 0x80) != 0) {
+                    error = "scanline " + std::to_string(y) + " is not run-length encoded";
+                    return false;
+                }
+                if ((header[2] << 8 | header[3]) != width) {
+                    error = "invalid decoded scanline length";
+                    return false;
+                }
+                position += 4;
+
+                for (int channel = 0; channel < 4; channel++) {
+                    for (int x = 0; x < width;) {
+                        if (position >= size) {
+                            error = "truncated data";
+                            return false;
+                        }
+                        int count = bytes[position++];
+                        bool run = count > 128;
+                        count = run ? count - 128 : count;
+                        if (count == 0 || count > width - x) {
+                            error = "bad RLE data";
+                            return false;
+                        }
+                        position += run ? 1 : (size_t) count;
+                        x += count;
+                    }
+                }
+            }
+            if (position > size) {
+                error = "truncated data";
+                return false;
+            }
+            offsets[height] = position;
+            return true;
+        }
+
+        /**
+         * Decode a scanline checked by indexScanlines() to interleaved RGBE
+         */
+        void decodeScanline(const unsigned char* data, int width, unsigned char* rgbe) {
+            // Skips the 4 bytes of the header
+            data += 4;
+            for (int channel = 0; channel < 4; channel++) {
+                for (int x = 0; x < width;) {
+                    int count = *data++;
+                    if (count > 128) {
+                        count -= 128;
+                        unsigned char value = *data++;
+                        for (int i = 0; i < count; i++) {
+                            rgbe[4 * (x + i) + channel] = value;
+                        }
+                    } else {
+                        for (int i = 0; i < count; i++) {
+                            rgbe[4 * (x + i) + channel] = data[i];
+                        }
+                        data += count;
+                    }
+                    x += count;
+                }
+            }
+        }
+    }
+
+    bool decodeRadianceImage(const unsigned char* bytes, size_t size, RadianceImage& image, std::string& error) {
+        OWO_PROFILE_SCOPE("decodeRadianceImage");
+        size_t position = 0;
+        std::string line;
+        if (!readLine(bytes, size, position, line) || (line != "#?RADIANCE" && line != "#?RGBE")) {
+            error = "not a Radiance .hdr file";
+            return false;
+        }
+        bool rgbe = false;
+        while (readLine(bytes, size, position, line) && !line.empty()) {
+            rgbe = rgbe || line == "FORMAT=32-bit_rle_rgbe";
+        }
+        if (!rgbe) {
+            error = "unsupported format, only 32-bit_rle_rgbe is";
+            return false;
+        }
+
+        // Only the orientation of most files is supported, as by stbi
+        if (!readLine(bytes, size, position, line)) {
+            error = "truncated header";
+            return false;
+        }
+        const char* token = line.c_str();
+        if (strncmp(token, "-Y ", 3) != 0) {
+            error = "unsupported orientation " + line;
+            return false;
+        }
+        char* end;
+        long height = strtol(token + 3, &end, 10);
+        while (*end == ' ') {
+            end++;
+        }
+        if (strncmp(end, "+X ", 3) != 0) {
+            error = "unsupported orientation " + line;
+            return false;
+        }
+        long width = strtol(end + 3, nullptr, 10);
+        if (width <= 0 || height <= 0 || width > (1 << 24) || height > (1 << 24)
+            || (unsigned long long) width * (unsigned long long) height > (1ull << 28)) {
+            error = "invalid size " + line;
+            return false;
+        }
+
+        image.width = (int) width;
+        image.height = (int) height;
+        image.data.resize((size_t) width * height * 3);
+        float* output = image.data.data();
+
+        // Files are run-length encoded but for very narrow or wide images, or when the first scanline is flat
+        const unsigned char* data = bytes + position;
+        bool encoded = width >= 8 && width < 32768 && position + 3 <= size
+                       && data[0] == 2 && data[1] == 2 && (data[2] & 0x80) == 0;
+        if (!encoded) {
+            if (size - position < (size_t) width * height * 4) {
+                error = "truncated data";
+                return false;
+            }
+            parallelRows(image.height, ROWS_PER_THREAD, [&](int begin, int end) {
+                for (int y = begin; y < end; y++) {
+                    convertScanline(data + (size_t) y * width * 4, image.width, output + (size_t) y * width * 3);
+                }
+            });
+            return true;
+        }
+
+        std::vector<size_t> offsets;
+        if (!indexScanlines(bytes, size, position, image.width, image.height, offsets, error)) {
+            return false;
+        }
+        parallelRows(image.height, ROWS_PER_THREAD, [&](int begin, int end) {
+            std::vector<unsigned char> scanline((size_t) image.width * 4);
+            for (int y = begin; y < end; y++) {
+                decodeScanline(bytes + offsets[y], image.width, scanline.data());
+                convertScanline(scanline.data(), image.width, output + (size_t) y * width * 3);
+            }
+        });
+        return true;
+    }
+
+    bool loadRadianceImage(const std::string& filename, RadianceImage& image, std::string& error) {
+        OWO_PROFILE_SCOPE("loadRadianceImage");
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file) {
+            error = filename + ": cannot open the file";
+            return false;
+        }
+        std::vector<unsigned char> bytes((size_t) file.tellg());
+        file.seekg(0);
+        if (!file.read((char*) bytes.data(), (std::streamsize) bytes.size())) {
+            error = filename + ": cannot read the file";
+            return false;
+        }
+        if (!decodeRadianceImage(bytes.data(), bytes.size(), image, error)) {
+            error = filename + ": " + error;
+            return false;
+        }
+        return true;
+    }
+
+    bool radianceDecodeUsesSimd() noexcept {
+#ifdef OWO_RADIANCE_SSE2
+        return true;
+#else
+        return false;
+#endif
+    }
+}
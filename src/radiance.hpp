@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace owo {
+    /**
+     * Radiance .hdr image decoded to RGB floats, in the order of the file: top row first
+     */
+    struct RadianceImage {
+        int width = 0;
+        int height = 0;
+        std::vector<float> data;
+    };
+
+    /**
+     * Decode a Radiance .hdr file, of flat or run-length encoded RGBE scanlines and the usual "-Y height +X width"
+     * orientation. Scanlines are decoded on several threads and converted to floats 4 texels at a time with SSE2 when
+     * available. Results are bit-identical to stbi_loadf().
+     * @param error Set to the reason of a failure
+     * @return False if the file cannot be read or is not a supported .hdr
+     */
+    bool loadRadianceImage(const std::string& filename, RadianceImage& image, std::string& error);
+
+    /**
+     * Same as loadRadianceImage(), from the content of a file
+     */
+    bool decodeRadianceImage(const unsigned char* bytes, size_t size, RadianceImage& image, std::string& error);
+
+    /**
+     * @return True if the RGBE to float conversion uses SSE2
+     */
+    bool radianceDecodeUsesSimd() noexcept;
+}
@@ -0,0 +1,358 @@
+#include "rendergraph.hpp"
+
+#include <algorithm>
+#include <map>
+#include <labhelper.hpp>
+
+///////////////////////////////////////////////////////////////////////////////
+// RenderTargetPool
+///////////////////////////////////////////////////////////////////////////////
+
+RenderTargetPool::~RenderTargetPool() {
+    this->destroy();
+}
+
+void RenderTargetPool::destroy() {
+    for (auto& entry : this->entries) {
+        entry.target->destroy();
+    }
+    this->entries.clear();
+}
+
+FboInfo* RenderTargetPool::acquire(const RenderTargetDesc& desc) {
+    for (auto& entry : this->entries) {
+        if (!entry.inUse && entry.desc == desc) {
+            entry.inUse = true;
+            entry.unusedFrames = 0;
+            return entry.target.get();
+        }
+    }
+
+    Entry entry;
+    entry.desc = desc;
+    entry.target.reset(new FboInfo(desc.colorAttachments, desc.colorFormat, true));
+    entry.target->resize(desc.width, desc.height);
+    entry.inUse = true;
+    entry.unusedFrames = 0;
+    this->entries.push_back(std::move(entry));
+    return this->entries.back().target.get();
+}
+
+void RenderTargetPool::release(FboInfo* target) noexcept {
+    for (auto& entry : this->entries) {
+        if (entry.target.get() == target) {
+            entry.inUse = false;
+            return;
+        }
+    }
+}
+
+void RenderTargetPool::endFrame() {
+    for (auto it = this->entries.begin(); it != this->entries.end();) {
+        if (!it->inUse && ++it->unusedFrames > MAX_UNUSED_FRAMES) {
+            it->target->destroy();
+            it = this->entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RenderPass
+///////////////////////////////////////////////////////////////////////////////
+
+RenderPass& RenderPass::read(const std::string& resource) {
+    this->accesses.emplace_back(resource, Access::READ);
+    return *this;
+}
+
+RenderPass& RenderPass::write(const std::string& resource) {
+    this->accesses.emplace_back(resource, Access::WRITE);
+    return *this;
+}
+
+RenderPass& RenderPass::depthTestedWrite(const std::string& resource) {
+    this->accesses.emplace_back(resource, Access::DEPTH_TESTED_WRITE);
+    return *this;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RenderGraph
+///////////////////////////////////////////////////////////////////////////////
+
+void RenderGraph::reset() {
+    this->passes.clear();
+    this->targets.clear();
+    this->outputs.clear();
+}
+
+void RenderGraph::createTarget(const std::string& name, const RenderTargetDesc& desc) {
+    this->targets.push_back({name, desc, false, nullptr, -1, -1});
+}
+
+void RenderGraph::importTarget(const std::string& name, FboInfo* target, int width, int height) {
+    this->targets.push_back({name, {width, height, 0, GL_NONE}, true, target, -1, -1});
+}
+
+RenderPass& RenderGraph::addPass(const std::string& name, std::function<void()> execute, PassOrder order) {
+    this->passes.emplace_back();
+    RenderPass& pass = this->passes.back();
+    pass.name = name;
+    pass.execute = std::move(execute);
+    pass.order = order;
+    return pass;
+}
+
+void RenderGraph::setOutput(const std::string& resource) {
+    this->outputs.push_back(resource);
+}
+
+RenderGraph::Target* RenderGraph::findTarget(const std::string& resource) {
+    return const_cast<Target*>(static_cast<const RenderGraph*>(this)->findTarget(resource));
+}
+
+const RenderGraph::Target* RenderGraph::findTarget(const std::string& resource) const {
+    std::string name = resource.substr(0, resource.find('.'));
+    for (const auto& target : this->targets) {
+        if (target.name == name) {
+            return &target;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<size_t> RenderGraph::compile() {
+    typedef RenderPass::Access Access;
+    const size_t n = this->passes.size();
+
+    ///////////////////////////////////////////////////////////////////////
+    // Dependencies, from the accesses to each resource in declaration
+    // order. Depth tested writes of a resource commute with each other.
+    ///////////////////////////////////////////////////////////////////////
+    struct History {
+        // Last write, or the depth tested writes since then
+        std::vector<size_t> writers;
+        // Reads since the last write
+        std::vector<size_t> readers;
+        // Accesses the current group of depth tested writes follows
+        std::vector<size_t> groupBase;
+        bool inGroup = false;
+    };
+    std::map<std::string, History> histories;
+    std::vector<std::vector<size_t>> successors(n);
+    std::vector<int> predecessorCount(n, 0);
+
+    auto addEdge = [&](size_t from, size_t to) {
+        if (from == to) {
+            return;
+        }
+        successors[from].push_back(to);
+        predecessorCount[to]++;
+    };
+
+    for (size_t i = 0; i < n; i++) {
+        for (const auto& access : this->passes[i].accesses) {
+            History& history = histories[access.first];
+            switch (access.second) {
+                case Access::READ:
+                    for (size_t writer : history.writers) {
+                        addEdge(writer, i);
+                    }
+                    history.readers.push_back(i);
+                    // Later writes must not be reordered before this read
+                    history.inGroup = false;
+                    break;
+
+                case Access::DEPTH_TESTED_WRITE:
+                    if (!history.inGroup) {
+                        history.groupBase = history.writers;
+                        history.groupBase.insert(history.groupBase.end(), history.readers.begin(),
+                                                 history.readers.end());
+                        history.writers.clear();
+                        history.readers.clear();
+                        history.inGroup = true;
+                    }
+                    for (size_t base : history.groupBase) {
+                        addEdge(base, i);
+                    }
+                    history.writers.push_back(i);
+                    break;
+
+                case Access::WRITE:
+                    for (size_t writer : history.writers) {
+                        addEdge(writer, i);
+                    }
+                    for (size_t reader : history.readers) {
+                        addEdge(reader, i);
+                    }
+                    history.writers.assign(1, i);
+                    history.readers.clear();
+                    history.inGroup = false;
+                    break;
+            }
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////
+    // Topological sort, picking the ready pass with the earliest hint,
+    // then the earliest declaration
+    ///////////////////////////////////////////////////////////////////////
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < n; i++) {
+        if (predecessorCount[i] == 0) {
+            ready.push_back(i);
+        }
+    }
+
+    std::vector<size_t> order;
+    while (!ready.empty()) {
+        auto next = std::min_element(ready.begin(), ready.end(), [this](size_t a, size_t b) {
+            if (this->passes[a].order != this->passes[b].order) {
+                return this->passes[a].order < this->passes[b].order;
+            }
+            return a < b;
+        });
+        size_t pass = *next;
+        ready.erase(next);
+        order.push_back(pass);
+
+        for (size_t successor : successors[pass]) {
+            if (--predecessorCount[successor] == 0) {
+                ready.push_back(successor);
+            }
+        }
+    }
+
+    if (order.size() != n) {
+        owo::fatal_error("Render graph has a cycle");
+    }
+
+    ///////////////////////////////////////////////////////////////////////
+    // Culling, backwards from the outputs: a pass is kept if it writes a
+    // resource needed by the outputs or by a pass kept after it. A pass
+    // overwriting a resource it does not read hides the previous writes.
+    ///////////////////////////////////////////////////////////////////////
+    std::vector<std::string> needed = this->outputs;
+    std::vector<bool> live(n, false);
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        const RenderPass& pass = this->passes[*it];
+        for (const auto& access : pass.accesses) {
+            if (access.second != Access::READ
+                && std::find(needed.begin(), needed.end(), access.first) != needed.end()) {
+                live[*it] = true;
+                break;
+            }
+        }
+        if (!live[*it]) {
+            continue;
+        }
+        for (const auto& access : pass.accesses) {
+            if (access.second != Access::WRITE) {
+                continue;
+            }
+            bool reads = false;
+            for (const auto& other : pass.accesses) {
+                reads = reads || (other.first == access.first && other.second == Access::READ);
+            }
+            if (!reads) {
+                needed.erase(std::remove(needed.begin(), needed.end(), access.first), needed.end());
+            }
+        }
+        for (const auto& access : pass.accesses) {
+            if (access.second == Access::READ
+                && std::find(needed.begin(), needed.end(), access.first) == needed.end()) {
+                needed.push_back(access.first);
+            }
+        }
+    }
+
+    std::vector<size_t> result;
+    this->culled.clear();
+    for (size_t pass : order) {
+        if (live[pass]) {
+            result.push_back(pass);
+        } else {
+            this->culled.push_back(this->passes[pass].name);
+        }
+    }
+    return result;
+}
+
+void RenderGraph::execute(RenderTargetPool& pool) {
+    std::vector<size_t> order = this->compile();
+
+    ///////////////////////////////////////////////////////////////////////
+    // Lifetime of the targets, in executed passes
+    ///////////////////////////////////////////////////////////////////////
+    for (size_t i = 0; i < order.size(); i++) {
+        for (const auto& access : this->passes[order[i]].accesses) {
+            Target* target = this->findTarget(access.first);
+            if (target == nullptr) {
+                owo::fatal_error("Render graph resource " + access.first + " has no target",
+                                 "Pass " + this->passes[order[i]].name);
+                continue;
+            }
+            if (target->firstUse < 0) {
+                target->firstUse = (int) i;
+            }
+            target->lastUse = (int) i;
+        }
+    }
+
+    this->executed.clear();
+    for (size_t i = 0; i < order.size(); i++) {
+        for (auto& target : this->targets) {
+            if (!target.imported && target.firstUse == (int) i) {
+                target.fbo = pool.acquire(target.desc);
+            }
+        }
+
+        RenderPass& pass = this->passes[order[i]];
+        if (this->beforePass) {
+            this->beforePass(pass.name);
+        }
+        pass.execute();
+        if (this->afterPass) {
+            this->afterPass(pass.name);
+        }
+        this->executed.push_back(pass.name);
+
+        for (auto& target : this->targets) {
+            if (!target.imported && target.lastUse == (int) i) {
+                pool.release(target.fbo);
+                target.fbo = nullptr;
+            }
+        }
+    }
+}
+
+void RenderGraph::setPassHooks(std::function<void(const std::string&)> before,
+                               std::function<void(const std::string&)> after) {
+    this->beforePass = std::move(before);
+    this->afterPass = std::move(after);
+}
+
+FboInfo* RenderGraph::target(const std::string& name) const {
+    const Target* target = this->findTarget(name);
+    return target != nullptr ? target->fbo : nullptr;
+}
+
+GLuint RenderGraph::framebuffer(const std::string& name) const {
+    const FboInfo* fbo = this->target(name);
+    return fbo != nullptr ? fbo->framebufferId : 0;
+}
+
+void RenderGraph::bindTarget(const std::string& name) const {
+    const Target* target = this->findTarget(name);
+    if (target == nullptr) {
+        return;
+    }
+    if (target->fbo == nullptr) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, target->desc.width, target->desc.height);
+    } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, target->fbo->framebufferId);
+        glViewport(0, 0, target->fbo->width, target->fbo->height);
+    }
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "fbo.hpp"
+
+/**
+ * Size and format of a transient render target
+ */
+struct RenderTargetDesc {
+    int width;
+    int height;
+    int colorAttachments;
+    GLenum colorFormat;
+
+    bool operator==(const RenderTargetDesc& other) const noexcept {
+        return this->width == other.width && this->height == other.height
+               && this->colorAttachments == other.colorAttachments && this->colorFormat == other.colorFormat;
+    }
+};
+
+/**
+ * Pool of render targets, recycled from one frame to the next so that transient targets are never reallocated.
+ * Targets use immutable storage, a target whose description is no longer requested is released after a few frames.
+ */
+class RenderTargetPool {
+public:
+    /**
+     * Destructor
+     */
+    ~RenderTargetPool();
+
+    /**
+     * Delete all the targets while the context exists
+     */
+    void destroy();
+
+    /**
+     * Get a target matching the description, not used by anyone else until released
+     */
+    FboInfo* acquire(const RenderTargetDesc& desc);
+
+    /**
+     * Give a target back to the pool
+     */
+    void release(FboInfo* target) noexcept;
+
+    /**
+     * Age the unused targets and release the ones unused for too long, once per frame
+     */
+    void endFrame();
+
+    /**
+     * @return Number of targets allocated
+     */
+    size_t size() const noexcept {
+        return this->entries.size();
+    }
+
+    /**
+     * Number of frames an unused target is kept for
+     */
+    static const int MAX_UNUSED_FRAMES = 8;
+
+private:
+    struct Entry {
+        RenderTargetDesc desc;
+        std::unique_ptr<FboInfo> target;
+        bool inUse;
+        int unusedFrames;
+    };
+
+    std::vector<Entry> entries;
+};
+
+/**
+ * Ordering hint of a pass, only used among passes whose dependencies allow any order
+ */
+enum class PassOrder {
+    EARLY,
+    NORMAL,
+    LATE,
+};
+
+/**
+ * Render pass of a RenderGraph, declaring the resources it accesses.
+ * Resources are named after render targets, "<target>" being its color attachments and "<target>.depth" its depth
+ * attachment.
+ */
+class RenderPass {
+public:
+    /**
+     * The pass reads the resource, all the previous writes must be done
+     */
+    RenderPass& read(const std::string& resource);
+
+    /**
+     * The pass overwrites the resource, it is ordered after all the previous accesses
+     */
+    RenderPass& write(const std::string& resource);
+
+    /**
+     * The pass writes the resource through the depth test, so that the result does not depend on the order of such
+     * writes, which are then free to be reordered among themselves
+     */
+    RenderPass& depthTestedWrite(const std::string& resource);
+
+private:
+    friend class RenderGraph;
+
+    enum class Access {
+        READ,
+        WRITE,
+        DEPTH_TESTED_WRITE,
+    };
+
+    std::string name;
+    std::function<void()> execute;
+    PassOrder order;
+    std::vector<std::pair<std::string, Access>> accesses;
+};
+
+/**
+ * Frame render graph.
+ * Passes are declared every frame with the resources they access, then sorted so that each runs after the passes it
+ * depends on, with passes that do not contribute to the output culled. Transient targets are taken from a
+ * RenderTargetPool for the lifetime of the passes using them only.
+ */
+class RenderGraph {
+public:
+    /**
+     * Forget the passes and targets of the previous frame
+     */
+    void reset();
+
+    /**
+     * Declare a transient target, whose content is undefined until written by a pass
+     */
+    void createTarget(const std::string& name, const RenderTargetDesc& desc);
+
+    /**
+     * Declare a target owned by the application
+     * @param target Target, nullptr for the default framebuffer
+     */
+    void importTarget(const std::string& name, FboInfo* target, int width, int height);
+
+    /**
+     * Declare a pass, the returned reference is only valid until the next declaration
+     */
+    RenderPass& addPass(const std::string& name, std::function<void()> execute, PassOrder order = PassOrder::NORMAL);
+
+    /**
+     * Declare a resource as an output of the frame, passes not contributing to any output are culled
+     */
+    void setOutput(const std::string& resource);
+
+    /**
+     * Sort, cull and run the passes
+     */
+    void execute(RenderTargetPool& pool);
+
+    /**
+     * @return Framebuffer of a target, only valid while a pass accessing it runs
+     */
+    FboInfo* target(const std::string& name) const;
+
+    /**
+     * @return Framebuffer object of a target, 0 for the default framebuffer
+     */
+    GLuint framebuffer(const std::string& name) const;
+
+    /**
+     * Bind the framebuffer of a target and set the viewport to its size
+     */
+    void bindTarget(const std::string& name) const;
+
+    /**
+     * Set functions called with the name of each pass before and after running it, e.g. to time them
+     */
+    void setPassHooks(std::function<void(const std::string&)> before, std::function<void(const std::string&)> after);
+
+    /**
+     * @return Names of the passes run by the last execution, in order
+     */
+    const std::vector<std::string>& executedPasses() const noexcept {
+        return this->executed;
+    }
+
+    /**
+     * @return Names of the passes culled by the last execution
+     */
+    const std::vector<std::string>& culledPasses() const noexcept {
+        return this->culled;
+    }
+
+private:
+    struct Target {
+        std::string name;
+        RenderTargetDesc desc;
+        bool imported;
+        FboInfo* fbo;
+        int firstUse;
+        int lastUse;
+    };
+
+    /**
+     * @return Target of a resource name
+     */
+    Target* findTarget(const std::string& resource);
+
+    const Target* findTarget(const std::string& resource) const;
+
+    /**
+     * @return Indices of the passes in execution order, culled passes excluded
+     */
+    std::vector<size_t> compile();
+
+    std::deque<RenderPass> passes;
+    std::vector<Target> targets;
+    std::vector<std::string> outputs;
+    std::vector<std::string> executed;
+    std::vector<std::string> culled;
+    std::function<void(const std::string&)> beforePass;
+    std::function<void(const std::string&)> afterPass;
+};
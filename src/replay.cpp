@@ -0,0 +1,260 @@
+#include "replay.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+namespace {
+    ///////////////////////////////////////////////////////////////////////////
+    // Layout, in native byte order:
+    //   header: magic, version, parameter count,
+    //           then per parameter: type (u8), name length (u8), name
+    //   frame:  delta time, camera position, camera direction,
+    //           light rotation (floats), change count (u16),
+    //           then per change: parameter index (u16), value
+    ///////////////////////////////////////////////////////////////////////////
+    const char MAGIC[8] = {'O', 'W', 'O', 'R', 'E', 'C', '\0', '\0'};
+    // 2: the light rotation is the one rendered, after the simulation step
+    const uint32_t VERSION = 2;
+
+    template<typename T>
+    void write(std::ofstream& out, const T& value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /**
+     * Bounds checked read from a loaded session
+     */
+    bool read(const std::vector<uint8_t>& data, size_t& offset, void* value, size_t size) {
+        if (offset + size > data.size()) {
+            return false;
+        }
+        memcpy(value, data.data() + offset, size);
+        offset += size;
+        return true;
+    }
+
+    template<typename T>
+    bool read(const std::vector<uint8_t>& data, size_t& offset, T& value) {
+        return read(data, offset, &value, sizeof(T));
+    }
+
+    /**
+     * Frame state, stored as floats
+     */
+    const size_t FRAME_STATE_SIZE = 8 * sizeof(float);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ReplayParameters
+///////////////////////////////////////////////////////////////////////////////
+
+void ReplayParameters::add(const char* name, bool* value) {
+    this->parameters.push_back({name, Type::BOOL, value, sizeof(bool), 0, 0});
+}
+
+void ReplayParameters::add(const char* name, int* value) {
+    this->add(name, value, INT_MIN, INT_MAX);
+}
+
+void ReplayParameters::add(const char* name, int* value, int minimum, int maximum) {
+    this->parameters.push_back({name, Type::INT, value, sizeof(int), minimum, maximum});
+}
+
+bool ReplayParameters::Parameter::accepts(const uint8_t* recorded) const noexcept {
+    if (this->type == Type::BOOL) {
+        return *recorded <= 1;
+    }
+    if (this->type == Type::INT) {
+        int recordedInt;
+        memcpy(&recordedInt, recorded, sizeof(recordedInt));
+        return recordedInt >= this->minimum && recordedInt <= this->maximum;
+    }
+    return true;
+}
+
+void ReplayParameters::add(const char* name, float* value) {
+    this->parameters.push_back({name, Type::FLOAT, value, sizeof(float), 0, 0});
+}
+
+void ReplayParameters::add(const char* name, glm::vec3* value) {
+    this->parameters.push_back({name, Type::VEC3, value, sizeof(glm::vec3), 0, 0});
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SessionRecorder
+///////////////////////////////////////////////////////////////////////////////
+
+bool SessionRecorder::start(const std::string& path, const ReplayParameters& p_parameters) {
+    this->stop();
+    this->file.open(path, std::ios::binary);
+    if (!this->file) {
+        std::cout << "ERROR: SessionRecorder: cannot write " << path << "\n";
+        return false;
+    }
+    this->parameters = &p_parameters;
+    this->frames = 0;
+    this->previous.clear();
+
+    this->file.write(MAGIC, sizeof(MAGIC));
+    write(this->file, VERSION);
+    write(this->file, (uint32_t) p_parameters.parameters.size());
+    for (const auto& parameter : p_parameters.parameters) {
+        write(this->file, (uint8_t) parameter.type);
+        write(this->file, (uint8_t) parameter.name.size());
+        this->file.write(parameter.name.data(), (std::streamsize) parameter.name.size());
+    }
+    return true;
+}
+
+void SessionRecorder::recordFrame(const ReplayFrameState& state) {
+    if (!this->isRecording()) {
+        return;
+    }
+
+    write(this->file, state.deltaTime);
+    write(this->file, state.cameraPosition);
+    write(this->file, state.cameraDirection);
+    write(this->file, state.lightRotation);
+
+    ///////////////////////////////////////////////////////////////////////
+    // Parameters that changed, all of them on the first frame
+    ///////////////////////////////////////////////////////////////////////
+    const auto& all = this->parameters->parameters;
+    bool first = this->previous.empty();
+    std::vector<uint16_t> changed;
+    size_t offset = 0;
+    for (size_t i = 0; i < all.size(); i++) {
+        if (first) {
+            this->previous.insert(this->previous.end(), (const uint8_t*) all[i].value,
+                                  (const uint8_t*) all[i].value + all[i].size);
+            changed.push_back((uint16_t) i);
+        } else if (memcmp(this->previous.data() + offset, all[i].value, all[i].size) != 0) {
+            memcpy(this->previous.data() + offset, all[i].value, all[i].size);
+            changed.push_back((uint16_t) i);
+        }
+        offset += all[i].size;
+    }
+
+    write(this->file, (uint16_t) changed.size());
+    for (uint16_t i : changed) {
+        write(this->file, i);
+        this->file.write((const char*) all[i].value, (std::streamsize) all[i].size);
+    }
+    this->frames++;
+}
+
+void SessionRecorder::stop() {
+    if (this->isRecording()) {
+        this->file.close();
+        std::cout << "Recorded " << this->frames << " frames\n";
+    }
+    this->parameters = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SessionPlayer
+///////////////////////////////////////////////////////////////////////////////
+
+bool SessionPlayer::open(const std::string& path, const ReplayParameters& p_parameters) {
+    this->close();
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cout << "ERROR: SessionPlayer: cannot read " << path << "\n";
+        return false;
+    }
+    std::vector<uint8_t> content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    ///////////////////////////////////////////////////////////////////////
+    // Header, the parameters must match the registered ones
+    ///////////////////////////////////////////////////////////////////////
+    size_t offset = 0;
+    char magic[sizeof(MAGIC)];
+    uint32_t version = 0, count = 0;
+    if (!read(content, offset, magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+        || !read(content, offset, version) || version != VERSION || !read(content, offset, count)) {
+        std::cout << "ERROR: SessionPlayer: " << path << " is not a session of this version\n";
+        return false;
+    }
+
+    const auto& all = p_parameters.parameters;
+    bool matching = count == all.size();
+    for (uint32_t i = 0; i < count && matching; i++) {
+        uint8_t type = 0, length = 0;
+        std::string name;
+        matching = read(content, offset, type) && read(content, offset, length);
+        if (matching) {
+            name.resize(length);
+            matching = read(content, offset, &name[0], length);
+        }
+        matching = matching && type == (uint8_t) all[i].type && name == all[i].name;
+    }
+    if (!matching) {
+        std::cout << "ERROR: SessionPlayer: " << path << " was recorded with different parameters\n";
+        return false;
+    }
+
+    ///////////////////////////////////////////////////////////////////////
+    // Count and validate the frames, so that playing cannot fail midway
+    ///////////////////////////////////////////////////////////////////////
+    size_t framesOffset = offset;
+    size_t frameCount = 0;
+    while (offset < content.size()) {
+        uint16_t changes = 0;
+        bool valid = offset + FRAME_STATE_SIZE <= content.size();
+        offset += FRAME_STATE_SIZE;
+        valid = valid && read(content, offset, changes);
+        for (uint16_t i = 0; i < changes && valid; i++) {
+            uint16_t index = 0;
+            valid = read(content, offset, index) && index < all.size() && offset + all[index].size <= content.size()
+                    && all[index].accepts(content.data() + offset);
+            offset += valid ? all[index].size : 0;
+        }
+        if (!valid) {
+            std::cout << "WARNING: SessionPlayer: " << path << " is truncated or damaged after " << frameCount
+                      << " frames\n";
+            break;
+        }
+        frameCount++;
+    }
+
+    this->data = std::move(content);
+    this->offset = framesOffset;
+    this->parameters = &p_parameters;
+    this->frames = frameCount;
+    this->played = 0;
+    return true;
+}
+
+bool SessionPlayer::nextFrame(ReplayFrameState& state) {
+    if (!this->isPlaying() || this->played >= this->frames) {
+        return false;
+    }
+
+    read(this->data, this->offset, state.deltaTime);
+    read(this->data, this->offset, state.cameraPosition);
+    read(this->data, this->offset, state.cameraDirection);
+    read(this->data, this->offset, state.lightRotation);
+
+    uint16_t changes = 0;
+    read(this->data, this->offset, changes);
+    const auto& all = this->parameters->parameters;
+    for (uint16_t i = 0; i < changes; i++) {
+        uint16_t index = 0;
+        read(this->data, this->offset, index);
+        read(this->data, this->offset, all[index].value, all[index].size);
+    }
+
+    this->played++;
+    return true;
+}
+
+void SessionPlayer::close() noexcept {
+    this->data.clear();
+    this->data.shrink_to_fit();
+    this->offset = 0;
+    this->parameters = nullptr;
+    this->frames = 0;
+    this->played = 0;
+}
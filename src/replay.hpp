@@ -0,0 +1,148 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * State driving a frame, besides the parameters
+ */
+struct ReplayFrameState {
+    float deltaTime;
+    glm::vec3 cameraPosition;
+    glm::vec3 cameraDirection;
+    float lightRotation;
+};
+
+/**
+ * Parameters recorded along with the frames, usually the ones edited in the GUI.
+ * Recorder and player must register the same parameters in the same order.
+ */
+class ReplayParameters {
+public:
+    void add(const char* name, bool* value);
+
+    void add(const char* name, int* value);
+
+    /**
+     * Parameter of a bounded value, e.g. an enum. Sessions where it is out of [minimum, maximum] are damaged, and are
+     * only replayed up to that frame.
+     */
+    void add(const char* name, int* value, int minimum, int maximum);
+
+    void add(const char* name, float* value);
+
+    void add(const char* name, glm::vec3* value);
+
+private:
+    friend class SessionRecorder;
+    friend class SessionPlayer;
+
+    enum class Type : uint8_t {
+        BOOL = 0,
+        INT = 1,
+        FLOAT = 2,
+        VEC3 = 3,
+    };
+
+    struct Parameter {
+        std::string name;
+        Type type;
+        void* value;
+        size_t size;
+        // Bounds of an INT
+        int minimum;
+        int maximum;
+
+        /**
+         * @return False if a recorded value cannot be taken: a bool other than 0 or 1, or an int out of its bounds
+         */
+        bool accepts(const uint8_t* recorded) const noexcept;
+    };
+
+    std::vector<Parameter> parameters;
+};
+
+/**
+ * Records sessions into a compact binary log: the frame state, and the parameters that changed since the previous
+ * frame.
+ */
+class SessionRecorder {
+public:
+    /**
+     * Start recording, the first frame records all the parameters
+     * @return False if the file cannot be written
+     */
+    bool start(const std::string& path, const ReplayParameters& parameters);
+
+    /**
+     * Record the state of the frame about to be rendered
+     */
+    void recordFrame(const ReplayFrameState& state);
+
+    /**
+     * Stop recording and close the file
+     */
+    void stop();
+
+    bool isRecording() const noexcept {
+        return this->file.is_open();
+    }
+
+    size_t recordedFrames() const noexcept {
+        return this->frames;
+    }
+
+private:
+    std::ofstream file;
+    const ReplayParameters* parameters {nullptr};
+    // Values of the parameters as last recorded
+    std::vector<uint8_t> previous;
+    size_t frames {0};
+};
+
+/**
+ * Plays sessions recorded by a SessionRecorder back. The whole log is loaded up front, so that replaying does not
+ * touch the disk.
+ */
+class SessionPlayer {
+public:
+    /**
+     * Load a session
+     * @return False if the file cannot be read or was recorded with different parameters
+     */
+    bool open(const std::string& path, const ReplayParameters& parameters);
+
+    /**
+     * Apply the parameter changes of the next frame and get its state
+     * @return False at the end of the session
+     */
+    bool nextFrame(ReplayFrameState& state);
+
+    /**
+     * Stop playing
+     */
+    void close() noexcept;
+
+    bool isPlaying() const noexcept {
+        return this->parameters != nullptr;
+    }
+
+    size_t frameCount() const noexcept {
+        return this->frames;
+    }
+
+    size_t currentFrame() const noexcept {
+        return this->played;
+    }
+
+private:
+    std::vector<uint8_t> data;
+    size_t offset {0};
+    const ReplayParameters* parameters {nullptr};
+    size_t frames {0};
+    size_t played {0};
+};
@@ -0,0 +1,53 @@
+#include "resolutionscaler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Weight of the newest measurement in the moving average
+    const float SMOOTHING = 0.1f;
+
+    // Aim below the budget, so that small variations do not exceed it
+    const float HEADROOM = 0.9f;
+}
+
+constexpr float ResolutionScaler::STEP;
+
+ResolutionScaler::ResolutionScaler(float targetMilliseconds) noexcept :
+    targetMilliseconds(targetMilliseconds) {}
+
+float ResolutionScaler::update(float gpuMilliseconds) noexcept {
+    if (gpuMilliseconds <= 0.f) {
+        return this->currentScale;
+    }
+
+    this->framesSinceChange++;
+    if (this->framesSinceChange <= COOLDOWN_FRAMES) {
+        // Still measuring the previous resolution
+        return this->currentScale;
+    }
+
+    if (this->smoothedMilliseconds < 0.f) {
+        this->smoothedMilliseconds = gpuMilliseconds;
+    } else {
+        this->smoothedMilliseconds += SMOOTHING * (gpuMilliseconds - this->smoothedMilliseconds);
+    }
+
+    // GPU time is mostly proportional to the pixel count, i.e. to the square of the scale
+    float ideal = this->currentScale * std::sqrt(HEADROOM * this->targetMilliseconds / this->smoothedMilliseconds);
+    ideal = std::min(1.f, std::max(this->minScale, ideal));
+
+    // A whole step of dead band, so that the scale does not flicker between two steps
+    if (std::fabs(ideal - this->currentScale) >= STEP) {
+        this->currentScale = std::min(1.f, std::max(this->minScale, std::round(ideal / STEP) * STEP));
+        this->smoothedMilliseconds = -1.f;
+        this->framesSinceChange = 0;
+    }
+    return this->currentScale;
+}
+
+void ResolutionScaler::reset() noexcept {
+    this->currentScale = 1.f;
+    this->smoothedMilliseconds = -1.f;
+    this->framesSinceChange = 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/**
+ * Dynamic resolution controller.
+ * Chooses the scale of the render resolution so that the measured GPU frame time stays under a budget. The scale is
+ * quantized, so that render targets are only reallocated on significant changes, and left alone for a few frames
+ * after each change, until measurements at the new resolution are available.
+ */
+class ResolutionScaler {
+public:
+    /**
+     * Constructor
+     * @param targetMilliseconds GPU frame time budget
+     */
+    explicit ResolutionScaler(float targetMilliseconds = 16.6f) noexcept;
+
+    /**
+     * Feed the latest GPU frame time, once per frame
+     * @param gpuMilliseconds GPU frame time, negative if not available
+     * @return Scale of the render resolution, in ]0, 1]
+     */
+    float update(float gpuMilliseconds) noexcept;
+
+    /**
+     * @return Current scale of the render resolution
+     */
+    float scale() const noexcept {
+        return this->currentScale;
+    }
+
+    /**
+     * Go back to full resolution
+     */
+    void reset() noexcept;
+
+    /**
+     * GPU frame time budget
+     */
+    float targetMilliseconds;
+
+    /**
+     * Lowest scale allowed
+     */
+    float minScale {0.5f};
+
+    /**
+     * Scale increment
+     */
+    static constexpr float STEP = 0.05f;
+
+    /**
+     * Frames to wait after a change, longer than the latency of GPU timers
+     */
+    static const int COOLDOWN_FRAMES = 8;
+
+private:
+    /**
+     * Current scale
+     */
+    float currentScale {1.f};
+
+    /**
+     * Exponential moving average of the GPU frame time, negative if none
+     */
+    float smoothedMilliseconds {-1.f};
+
+    /**
+     * Frames since the last change of scale
+     */
+    int framesSinceChange {0};
+};
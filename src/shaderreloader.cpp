@@ -0,0 +1,279 @@
+#include "shaderreloader.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <GLState.hpp>
+#include <Trace.hpp>
+
+ShaderReloader::~ShaderReloader() {
+    this->stop();
+}
+
+void ShaderReloader::add(const std::string& vertexShader,
+                         const std::string& fragmentShader,
+                         GLuint* program,
+                         const owo::ShaderDefines& defines) {
+    this->programs.push_back({vertexShader, fragmentShader, defines, program, {}, false, false, {}});
+}
+
+bool ShaderReloader::readSources(Program& program,
+                                 std::string& vertexSource,
+                                 std::string& fragmentSource,
+                                 std::string& p_error) {
+    // The files of both shaders are watched even if one cannot be read, it may be created later
+    std::vector<std::string> vertexFiles, fragmentFiles;
+    bool read = owo::loadShaderSource(program.vertexShader, vertexSource, p_error, &vertexFiles);
+    read = read && owo::loadShaderSource(program.fragmentShader, fragmentSource, p_error, &fragmentFiles);
+    if (!read && fragmentFiles.empty()) {
+        fragmentFiles.push_back(program.fragmentShader);
+    }
+
+    for (const std::vector<std::string>* files : {&vertexFiles, &fragmentFiles}) {
+        for (const std::string& file : *files) {
+            if (std::find(program.files.begin(), program.files.end(), file) == program.files.end()) {
+                program.files.push_back(file);
+            }
+            if (this->watching) {
+                this->watcher.addFile(file);
+            }
+        }
+    }
+    if (read) {
+        vertexSource = owo::injectDefines(vertexSource, program.defines);
+        fragmentSource = owo::injectDefines(fragmentSource, program.defines);
+    }
+    return read;
+}
+
+void ShaderReloader::loadAll() {
+    OWO_PROFILE_SCOPE("ShaderReloader::loadAll");
+    // All are started before waiting for any, so that they are compiled in parallel when supported
+    owo::enableParallelShaderCompile();
+    for (Program& program : this->programs) {
+        std::string vertexSource, fragmentSource, readError;
+        if (!this->readSources(program, vertexSource, fragmentSource, readError)) {
+            owo::fatal_error(readError, "Shader source");
+        }
+        program.pending = owo::beginShaderProgram(
+            vertexSource, fragmentSource,
+            owo::shaderProgramName(program.vertexShader, program.fragmentShader, program.defines));
+    }
+    for (Program& program : this->programs) {
+        std::string buildError, title;
+        *program.target = owo::finishShaderProgram(program.pending, buildError, title);
+        if (*program.target == 0) {
+            owo::fatal_error(buildError, title);
+        }
+    }
+}
+
+void ShaderReloader::start(SDL_Window* p_window) {
+    this->watching = true;
+    for (const Program& program : this->programs) {
+        for (const std::string& file : program.files) {
+            this->watcher.addFile(file);
+        }
+    }
+
+    if (owo::enableParallelShaderCompile()) {
+        this->reloadMode = Mode::PARALLEL_COMPILE;
+        return;
+    }
+
+    // Made current on the background thread, with the attributes of the render context
+    SDL_GLContext renderContext = SDL_GL_GetCurrentContext();
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+    this->context = SDL_GL_CreateContext(p_window);
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+    SDL_GL_MakeCurrent(p_window, renderContext);
+    if (this->context == nullptr) {
+        std::cout << "No shared context: " << SDL_GetError() << ", shaders are rebuilt on the render thread\n";
+        this->reloadMode = Mode::SYNCHRONOUS;
+        return;
+    }
+
+    this->window = p_window;
+    this->stopping = false;
+    this->worker = std::thread(&ShaderReloader::workerLoop, this);
+    this->reloadMode = Mode::BACKGROUND_CONTEXT;
+}
+
+void ShaderReloader::stop() {
+    if (this->worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->wake.notify_one();
+        this->worker.join();
+    }
+    for (const Result& result : this->results) {
+        glDeleteSync(result.fence);
+        glDeleteProgram(result.program);
+    }
+    this->results.clear();
+    this->jobs.clear();
+    if (this->context != nullptr) {
+        SDL_GL_DeleteContext(this->context);
+        this->context = nullptr;
+        // Dropped with the jobs, built again by the next update()
+        for (Program& program : this->programs) {
+            program.dirty = program.dirty || program.building;
+            program.building = false;
+        }
+    }
+    this->reloadMode = Mode::SYNCHRONOUS;
+}
+
+void ShaderReloader::reloadAll() noexcept {
+    for (Program& program : this->programs) {
+        program.dirty = true;
+    }
+}
+
+void ShaderReloader::update() {
+    OWO_PROFILE_SCOPE("ShaderReloader::update");
+    for (const std::string& changed : this->watcher.poll()) {
+        for (Program& program : this->programs) {
+            if (std::find(program.files.begin(), program.files.end(), changed) != program.files.end()) {
+                program.dirty = true;
+            }
+        }
+    }
+
+    // A program changed again while building is rebuilt once the current build is done
+    for (size_t i = 0; i < this->programs.size(); i++) {
+        if (this->programs[i].dirty && !this->programs[i].building) {
+            this->programs[i].dirty = false;
+            this->startBuild(i);
+        }
+    }
+
+    bool replaced = false;
+    if (this->reloadMode == Mode::BACKGROUND_CONTEXT) {
+        std::vector<Result> done;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            for (auto it = this->results.begin(); it != this->results.end();) {
+                GLenum status = glClientWaitSync(it->fence, 0, 0);
+                if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                    done.push_back(*it);
+                    it = this->results.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        for (const Result& result : done) {
+            glDeleteSync(result.fence);
+            this->finishBuild(result.index, result.program, result.error, result.title);
+            replaced = replaced || result.program != 0;
+        }
+    } else {
+        for (size_t i = 0; i < this->programs.size(); i++) {
+            Program& program = this->programs[i];
+            if (!program.building || !owo::isShaderProgramReady(program.pending)) {
+                continue;
+            }
+            std::string buildError, title;
+            GLuint built = owo::finishShaderProgram(program.pending, buildError, title);
+            this->finishBuild(i, built, buildError, title);
+            replaced = replaced || built != 0;
+        }
+    }
+
+    if (replaced) {
+        // A new program may reuse the name of a deleted one
+        owo::glstate::invalidate();
+    }
+}
+
+void ShaderReloader::startBuild(size_t index) {
+    Program& program = this->programs[index];
+    std::string vertexSource, fragmentSource, readError;
+    if (!this->readSources(program, vertexSource, fragmentSource, readError)) {
+        this->finishBuild(index, 0, readError, "Shader source");
+        return;
+    }
+
+    program.building = true;
+    std::string name = owo::shaderProgramName(program.vertexShader, program.fragmentShader, program.defines);
+    if (this->reloadMode == Mode::BACKGROUND_CONTEXT) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->jobs.push_back({index, std::move(vertexSource), std::move(fragmentSource), std::move(name)});
+        }
+        this->wake.notify_one();
+    } else {
+        program.pending = owo::beginShaderProgram(vertexSource, fragmentSource, name);
+    }
+}
+
+void ShaderReloader::finishBuild(size_t index, GLuint built, const std::string& p_error, const std::string& title) {
+    Program& program = this->programs[index];
+    program.building = false;
+    if (built == 0) {
+        this->error = title + ": " + p_error;
+        owo::non_fatal_error(p_error, title);
+        return;
+    }
+
+    GLuint previous = *program.target;
+    *program.target = built;
+    glDeleteProgram(previous);
+    this->error.clear();
+}
+
+int ShaderReloader::buildingCount() const noexcept {
+    int count = 0;
+    for (const Program& program : this->programs) {
+        count += program.building ? 1 : 0;
+    }
+    return count;
+}
+
+std::string ShaderReloader::description() const {
+    std::string description;
+    switch (this->reloadMode) {
+        case Mode::SYNCHRONOUS:
+            description = "on the render thread";
+            break;
+        case Mode::PARALLEL_COMPILE:
+            description = "parallel compile";
+            break;
+        case Mode::BACKGROUND_CONTEXT:
+            description = "background context";
+            break;
+    }
+    if (this->watching) {
+        description += this->watcher.usesNotifications() ? ", inotify" : ", polling";
+    }
+    return description;
+}
+
+void ShaderReloader::workerLoop() {
+    SDL_GL_MakeCurrent(this->window, this->context);
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wake.wait(lock, [this] { return this->stopping || !this->jobs.empty(); });
+            if (this->stopping) {
+                break;
+            }
+            job = std::move(this->jobs.front());
+            this->jobs.pop_front();
+        }
+
+        owo::PendingProgram pending = owo::beginShaderProgram(job.vertexSource, job.fragmentSource, job.name);
+        Result result {job.index, 0, nullptr, {}, {}};
+        result.program = owo::finishShaderProgram(pending, result.error, result.title);
+        // Commands of a context are not seen by the others before they are flushed
+        result.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->results.push_back(std::move(result));
+    }
+    SDL_GL_MakeCurrent(this->window, nullptr);
+}
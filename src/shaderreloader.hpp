@@ -0,0 +1,161 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <labhelper.hpp>
+
+#include "filewatcher.hpp"
+
+/**
+ * Shader programs of the application, rebuilt in the background when their files change.
+ * Only the programs including a changed file are rebuilt. The driver compiles and links them on its own threads when
+ * it supports parallel compilation, otherwise they are built on a background context sharing the objects of the
+ * render one. A rebuilt program replaces the previous one between two frames, once linked, and a program failing to
+ * build keeps the previous one.
+ * Variants of a program are registered with their definitions and all built up front, so that switching from one to
+ * another is instant.
+ */
+class ShaderReloader {
+public:
+    /**
+     * How programs are rebuilt
+     */
+    enum class Mode {
+        // On the render thread, waiting for the result
+        SYNCHRONOUS,
+        // GL_KHR_parallel_shader_compile, the render thread polls the result
+        PARALLEL_COMPILE,
+        // On a thread with a shared context
+        BACKGROUND_CONTEXT,
+    };
+
+    /**
+     * Destructor, stops the background thread
+     */
+    ~ShaderReloader();
+
+    /**
+     * Register a program, before loadAll()
+     * @param program Set to the program, and to each rebuilt one
+     * @param defines Definitions of the variant, a program being registered once per variant
+     */
+    void add(const std::string& vertexShader,
+             const std::string& fragmentShader,
+             GLuint* program,
+             const owo::ShaderDefines& defines = owo::ShaderDefines());
+
+    /**
+     * Build all the programs, waiting for them. Errors are fatal.
+     */
+    void loadAll();
+
+    /**
+     * Watch the files of the programs and choose how to rebuild them
+     * @param window Window of the render context, to create the background one
+     */
+    void start(SDL_Window* window);
+
+    /**
+     * Stop the background thread and release its context
+     */
+    void stop();
+
+    /**
+     * Rebuild all the programs, whether or not their files changed
+     */
+    void reloadAll() noexcept;
+
+    /**
+     * Rebuild the programs whose files changed, and replace the rebuilt ones. Once per frame, between two frames.
+     */
+    void update();
+
+    Mode mode() const noexcept {
+        return this->reloadMode;
+    }
+
+    /**
+     * @return Description of the mode and of the file watching
+     */
+    std::string description() const;
+
+    /**
+     * @return Number of programs being rebuilt
+     */
+    int buildingCount() const noexcept;
+
+    /**
+     * @return Error of the last program failing to build, empty once it builds
+     */
+    const std::string& lastError() const noexcept {
+        return this->error;
+    }
+
+private:
+    struct Program {
+        std::string vertexShader;
+        std::string fragmentShader;
+        owo::ShaderDefines defines;
+        GLuint* target;
+        // Files read by the last build, includes too
+        std::vector<std::string> files;
+        bool dirty;
+        bool building;
+        owo::PendingProgram pending;
+    };
+
+    /**
+     * Program built by the background thread
+     */
+    struct Job {
+        size_t index;
+        std::string vertexSource;
+        std::string fragmentSource;
+        std::string name;
+    };
+
+    struct Result {
+        size_t index;
+        GLuint program;
+        // Signaled once the background context is done with the program
+        GLsync fence;
+        std::string error;
+        std::string title;
+    };
+
+    /**
+     * Read the sources of a program with its definitions, updating the files it depends on
+     */
+    bool readSources(Program& program, std::string& vertexSource, std::string& fragmentSource, std::string& error);
+
+    void startBuild(size_t index);
+
+    /**
+     * Replace a program by its rebuilt one, or report its failure
+     */
+    void finishBuild(size_t index, GLuint program, const std::string& error, const std::string& title);
+
+    void workerLoop();
+
+    std::vector<Program> programs;
+    FileWatcher watcher;
+    Mode reloadMode {Mode::SYNCHRONOUS};
+    bool watching {false};
+    std::string error;
+
+    //-------------------------------------------------------------------------
+    // Background context
+    //-------------------------------------------------------------------------
+    SDL_Window* window {nullptr};
+    SDL_GLContext context {nullptr};
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    std::vector<Result> results;
+    bool stopping {false};
+};
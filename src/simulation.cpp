@@ -0,0 +1,231 @@
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <glm/gtx/transform.hpp>
+#include <Trace.hpp>
+
+using glm::vec3;
+using glm::vec4;
+using glm::mat4;
+using std::chrono::steady_clock;
+
+namespace {
+    const vec3 WORLD_UP(0.f, 1.f, 0.f);
+
+    // Light rotation per second, in radians
+    const float LIGHT_ROTATION_SPEED = 1.f;
+
+    // Light rotation per pixel of mouse motion, in radians
+    const float LIGHT_DRAG_SPEED = 0.01f;
+
+    // Camera rotation per pixel, relative to the rotation speed. It used to be scaled by the frame time, this is
+    // the same rotation as at 60 FPS, now at any frame rate.
+    const float CAMERA_DRAG_SCALE = 1.f / 100.f / 60.f;
+
+    // Steps run at once before giving up on catching up, e.g. after a breakpoint
+    const int MAX_CATCH_UP_STEPS = 8;
+
+    const steady_clock::duration STEP = std::chrono::duration_cast<steady_clock::duration>(
+        std::chrono::duration<double>(1. / Simulation::RATE));
+}
+
+Simulation::Simulation(const SimulationState& initial) :
+    state(initial),
+    nextStep(steady_clock::now()),
+    snapshots(Snapshot {initial, initial, steady_clock::now()}) {}
+
+Simulation::~Simulation() {
+    this->stopThread();
+}
+
+void Simulation::advance(SimulationState& state,
+                         const SimulationInput& input,
+                         const SimulationSettings& settings,
+                         float deltaTime) noexcept {
+    if (input.cameraRotation.x != 0 || input.cameraRotation.y != 0) {
+        float angle = settings.rotationSpeed * CAMERA_DRAG_SCALE;
+        mat4 yaw = glm::rotate(angle * (float) -input.cameraRotation.x, WORLD_UP);
+        mat4 pitch = glm::rotate(angle * (float) -input.cameraRotation.y,
+                                 glm::normalize(glm::cross(state.cameraDirection, WORLD_UP)));
+        state.cameraDirection = vec3(pitch * yaw * vec4(state.cameraDirection, 0.f));
+    }
+
+    vec3 cameraRight = glm::cross(state.cameraDirection, WORLD_UP);
+    float distance = settings.cameraSpeed * deltaTime;
+    if (input.keys & Simulation::KEY_FORWARD) {
+        state.cameraPosition += distance * state.cameraDirection;
+    }
+    if (input.keys & Simulation::KEY_BACKWARD) {
+        state.cameraPosition -= distance * state.cameraDirection;
+    }
+    if (input.keys & Simulation::KEY_LEFT) {
+        state.cameraPosition -= distance * cameraRight;
+    }
+    if (input.keys & Simulation::KEY_RIGHT) {
+        state.cameraPosition += distance * cameraRight;
+    }
+    if (input.keys & Simulation::KEY_DOWN) {
+        state.cameraPosition -= distance * WORLD_UP;
+    }
+    if (input.keys & Simulation::KEY_UP) {
+        state.cameraPosition += distance * WORLD_UP;
+    }
+
+    state.lightRotation += (float) input.lightRotation * LIGHT_DRAG_SPEED;
+    if (!settings.lightManualOnly && !input.lightDragging) {
+        state.lightRotation += deltaTime * LIGHT_ROTATION_SPEED;
+    }
+}
+
+void Simulation::setKeys(uint32_t p_keys) noexcept {
+    this->keys.store(p_keys, std::memory_order_relaxed);
+}
+
+void Simulation::addCameraRotation(int dx, int dy) noexcept {
+    this->cameraRotationX.fetch_add(dx, std::memory_order_relaxed);
+    this->cameraRotationY.fetch_add(dy, std::memory_order_relaxed);
+}
+
+void Simulation::addLightRotation(int dx) noexcept {
+    this->lightRotation.fetch_add(dx, std::memory_order_relaxed);
+}
+
+void Simulation::setLightDragging(bool dragging) noexcept {
+    this->lightDragging.store(dragging, std::memory_order_relaxed);
+}
+
+void Simulation::setSettings(const SimulationSettings& settings) noexcept {
+    this->cameraSpeed.store(settings.cameraSpeed, std::memory_order_relaxed);
+    this->rotationSpeed.store(settings.rotationSpeed, std::memory_order_relaxed);
+    this->lightManualOnly.store(settings.lightManualOnly, std::memory_order_relaxed);
+}
+
+void Simulation::startThread() {
+    if (this->isThreaded()) {
+        return;
+    }
+    this->running.store(true);
+    this->thread = std::thread(&Simulation::threadLoop, this);
+}
+
+void Simulation::stopThread() {
+    if (!this->isThreaded()) {
+        return;
+    }
+    this->running.store(false);
+    this->thread.join();
+}
+
+void Simulation::update() {
+    this->runSteps(steady_clock::now());
+}
+
+void Simulation::reset(const SimulationState& p_state) {
+    bool threaded = this->isThreaded();
+    this->stopThread();
+
+    this->state = p_state;
+    this->nextStep = steady_clock::now();
+    this->cameraRotationX.store(0);
+    this->cameraRotationY.store(0);
+    this->lightRotation.store(0);
+    this->snapshots.writeSlot() = {p_state, p_state, this->nextStep};
+    this->snapshots.publish();
+
+    if (threaded) {
+        this->startThread();
+    }
+}
+
+SimulationState Simulation::sample() noexcept {
+    this->snapshots.update();
+    const Snapshot& snapshot = this->snapshots.read();
+
+    std::chrono::duration<float> sinceStep = steady_clock::now() - snapshot.time;
+    float alpha = glm::clamp(sinceStep.count() * (float) RATE, 0.f, 1.f);
+    SimulationState result;
+    result.cameraPosition = glm::mix(snapshot.previous.cameraPosition, snapshot.current.cameraPosition, alpha);
+    result.cameraDirection = glm::normalize(
+        glm::mix(snapshot.previous.cameraDirection, snapshot.current.cameraDirection, alpha));
+    result.lightRotation = glm::mix(snapshot.previous.lightRotation, snapshot.current.lightRotation, alpha);
+    return result;
+}
+
+SimulationState Simulation::sampleLatched() noexcept {
+    OWO_PROFILE_SCOPE("Simulation latch");
+    for (;;) {
+        uint32_t before = this->sequence.load(std::memory_order_acquire);
+        if (before & 1u) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        this->snapshots.update();
+        const Snapshot& snapshot = this->snapshots.read();
+        SimulationInput input {};
+        input.keys = this->keys.load(std::memory_order_relaxed);
+        input.cameraRotation.x = this->cameraRotationX.load(std::memory_order_relaxed);
+        input.cameraRotation.y = this->cameraRotationY.load(std::memory_order_relaxed);
+        input.lightRotation = this->lightRotation.load(std::memory_order_relaxed);
+        input.lightDragging = this->lightDragging.load(std::memory_order_relaxed);
+        SimulationSettings settings {this->cameraSpeed.load(std::memory_order_relaxed),
+                                     this->rotationSpeed.load(std::memory_order_relaxed),
+                                     this->lightManualOnly.load(std::memory_order_relaxed)};
+        SimulationState result = snapshot.current;
+        steady_clock::time_point time = snapshot.time;
+
+        // A step in between may have consumed the input read, or published a snapshot including it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (this->sequence.load(std::memory_order_relaxed) != before) {
+            continue;
+        }
+
+        // At most the time until the next step, which takes over from the snapshot with the same input
+        std::chrono::duration<float> sinceStep = steady_clock::now() - time;
+        advance(result, input, settings, glm::clamp(sinceStep.count(), 0.f, 1.f / (float) RATE));
+        return result;
+    }
+}
+
+void Simulation::runSteps(steady_clock::time_point now) {
+    int due = 0;
+    while (this->nextStep <= now && due < MAX_CATCH_UP_STEPS) {
+        OWO_PROFILE_SCOPE("Simulation step");
+        this->sequence.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        SimulationInput input {};
+        input.keys = this->keys.load(std::memory_order_relaxed);
+        input.cameraRotation.x = this->cameraRotationX.exchange(0, std::memory_order_relaxed);
+        input.cameraRotation.y = this->cameraRotationY.exchange(0, std::memory_order_relaxed);
+        input.lightRotation = this->lightRotation.exchange(0, std::memory_order_relaxed);
+        input.lightDragging = this->lightDragging.load(std::memory_order_relaxed);
+        SimulationSettings settings {this->cameraSpeed.load(std::memory_order_relaxed),
+                                     this->rotationSpeed.load(std::memory_order_relaxed),
+                                     this->lightManualOnly.load(std::memory_order_relaxed)};
+
+        SimulationState previous = this->state;
+        advance(this->state, input, settings, 1.f / (float) RATE);
+
+        Snapshot& snapshot = this->snapshots.writeSlot();
+        snapshot.previous = previous;
+        snapshot.current = this->state;
+        snapshot.time = this->nextStep;
+        this->snapshots.publish();
+        this->sequence.fetch_add(1, std::memory_order_release);
+
+        this->steps.fetch_add(1, std::memory_order_relaxed);
+        this->nextStep += STEP;
+        due++;
+    }
+    // Too far behind, drop the missed steps rather than running them all
+    if (this->nextStep <= now) {
+        this->nextStep = now + STEP;
+    }
+}
+
+void Simulation::threadLoop() {
+    while (this->running.load()) {
+        this->runSteps(steady_clock::now());
+        std::this_thread::sleep_until(this->nextStep);
+    }
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <glm/glm.hpp>
+
+#include "triplebuffer.hpp"
+
+/**
+ * State advanced by the simulation
+ */
+struct SimulationState {
+    glm::vec3 cameraPosition;
+    glm::vec3 cameraDirection;
+    float lightRotation;
+};
+
+/**
+ * Input consumed by a simulation step
+ */
+struct SimulationInput {
+    // Keys held, see Simulation::Key
+    uint32_t keys;
+    // Mouse motion while rotating the camera, in pixels
+    glm::ivec2 cameraRotation;
+    // Mouse motion while rotating the light, in pixels
+    int lightRotation;
+    // The light is held by the mouse and does not rotate by itself
+    bool lightDragging;
+};
+
+/**
+ * Settings of the simulation, from the GUI
+ */
+struct SimulationSettings {
+    float cameraSpeed;
+    float rotationSpeed;
+    bool lightManualOnly;
+};
+
+/**
+ * Camera and light simulation at a fixed rate, optionally on its own thread.
+ * Input is accumulated from the thread handling the events without locking, and each step publishes a snapshot
+ * through a triple buffer. The render thread samples the latest snapshot, interpolated between its last two steps,
+ * so that neither thread ever waits for the other. For lower latency, the render thread can instead latch the
+ * latest snapshot extrapolated with the input not consumed yet.
+ */
+class Simulation {
+public:
+    /**
+     * Keys moving the camera
+     */
+    enum Key : uint32_t {
+        KEY_FORWARD = 1u << 0u,
+        KEY_BACKWARD = 1u << 1u,
+        KEY_LEFT = 1u << 2u,
+        KEY_RIGHT = 1u << 3u,
+        KEY_DOWN = 1u << 4u,
+        KEY_UP = 1u << 5u,
+    };
+
+    /**
+     * Steps per second
+     */
+    static const int RATE = 120;
+
+    /**
+     * Constructor
+     * @param initial State before the first step
+     */
+    explicit Simulation(const SimulationState& initial);
+
+    /**
+     * Destructor, stops the thread
+     */
+    ~Simulation();
+
+    /**
+     * Advance a state by one step
+     */
+    static void advance(SimulationState& state,
+                        const SimulationInput& input,
+                        const SimulationSettings& settings,
+                        float deltaTime) noexcept;
+
+    /**
+     * Set the keys held, any thread
+     */
+    void setKeys(uint32_t keys) noexcept;
+
+    /**
+     * Add mouse motion rotating the camera, any thread
+     */
+    void addCameraRotation(int dx, int dy) noexcept;
+
+    /**
+     * Add mouse motion rotating the light, any thread
+     */
+    void addLightRotation(int dx) noexcept;
+
+    /**
+     * Set whether the light is held by the mouse, any thread
+     */
+    void setLightDragging(bool dragging) noexcept;
+
+    /**
+     * Set the settings used by the next steps, any thread
+     */
+    void setSettings(const SimulationSettings& settings) noexcept;
+
+    /**
+     * Run the steps on a thread of their own
+     */
+    void startThread();
+
+    /**
+     * Run the steps from update() again
+     */
+    void stopThread();
+
+    bool isThreaded() const noexcept {
+        return this->thread.joinable();
+    }
+
+    /**
+     * Run the steps due by now, when not threaded
+     */
+    void update();
+
+    /**
+     * Restart from a state, dropping the pending input. Not to be called concurrently with sample().
+     */
+    void reset(const SimulationState& state);
+
+    /**
+     * Latest state, interpolated between its last two steps at the current time, one step behind. Render thread
+     * only.
+     */
+    SimulationState sample() noexcept;
+
+    /**
+     * Latest state, advanced to the current time with the input not consumed by a step yet, which is left for the
+     * next step. Spins while a step is being run. Render thread only.
+     */
+    SimulationState sampleLatched() noexcept;
+
+    /**
+     * @return Number of steps run
+     */
+    uint64_t stepCount() const noexcept {
+        return this->steps.load(std::memory_order_relaxed);
+    }
+
+private:
+    /**
+     * Published after each step
+     */
+    struct Snapshot {
+        SimulationState previous;
+        SimulationState current;
+        // Time of the current step
+        std::chrono::steady_clock::time_point time;
+    };
+
+    /**
+     * Run the steps due by a time, on the simulation thread if any
+     */
+    void runSteps(std::chrono::steady_clock::time_point now);
+
+    /**
+     * Loop of the simulation thread
+     */
+    void threadLoop();
+
+    //-------------------------------------------------------------------------
+    // Owned by the thread running the steps
+    //-------------------------------------------------------------------------
+    SimulationState state;
+    std::chrono::steady_clock::time_point nextStep;
+
+    //-------------------------------------------------------------------------
+    // Shared
+    //-------------------------------------------------------------------------
+    TripleBuffer<Snapshot> snapshots;
+    std::atomic<uint64_t> steps {0};
+    // Odd while a step consumes the input and publishes its snapshot, see sampleLatched()
+    std::atomic<uint32_t> sequence {0};
+    std::thread thread;
+    std::atomic<bool> running {false};
+
+    std::atomic<uint32_t> keys {0};
+    std::atomic<int> cameraRotationX {0};
+    std::atomic<int> cameraRotationY {0};
+    std::atomic<int> lightRotation {0};
+    std::atomic<bool> lightDragging {false};
+    std::atomic<float> cameraSpeed {30.f};
+    std::atomic<float> rotationSpeed {15.f};
+    std::atomic<bool> lightManualOnly {false};
+};
@@ -0,0 +1,62 @@
+#include "tessellationcontroller.hpp"
+
+#include <algorithm>
+
+namespace {
+    // Weight of the newest measurement in the moving average
+    const float SMOOTHING = 0.2f;
+}
+
+constexpr float TessellationController::RAISE_THRESHOLD;
+constexpr float TessellationController::STEP;
+
+TessellationController::TessellationController(float budgetMilliseconds) noexcept :
+    budgetMilliseconds(budgetMilliseconds) {}
+
+int TessellationController::update(float terrainMilliseconds, int tessellation) noexcept {
+    if (this->ceilingFrames > 0 && --this->ceilingFrames == 0) {
+        this->ceiling = 0;
+    }
+
+    if (terrainMilliseconds <= 0.f) {
+        return tessellation;
+    }
+
+    this->framesSinceChange++;
+    if (this->framesSinceChange <= COOLDOWN_FRAMES) {
+        // Still measuring the previous mesh
+        return tessellation;
+    }
+
+    if (this->smoothedMilliseconds < 0.f) {
+        this->smoothedMilliseconds = terrainMilliseconds;
+    } else {
+        this->smoothedMilliseconds += SMOOTHING * (terrainMilliseconds - this->smoothedMilliseconds);
+    }
+
+    int next = tessellation;
+    if (this->smoothedMilliseconds > this->budgetMilliseconds) {
+        next = std::max(this->minTessellation, (int) ((float) tessellation / STEP));
+        // Do not come back to this level right away
+        this->ceiling = tessellation;
+        this->ceilingFrames = BACKOFF_FRAMES;
+    } else if (this->smoothedMilliseconds < RAISE_THRESHOLD * this->budgetMilliseconds) {
+        next = std::min(this->maxTessellation, (int) ((float) tessellation * STEP) + 1);
+        if (this->ceiling > 0 && next >= this->ceiling) {
+            next = tessellation;
+        }
+    }
+
+    if (next != tessellation) {
+        this->smoothedMilliseconds = -1.f;
+        this->framesSinceChange = 0;
+    }
+    return next;
+}
+
+void TessellationController::reset() noexcept {
+    this->smoothedMilliseconds = -1.f;
+    this->framesSinceChange = 0;
+    this->ceiling = 0;
+    this->ceilingFrames = 0;
+}
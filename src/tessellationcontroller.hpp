@@ -0,0 +1,77 @@
+#pragma once
+
+/**
+ * Automatic terrain tessellation.
+ * Raises or lowers the tessellation level so that the measured GPU time of the terrain stays within a budget.
+ * To avoid oscillating, the level is only raised well under the budget and lowered over it, changes are followed by
+ * a cooldown, and a level found to be over budget is not tried again for a while.
+ */
+class TessellationController {
+public:
+    /**
+     * Constructor
+     * @param budgetMilliseconds GPU time budget of the terrain
+     */
+    explicit TessellationController(float budgetMilliseconds = 4.f) noexcept;
+
+    /**
+     * Feed the latest GPU time of the terrain, once per frame
+     * @param terrainMilliseconds GPU time of the terrain, negative if not available
+     * @param tessellation Current tessellation level
+     * @return Tessellation level to use
+     */
+    int update(float terrainMilliseconds, int tessellation) noexcept;
+
+    /**
+     * Forget the measurements and the levels found over budget
+     */
+    void reset() noexcept;
+
+    /**
+     * GPU time budget of the terrain
+     */
+    float budgetMilliseconds;
+
+    /**
+     * Tessellation bounds
+     */
+    int minTessellation {16};
+    int maxTessellation {2048};
+
+    /**
+     * Fraction of the budget under which the level is raised
+     */
+    static constexpr float RAISE_THRESHOLD = 0.7f;
+
+    /**
+     * Factor applied to the level on each change
+     */
+    static constexpr float STEP = 1.25f;
+
+    /**
+     * Frames to wait after a change, until measurements of the new mesh are available
+     */
+    static const int COOLDOWN_FRAMES = 10;
+
+    /**
+     * Frames during which a level found over budget is not tried again
+     */
+    static const int BACKOFF_FRAMES = 300;
+
+private:
+    /**
+     * Exponential moving average of the terrain time, negative if none
+     */
+    float smoothedMilliseconds {-1.f};
+
+    /**
+     * Frames since the last change
+     */
+    int framesSinceChange {0};
+
+    /**
+     * Lowest level found over budget, and frames left before trying it again
+     */
+    int ceiling {0};
+    int ceilingFrames {0};
+};
@@ -0,0 +1,420 @@
+#include "texturecontainer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <GLState.hpp>
+#include <Trace.hpp>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace owo {
+    namespace {
+        const char CONTAINER_MAGIC[8] = {'\xab', 'O', 'W', 'T', 'E', 'X', '\xbb', '\n'};
+        const uint32_t CONTAINER_VERSION = 1;
+        const uint64_t DATA_ALIGNMENT = 16;
+        const uint32_t MAX_TEXTURES = 64;
+        const uint32_t MAX_LEVELS = 16;
+        // Of a side, so that the sizes of the levels cannot overflow
+        const uint32_t MAX_SIZE = 1u << (MAX_LEVELS - 1);
+
+        struct FileHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t textureCount;
+        };
+
+        // Followed by its levels
+        struct TextureEntry {
+            char name[32];
+            uint32_t internalFormat;
+            uint32_t wrap;
+            uint32_t levelCount;
+            uint32_t reserved;
+        };
+
+        struct LevelEntry {
+            uint32_t width;
+            uint32_t height;
+            // From the start of the file
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        /**
+         * Read-only view of a whole file, mapped in memory where supported
+         */
+        class MappedFile {
+        public:
+            ~MappedFile() {
+#ifndef _WIN32
+                if (this->mapping != nullptr) {
+                    munmap(this->mapping, this->size);
+                }
+#endif
+            }
+
+            bool open(const std::string& path, std::string& error) {
+#ifdef _WIN32
+                std::ifstream file(path, std::ios::binary);
+                if (!file) {
+                    error = "cannot open the file";
+                    return false;
+                }
+                this->buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                this->data = (const unsigned char*) this->buffer.data();
+                this->size = this->buffer.size();
+                return true;
+#else
+                int descriptor = ::open(path.c_str(), O_RDONLY);
+                if (descriptor < 0) {
+                    error = "cannot open the file";
+                    return false;
+                }
+                struct stat info {};
+                if (fstat(descriptor, &info) != 0 || info.st_size <= 0) {
+                    close(descriptor);
+                    error = "empty file";
+                    return false;
+                }
+                this->size = (size_t) info.st_size;
+                void* mapping = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                // The mapping keeps the file open
+                close(descriptor);
+                if (mapping == MAP_FAILED) {
+                    error = "cannot map the file";
+                    return false;
+                }
+                this->mapping = mapping;
+                this->data = (const unsigned char*) mapping;
+                return true;
+#endif
+            }
+
+            const unsigned char* data {nullptr};
+            size_t size {0};
+
+        private:
+#ifdef _WIN32
+            std::vector<char> buffer;
+#else
+            void* mapping {nullptr};
+#endif
+        };
+
+        /**
+         * Client format and type of the texels of an uncompressed format
+         * @return False if compressed, or not supported by containers
+         */
+        bool pixelTransfer(GLenum internalFormat, GLenum& format, GLenum& type, int& bytesPerTexel) {
+            format = GL_RGB;
+            switch (internalFormat) {
+                case GL_RGB32F:
+                    type = GL_FLOAT;
+                    bytesPerTexel = 12;
+                    return true;
+                case GL_RGB9_E5:
+                    type = GL_UNSIGNED_INT_5_9_9_9_REV;
+                    bytesPerTexel = 4;
+                    return true;
+                case GL_R11F_G11F_B10F:
+                    type = GL_UNSIGNED_INT_10F_11F_11F_REV;
+                    bytesPerTexel = 4;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool isValidWrap(GLenum wrap) {
+            return wrap == GL_REPEAT || wrap == GL_MIRRORED_REPEAT || wrap == GL_CLAMP_TO_EDGE
+                   || wrap == GL_CLAMP_TO_BORDER;
+        }
+
+        bool isCompressed(GLenum internalFormat) {
+            return internalFormat == GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+        }
+
+        bool bc6hSupported() {
+            return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+        }
+
+        /**
+         * @return Bytes of a level in a supported format, 0 if the format is not supported
+         */
+        uint64_t levelSize(GLenum internalFormat, uint32_t width, uint32_t height) {
+            if (isCompressed(internalFormat)) {
+                // Blocks of 4x4 texels, 16 bytes each
+                return (uint64_t) ((width + 3) / 4) * ((height + 3) / 4) * 16;
+            }
+            GLenum format, type;
+            int bytesPerTexel;
+            if (!pixelTransfer(internalFormat, format, type, bytesPerTexel)) {
+                return 0;
+            }
+            return (uint64_t) width * height * bytesPerTexel;
+        }
+
+        uint64_t align(uint64_t offset) {
+            return (offset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+        }
+
+        struct ParsedTexture {
+            TextureEntry entry;
+            std::vector<LevelEntry> levels;
+        };
+
+        bool parseContainer(const MappedFile& file, std::vector<ParsedTexture>& textures, std::string& error) {
+            FileHeader header;
+            if (file.size < sizeof(header)) {
+                error = "truncated header";
+                return false;
+            }
+            memcpy(&header, file.data, sizeof(header));
+            if (memcmp(header.magic, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) != 0) {
+                error = "not a texture container";
+                return false;
+            }
+            if (header.version != CONTAINER_VERSION) {
+                error = "unsupported version " + std::to_string(header.version);
+                return false;
+            }
+            if (header.textureCount == 0 || header.textureCount > MAX_TEXTURES) {
+                error = "invalid texture count";
+                return false;
+            }
+
+            size_t position = sizeof(header);
+            std::set<std::string> names;
+            textures.resize(header.textureCount);
+            for (ParsedTexture& texture : textures) {
+                if (file.size - position < sizeof(TextureEntry)) {
+                    error = "truncated table";
+                    return false;
+                }
+                memcpy(&texture.entry, file.data + position, sizeof(TextureEntry));
+                position += sizeof(TextureEntry);
+                texture.entry.name[sizeof(texture.entry.name) - 1] = '\0';
+                std::string name = texture.entry.name;
+                if (texture.entry.levelCount == 0 || texture.entry.levelCount > MAX_LEVELS) {
+                    error = name + ": invalid level count";
+                    return false;
+                }
+                if (!names.insert(name).second) {
+                    error = name + ": duplicate texture";
+                    return false;
+                }
+                if (!isValidWrap(texture.entry.wrap)) {
+                    error = name + ": invalid wrap mode";
+                    return false;
+                }
+                // Baked on another machine, the uploads would fail and leave the texture without storage
+                if (isCompressed(texture.entry.internalFormat) && !bc6hSupported()) {
+                    error = name + ": BC6H compression not supported by the driver";
+                    return false;
+                }
+
+                texture.levels.resize(texture.entry.levelCount);
+                for (uint32_t i = 0; i < texture.entry.levelCount; i++) {
+                    LevelEntry& level = texture.levels[i];
+                    if (file.size - position < sizeof(LevelEntry)) {
+                        error = "truncated table";
+                        return false;
+                    }
+                    memcpy(&level, file.data + position, sizeof(LevelEntry));
+                    position += sizeof(LevelEntry);
+                    uint64_t expected = levelSize(texture.entry.internalFormat, level.width, level.height);
+                    if (expected == 0 || level.width == 0 || level.height == 0 || level.width > MAX_SIZE
+                        || level.height > MAX_SIZE) {
+                        error = name + ": unsupported format or size";
+                        return false;
+                    }
+                    // Levels must fit the storage allocated from the first one
+                    const LevelEntry& first = texture.levels[0];
+                    if (level.width != std::max(first.width >> i, 1u) || level.height != std::max(first.height >> i, 1u)
+                        || (i > 0 && std::max(texture.levels[i - 1].width, texture.levels[i - 1].height) == 1)) {
+                        error = name + ": level " + std::to_string(i) + " is not in the mipmap chain";
+                        return false;
+                    }
+                    if (level.size != expected || level.offset > file.size || file.size - level.offset < level.size) {
+                        error = name + ": level out of the file";
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+    }
+
+    bool downloadTexture(GLuint texture, const std::string& name, GLenum wrap, ContainerTexture& result,
+                         std::string& error) {
+        glstate::bindTexture(GL_TEXTURE_2D, texture);
+        GLint internalFormat = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        GLenum format, type;
+        int bytesPerTexel;
+        bool compressed = isCompressed((GLenum) internalFormat);
+        if (!compressed && !pixelTransfer((GLenum) internalFormat, format, type, bytesPerTexel)) {
+            error = name + ": format " + std::to_string(internalFormat) + " not supported by containers";
+            return false;
+        }
+
+        result.name = name;
+        result.internalFormat = (GLenum) internalFormat;
+        result.wrap = wrap;
+        result.levels.clear();
+        glstate::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        for (GLint level = 0; level < (GLint) MAX_LEVELS; level++) {
+            GLint width = 0, height = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+            if (width == 0 || height == 0) {
+                break;
+            }
+            ContainerLevel data {width, height, {}};
+            data.data.resize((size_t) levelSize((GLenum) internalFormat, (uint32_t) width, (uint32_t) height));
+            if (compressed) {
+                glGetCompressedTexImage(GL_TEXTURE_2D, level, data.data.data());
+            } else {
+                glGetTexImage(GL_TEXTURE_2D, level, format, type, data.data.data());
+            }
+            result.levels.push_back(std::move(data));
+        }
+        return !result.levels.empty();
+    }
+
+    bool writeTextureContainer(const std::string& path, const std::vector<ContainerTexture>& textures,
+                               std::string& error) {
+        FileHeader header {};
+        memcpy(header.magic, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC));
+        header.version = CONTAINER_VERSION;
+        header.textureCount = (uint32_t) textures.size();
+
+        // The table first, then the levels in the same order
+        uint64_t offset = sizeof(FileHeader);
+        for (const ContainerTexture& texture : textures) {
+            if (texture.name.size() >= sizeof(TextureEntry::name)) {
+                error = texture.name + ": name too long";
+                return false;
+            }
+            offset += sizeof(TextureEntry) + texture.levels.size() * sizeof(LevelEntry);
+        }
+
+        std::vector<char> table;
+        auto append = [&table](const void* value, size_t size) {
+            table.insert(table.end(), (const char*) value, (const char*) value + size);
+        };
+        append(&header, sizeof(header));
+        for (const ContainerTexture& texture : textures) {
+            TextureEntry entry {};
+            memcpy(entry.name, texture.name.c_str(), texture.name.size());
+            entry.internalFormat = texture.internalFormat;
+            entry.wrap = texture.wrap;
+            entry.levelCount = (uint32_t) texture.levels.size();
+            append(&entry, sizeof(entry));
+            for (const ContainerLevel& level : texture.levels) {
+                offset = align(offset);
+                LevelEntry levelEntry {(uint32_t) level.width, (uint32_t) level.height, offset, level.data.size()};
+                append(&levelEntry, sizeof(levelEntry));
+                offset += level.data.size();
+            }
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(table.data(), (std::streamsize) table.size());
+        uint64_t position = table.size();
+        const char padding[DATA_ALIGNMENT] = {};
+        for (const ContainerTexture& texture : textures) {
+            for (const ContainerLevel& level : texture.levels) {
+                file.write(padding, (std::streamsize) (align(position) - position));
+                file.write(level.data.data(), (std::streamsize) level.data.size());
+                position = align(position) + level.data.size();
+            }
+        }
+        if (!file) {
+            error = "cannot write " + path;
+            return false;
+        }
+        return true;
+    }
+
+    bool loadTextureContainer(const std::string& path, std::map<std::string, GLuint>& textures, std::string& error) {
+        OWO_PROFILE_SCOPE("loadTextureContainer");
+        MappedFile file;
+        std::vector<ParsedTexture> parsed;
+        if (!file.open(path, error) || !parseContainer(file, parsed, error)) {
+            error = path + ": " + error;
+            return false;
+        }
+
+        // One buffer for the data of all the levels, which the driver copies from while the file is mapped
+        uint64_t begin = file.size, end = 0;
+        for (const ParsedTexture& texture : parsed) {
+            for (const LevelEntry& level : texture.levels) {
+                begin = std::min(begin, level.offset);
+                end = std::max(end, level.offset + level.size);
+            }
+        }
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glstate::bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) (end - begin), file.data + begin, GL_STREAM_DRAW);
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        for (const ParsedTexture& texture : parsed) {
+            const TextureEntry& entry = texture.entry;
+            GLuint texId;
+            glGenTextures(1, &texId);
+            glstate::bindTexture(GL_TEXTURE_2D, texId);
+            GLint levels = (GLint) entry.levelCount;
+            if (GLEW_ARB_texture_storage) {
+                glTexStorage2D(GL_TEXTURE_2D, levels, entry.internalFormat, texture.levels[0].width,
+                               texture.levels[0].height);
+            }
+
+            GLenum format = GL_RGB, type = GL_FLOAT;
+            int bytesPerTexel;
+            bool compressed = !pixelTransfer(entry.internalFormat, format, type, bytesPerTexel);
+            for (GLint i = 0; i < levels; i++) {
+                const LevelEntry& level = texture.levels[i];
+                // Offset in the bound buffer
+                const GLvoid* data = (const GLvoid*) (uintptr_t) (level.offset - begin);
+                GLsizei width = (GLsizei) level.width, height = (GLsizei) level.height;
+                if (GLEW_ARB_texture_storage && compressed) {
+                    glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, width, height, entry.internalFormat,
+                                              (GLsizei) level.size, data);
+                } else if (GLEW_ARB_texture_storage) {
+                    glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, width, height, format, type, data);
+                } else if (compressed) {
+                    glCompressedTexImage2D(GL_TEXTURE_2D, i, entry.internalFormat, width, height, 0,
+                                           (GLsizei) level.size, data);
+                } else {
+                    glTexImage2D(GL_TEXTURE_2D, i, entry.internalFormat, width, height, 0, format, type, data);
+                }
+            }
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, (GLint) entry.wrap);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, (GLint) entry.wrap);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            textures[entry.name] = texId;
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        glstate::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        // Released by the driver once the uploads are done
+        glDeleteBuffers(1, &buffer);
+        return true;
+    }
+}
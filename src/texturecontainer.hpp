@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+/**
+ * Container of 2D textures in their final GPU format, all levels included, in the spirit of KTX: a header, a table of
+ * the textures and of their levels, then the data of the levels. Loading maps the file and uploads the levels as they
+ * are, through a pixel unpack buffer, into textures of immutable storage, with no decoding or conversion.
+ * Values are little-endian, the data of each level 16-byte aligned.
+ */
+namespace owo {
+    struct ContainerLevel {
+        int width;
+        int height;
+        std::vector<char> data;
+    };
+
+    struct ContainerTexture {
+        // At most 31 characters
+        std::string name;
+        GLenum internalFormat;
+        // GL_TEXTURE_WRAP_S and T
+        GLenum wrap;
+        std::vector<ContainerLevel> levels;
+    };
+
+    /**
+     * Read back all the levels of a 2D texture, as stored on the GPU
+     * @return False if its format cannot be stored in a container
+     */
+    bool downloadTexture(GLuint texture, const std::string& name, GLenum wrap, ContainerTexture& result,
+                         std::string& error);
+
+    bool writeTextureContainer(const std::string& path, const std::vector<ContainerTexture>& textures,
+                               std::string& error);
+
+    /**
+     * Create the textures of a container, filtered linearly between their texels and levels
+     * @param textures Set to the textures by name
+     * @param error Set to the reason of a failure, e.g. a corrupt file
+     * @return False if the file cannot be read, no texture being created
+     */
+    bool loadTextureContainer(const std::string& path, std::map<std::string, GLuint>& textures, std::string& error);
+}
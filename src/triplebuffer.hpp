@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free triple buffer, passing the latest value from one writer thread to one reader thread.
+ * The writer fills its own slot and publishes it by swapping it with the shared one, the reader swaps the shared slot
+ * with its own when a newer value was published. Neither ever waits, and values the reader did not pick up in time
+ * are overwritten.
+ */
+template<typename T>
+class TripleBuffer {
+public:
+    /**
+     * Default constructor, all slots hold T()
+     */
+    TripleBuffer() = default;
+
+    /**
+     * Constructor
+     * @param initial Value read until the first publication
+     */
+    explicit TripleBuffer(const T& initial) {
+        for (T& slot : this->slots) {
+            slot = initial;
+        }
+    }
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    /**
+     * @return Slot to fill before publishing, writer only
+     */
+    T& writeSlot() noexcept {
+        return this->slots[this->back];
+    }
+
+    /**
+     * Make the written slot the latest value, writer only
+     */
+    void publish() noexcept {
+        this->back = this->shared.exchange(this->back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    /**
+     * Pick up the latest value if a newer one was published, reader only
+     * @return True if the value changed
+     */
+    bool update() noexcept {
+        if ((this->shared.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        this->front = this->shared.exchange(this->front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    /**
+     * @return Value picked up by the last update(), reader only
+     */
+    const T& read() const noexcept {
+        return this->slots[this->front];
+    }
+
+private:
+    static const uint8_t INDEX_MASK = 3;
+    // Set in the shared index when it holds a value the reader has not seen yet
+    static const uint8_t FRESH = 4;
+
+    T slots[3] {};
+    uint8_t back {0};
+    std::atomic<uint8_t> shared {1};
+    uint8_t front {2};
+};
@@ -0,0 +1,112 @@
+#include <GL/glew.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <labhelper.hpp>
+#include <GLState.hpp>
+
+#include "hdr.hpp"
+#include "texturecontainer.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// Bakes the environment maps starting with a path, e.g. ../scenes/envmaps/001
+// for 001.hdr, 001_irradiance.hdr and 001_dl_0..7.hdr, to a texture container
+// per format, next to them: 001.rgb9e5.owotex, etc. The textures are loaded
+// as the engine loads them, then read back from the GPU, so that the
+// containers hold what the driver made of them, BC6H included, and the
+// engine only has to upload them.
+//
+// Usage: envbake [--format rgb32f|rgb9e5|r11g11b10f|bc6h] BASE
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    const int ROUGHNESSES = 8;
+
+    /**
+     * Download a loaded texture to the container, which is skipped if it could not be loaded
+     */
+    void addTexture(GLuint texture, const std::string& name, GLenum wrap, std::vector<owo::ContainerTexture>& textures) {
+        if (texture == 0) {
+            std::cout << "Skipping " << name << "\n";
+            return;
+        }
+        owo::ContainerTexture result;
+        std::string error;
+        if (!owo::downloadTexture(texture, name, wrap, result, error)) {
+            std::cout << "ERROR: addTexture(): " << error << "\n";
+        } else {
+            textures.push_back(std::move(result));
+        }
+        glDeleteTextures(1, &texture);
+        // Unbound, and its name may be given to the next texture
+        owo::glstate::invalidate();
+    }
+
+    bool bake(const std::string& base, owo::HdrFormat format) {
+        std::vector<std::string> filenames;
+        for (int i = 0; i < ROUGHNESSES; i++) {
+            filenames.push_back(base + "_dl_" + std::to_string(i) + ".hdr");
+        }
+
+        // Names and wrap modes of the textures of loadEnvironmentMaps()
+        std::vector<owo::ContainerTexture> textures;
+        addTexture(owo::loadHdrMipmapTexture(filenames, format), "reflection", GL_REPEAT, textures);
+        addTexture(owo::loadHdrTexture(base + ".hdr", format), "environment", GL_CLAMP_TO_EDGE, textures);
+        addTexture(owo::loadHdrTexture(base + "_irradiance.hdr", format), "irradiance", GL_CLAMP_TO_EDGE, textures);
+        if (textures.empty()) {
+            std::cout << "ERROR: bake(): no environment map at " << base << "\n";
+            return false;
+        }
+
+        std::string path = owo::hdrContainerPath(base, format);
+        std::string error;
+        if (!owo::writeTextureContainer(path, textures, error)) {
+            std::cout << "ERROR: bake(): " << error << "\n";
+            return false;
+        }
+        std::cout << "Wrote " << path << "\n";
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string base;
+    std::vector<owo::HdrFormat> formats;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        owo::HdrFormat format;
+        if (arg == "--format" && i + 1 < argc) {
+            if (!owo::parseHdrFormat(argv[++i], format)) {
+                std::cout << "Unknown format " << argv[i] << "\n";
+                return 1;
+            }
+            formats.push_back(format);
+        } else {
+            base = arg;
+        }
+    }
+    if (base.empty()) {
+        std::cout << "Usage: envbake [--format rgb32f|rgb9e5|r11g11b10f|bc6h] BASE\n";
+        return 1;
+    }
+    // All of them by default
+    for (int format = 0; formats.empty() && format < owo::HDR_FORMAT_COUNT; format++) {
+        formats.push_back((owo::HdrFormat) format);
+    }
+
+    SDL_Window* hiddenWindow = nullptr;
+    if (!owo::init_offscreen_GL(hiddenWindow)) {
+        std::cout << "ERROR: main(): no OpenGL context\n";
+        return 1;
+    }
+    // Encoded from the .hdr files, not from what a previous run cached
+    owo::setHdrTextureCache("");
+
+    bool baked = true;
+    for (owo::HdrFormat format : formats) {
+        baked = bake(base, format) && baked;
+    }
+    owo::shutDownOffscreen(hiddenWindow);
+    return baked ? 0 : 1;
+}